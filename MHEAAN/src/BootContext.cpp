@@ -8,8 +8,25 @@
 
 #include "BootContext.h"
 
-BootContext::BootContext(uint64_t** rpxVec,  uint64_t** rpxInvVec, uint64_t* rp1, uint64_t* rp2,
-		long* bndVec, long* bndInvVec, long bnd1, long bnd2, long logp)
-			: rpxVec(rpxVec), rpxInvVec(rpxInvVec), rp1(rp1), rp2(rp2),
-			  bndVec(bndVec), bndInvVec(bndInvVec), bnd1(bnd1), bnd2(bnd2), logp(logp) {
+BootContext::BootContext(residue_t** rpxVec,  residue_t** rpxInvVec, residue_t** rpxShoupVec, residue_t** rpxInvShoupVec,
+		residue_t* rp1, residue_t* rp2, long* bndVec, long* bndInvVec, long bnd1, long bnd2, long logp, long n0)
+			: rpxVec(rpxVec), rpxInvVec(rpxInvVec), rpxShoupVec(rpxShoupVec), rpxInvShoupVec(rpxInvShoupVec), rp1(rp1), rp2(rp2),
+			  bndVec(bndVec), bndInvVec(bndInvVec), bnd1(bnd1), bnd2(bnd2), logp(logp), n0(n0) {
+}
+
+BootContext::~BootContext() {
+	for (long i = 0; i < n0; ++i) {
+		if(rpxVec != NULL) delete[] rpxVec[i];
+		if(rpxInvVec != NULL) delete[] rpxInvVec[i];
+		if(rpxShoupVec != NULL) delete[] rpxShoupVec[i];
+		if(rpxInvShoupVec != NULL) delete[] rpxInvShoupVec[i];
+	}
+	delete[] rpxVec;
+	delete[] rpxInvVec;
+	delete[] rpxShoupVec;
+	delete[] rpxInvShoupVec;
+	delete[] rp1;
+	delete[] rp2;
+	delete[] bndVec;
+	delete[] bndInvVec;
 }
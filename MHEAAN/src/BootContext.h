@@ -9,6 +9,7 @@
 #ifndef MPHEAAN_BOOTCONTEXT_H_
 #define MPHEAAN_BOOTCONTEXT_H_
 
+#include "Params.h"
 #include <NTL/ZZ.h>
 
 using namespace NTL;
@@ -16,10 +17,12 @@ using namespace NTL;
 class BootContext {
 public:
 
-	uint64_t** rpxVec;
-	uint64_t** rpxInvVec;
-	uint64_t* rp1;
-	uint64_t* rp2;
+	residue_t** rpxVec;
+	residue_t** rpxInvVec;
+	residue_t** rpxShoupVec; ///< Shoup companions of rpxVec
+	residue_t** rpxInvShoupVec;
+	residue_t* rp1;
+	residue_t* rp2;
 
 	long* bndVec;
 	long* bndInvVec;
@@ -28,8 +31,12 @@ public:
 
 	long logp;
 
-	BootContext(uint64_t** rpxVec = NULL, uint64_t** rpxInvVec = NULL, uint64_t* rp1 = NULL, uint64_t* rp2 = NULL,
-			long* bndVec = NULL, long* bndInvVec = NULL, long bnd1 = 0, long bnd2 = 0, long logp = 0);
+	long n0; ///< entries of the vectors, all owned by the context
+
+	BootContext(residue_t** rpxVec = NULL, residue_t** rpxInvVec = NULL, residue_t** rpxShoupVec = NULL, residue_t** rpxInvShoupVec = NULL,
+			residue_t* rp1 = NULL, residue_t* rp2 = NULL, long* bndVec = NULL, long* bndInvVec = NULL, long bnd1 = 0, long bnd2 = 0, long logp = 0, long n0 = 0);
+
+	virtual ~BootContext();
 
 };
 
@@ -11,11 +11,36 @@
 Ciphertext::Ciphertext(long logp, long logq, long n0, long n1) : logp(logp), logq(logq), n0(n0), n1(n1) {
 }
 
-Ciphertext::Ciphertext(const Ciphertext& o) : logp(o.logp), logq(o.logq), n0(o.n0), n1(o.n1) {
-	for (long i = 0; i < N; ++i) {
-		ax[i] = o.ax[i];
-		bx[i] = o.bx[i];
+Ciphertext::Ciphertext(const Ciphertext& o) : ax(o.ax), bx(o.bx), logp(o.logp), logq(o.logq), n0(o.n0), n1(o.n1) {
+}
+
+Ciphertext::Ciphertext(Ciphertext&& o) noexcept : ax(std::move(o.ax)), bx(std::move(o.bx)), logp(o.logp), logq(o.logq), n0(o.n0), n1(o.n1) {
+}
+
+Ciphertext& Ciphertext::operator=(const Ciphertext& o) {
+	if(this != &o) {
+		logp = o.logp;
+		logq = o.logq;
+		n0 = o.n0;
+		n1 = o.n1;
+		ax.copy(o.ax);
+		bx.copy(o.bx);
 	}
+	return *this;
+}
+
+Ciphertext& Ciphertext::operator=(Ciphertext&& o) noexcept {
+	swap(o);
+	return *this;
+}
+
+void Ciphertext::swap(Ciphertext& o) {
+	ax.swap(o.ax);
+	bx.swap(o.bx);
+	std::swap(logp, o.logp);
+	std::swap(logq, o.logq);
+	std::swap(n0, o.n0);
+	std::swap(n1, o.n1);
 }
 
 void Ciphertext::copyParams(Ciphertext& o) {
@@ -27,20 +52,22 @@ void Ciphertext::copyParams(Ciphertext& o) {
 
 void Ciphertext::copy(Ciphertext& o) {
 	copyParams(o);
-	for (long i = 0; i < N; ++i) {
-		ax[i] = o.ax[i];
-		bx[i] = o.bx[i];
-	}
+	ax.copy(o.ax);
+	bx.copy(o.bx);
 }
 
 void Ciphertext::free() {
-	for (long i = 0; i < N; ++i) {
-		clear(ax[i]);
-		clear(bx[i]);
+	if(ax.data != NULL) {
+		for (long i = 0; i < (ax.nlimbs << logN); ++i) {
+			ax.data[i] = 0;
+		}
+	}
+	if(bx.data != NULL) {
+		for (long i = 0; i < (bx.nlimbs << logN); ++i) {
+			bx.data[i] = 0;
+		}
 	}
 }
 
 Ciphertext::~Ciphertext() {
-	delete[] ax;
-	delete[] bx;
 }
@@ -11,6 +11,7 @@
 
 #include <NTL/ZZ.h>
 #include "Params.h"
+#include "CoeffArray.h"
 
 using namespace std;
 using namespace NTL;
@@ -19,8 +20,8 @@ class Ciphertext {
 
 public:
 
-	ZZ* ax = new ZZ[N];
-	ZZ* bx = new ZZ[N];
+	CoeffArray ax = CoeffArray(qbnd); ///< coefficients mod 2^logq, allocated by the first operation that writes them
+	CoeffArray bx = CoeffArray(qbnd);
 
 	long logp;
 	long logq;
@@ -32,11 +33,19 @@ public:
 
 	Ciphertext(const Ciphertext& o);
 
+	Ciphertext(Ciphertext&& o) noexcept; ///< takes the arrays of o, which may then only be assigned to, copied into or destroyed
+
+	Ciphertext& operator=(const Ciphertext& o);
+
+	Ciphertext& operator=(Ciphertext&& o) noexcept;
+
+	void swap(Ciphertext& o);
+
 	void copyParams(Ciphertext& o);
 
 	void copy(Ciphertext& o);
 
-	void free();
+	void free(); ///< sets every coefficient to zero
 
 	virtual ~Ciphertext();
 };
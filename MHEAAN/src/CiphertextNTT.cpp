@@ -0,0 +1,84 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#include "CiphertextNTT.h"
+
+CiphertextNTT::CiphertextNTT(long np, long logp, long logq, long n0, long n1) : np(np), logb(logq), logp(logp), logq(logq), n0(n0), n1(n1) {
+	rax = new residue_t[np << logN];
+	rbx = new residue_t[np << logN];
+}
+
+CiphertextNTT::CiphertextNTT(const CiphertextNTT& o) : np(o.np), logb(o.logb), logp(o.logp), logq(o.logq), n0(o.n0), n1(o.n1) {
+	rax = new residue_t[np << logN];
+	rbx = new residue_t[np << logN];
+	for (long i = 0; i < (np << logN); ++i) {
+		rax[i] = o.rax[i];
+		rbx[i] = o.rbx[i];
+	}
+}
+
+CiphertextNTT::CiphertextNTT(CiphertextNTT&& o) noexcept : rax(o.rax), rbx(o.rbx), np(o.np), logb(o.logb), logp(o.logp), logq(o.logq), n0(o.n0), n1(o.n1) {
+	o.rax = NULL;
+	o.rbx = NULL;
+	o.np = 0;
+}
+
+CiphertextNTT& CiphertextNTT::operator=(const CiphertextNTT& o) {
+	if(this != &o) {
+		copy(o);
+	}
+	return *this;
+}
+
+CiphertextNTT& CiphertextNTT::operator=(CiphertextNTT&& o) noexcept {
+	swap(o);
+	return *this;
+}
+
+void CiphertextNTT::swap(CiphertextNTT& o) {
+	std::swap(rax, o.rax);
+	std::swap(rbx, o.rbx);
+	std::swap(np, o.np);
+	std::swap(logb, o.logb);
+	std::swap(logp, o.logp);
+	std::swap(logq, o.logq);
+	std::swap(n0, o.n0);
+	std::swap(n1, o.n1);
+}
+
+void CiphertextNTT::copyParams(const CiphertextNTT& o) {
+	logb = o.logb;
+	logp = o.logp;
+	logq = o.logq;
+	n0 = o.n0;
+	n1 = o.n1;
+}
+
+void CiphertextNTT::copy(const CiphertextNTT& o) {
+	copyParams(o);
+	resize(o.np);
+	for (long i = 0; i < (np << logN); ++i) {
+		rax[i] = o.rax[i];
+		rbx[i] = o.rbx[i];
+	}
+}
+
+void CiphertextNTT::resize(long np) {
+	if (np > this->np) {
+		delete[] rax;
+		delete[] rbx;
+		rax = new residue_t[np << logN];
+		rbx = new residue_t[np << logN];
+	}
+	this->np = np;
+}
+
+CiphertextNTT::~CiphertextNTT() {
+	delete[] rax;
+	delete[] rbx;
+}
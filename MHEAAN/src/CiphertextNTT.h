@@ -0,0 +1,58 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#ifndef MHEAAN_CIPHERTEXTNTT_H_
+#define MHEAAN_CIPHERTEXTNTT_H_
+
+#include "Params.h"
+
+using namespace std;
+
+// Double-CRT form of a ciphertext: ax and bx are kept as residues modulo the first np primes,
+// transformed by RingMultiplier::NTT and laid out prime-major like Key::rax.
+// The residues stand for integer polynomials with coefficients below 2^logb in absolute value,
+// so they are exact while np * pbnd > logb + 1; Scheme::toNTT and Scheme::fromNTT convert to and from Ciphertext.
+// Scheme re-images an operand from its value mod q when an operation would outgrow its primes.
+class CiphertextNTT {
+
+public:
+
+	residue_t* rax;
+	residue_t* rbx;
+
+	long np;
+	long logb;
+
+	long logp;
+	long logq;
+
+	long n0;
+	long n1;
+
+	CiphertextNTT(long np = 0, long logp = 0, long logq = 0, long n0 = 0, long n1 = 0);
+
+	CiphertextNTT(const CiphertextNTT& o);
+
+	CiphertextNTT(CiphertextNTT&& o) noexcept; ///< takes the images of o, which may then only be assigned to, copied into or destroyed
+
+	CiphertextNTT& operator=(const CiphertextNTT& o);
+
+	CiphertextNTT& operator=(CiphertextNTT&& o) noexcept;
+
+	void swap(CiphertextNTT& o);
+
+	void copyParams(const CiphertextNTT& o);
+
+	void copy(const CiphertextNTT& o);
+
+	void resize(long np); ///< shrinking keeps the first np residues, growing leaves the images undefined
+
+	virtual ~CiphertextNTT();
+};
+
+#endif
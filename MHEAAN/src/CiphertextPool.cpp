@@ -0,0 +1,42 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#include "CiphertextPool.h"
+
+CiphertextPool::CiphertextPool(size_t capacity) : capacity(capacity) {
+}
+
+Ciphertext CiphertextPool::take(long logp, long logq, long n0, long n1) {
+	m.lock();
+	if(ciphers.empty()) {
+		m.unlock();
+		return Ciphertext(logp, logq, n0, n1);
+	}
+	Ciphertext res(std::move(ciphers.back()));
+	ciphers.pop_back();
+	m.unlock();
+	res.logp = logp;
+	res.logq = logq;
+	res.n0 = n0;
+	res.n1 = n1;
+	return res;
+}
+
+void CiphertextPool::give(Ciphertext& cipher) {
+	m.lock();
+	if(cipher.ax.data != NULL && ciphers.size() < capacity) {
+		ciphers.push_back(std::move(cipher));
+	}
+	m.unlock();
+}
+
+void CiphertextPool::clear() {
+	m.lock();
+	ciphers.clear();
+	m.unlock();
+}
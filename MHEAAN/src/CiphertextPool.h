@@ -0,0 +1,39 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#ifndef MHEAAN_CIPHERTEXTPOOL_H_
+#define MHEAAN_CIPHERTEXTPOOL_H_
+
+#include <mutex>
+#include <vector>
+
+#include "Ciphertext.h"
+
+using namespace std;
+
+// Spare ciphertexts for temporaries: a taken ciphertext keeps the coefficient arrays of its previous use,
+// so overwriting it does not allocate. Its coefficients are stale until written.
+// take and give may be called from several threads.
+class CiphertextPool {
+
+public:
+
+	vector<Ciphertext> ciphers;
+	mutex m;
+
+	size_t capacity; ///< spare ciphertexts kept at most, the rest are freed, each holds 16 * qbnd * N bytes
+
+	CiphertextPool(size_t capacity);
+
+	Ciphertext take(long logp = 0, long logq = 0, long n0 = 0, long n1 = 0);
+	void give(Ciphertext& cipher); ///< moves the arrays of cipher into the pool unless it is full
+
+	void clear();
+};
+
+#endif
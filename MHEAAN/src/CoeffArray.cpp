@@ -0,0 +1,64 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#include "CoeffArray.h"
+
+CoeffArray::CoeffArray(long nlimbs) : nlimbs(nlimbs) {
+}
+
+CoeffArray::CoeffArray(const CoeffArray& o) : nlimbs(o.nlimbs) {
+	if (o.data == NULL) return;
+	data = new uint64_t[nlimbs << logN];
+	for (long i = 0; i < (nlimbs << logN); ++i) {
+		data[i] = o.data[i];
+	}
+}
+
+CoeffArray::CoeffArray(CoeffArray&& o) noexcept : nlimbs(o.nlimbs), data(o.data) {
+	o.data = NULL;
+}
+
+CoeffArray& CoeffArray::operator=(const CoeffArray& o) {
+	if (this != &o) copy(o);
+	return *this;
+}
+
+CoeffArray& CoeffArray::operator=(CoeffArray&& o) noexcept {
+	swap(o);
+	return *this;
+}
+
+void CoeffArray::swap(CoeffArray& o) {
+	std::swap(nlimbs, o.nlimbs);
+	std::swap(data, o.data);
+}
+
+void CoeffArray::copy(const CoeffArray& o) {
+	if (o.data == NULL) {
+		delete[] data;
+		data = NULL;
+		nlimbs = o.nlimbs;
+		return;
+	}
+	if (data == NULL || nlimbs != o.nlimbs) {
+		delete[] data;
+		nlimbs = o.nlimbs;
+		data = new uint64_t[nlimbs << logN];
+	}
+	for (long i = 0; i < (nlimbs << logN); ++i) {
+		data[i] = o.data[i];
+	}
+}
+
+void CoeffArray::alloc() {
+	if (data == NULL) data = new uint64_t[nlimbs << logN]();
+}
+
+CoeffArray::~CoeffArray() {
+	delete[] data;
+}
@@ -0,0 +1,50 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#ifndef MHEAAN_COEFFARRAY_H_
+#define MHEAAN_COEFFARRAY_H_
+
+#include "Params.h"
+
+using namespace std;
+
+// N coefficients modulo 2^logq as fixed-width integers of nlimbs 64-bit words in one allocation, a flat alternative to ZZ[N].
+// The Ring kernels leave each coefficient in [0, 2^logq), except normalizeAndEqual, which sign-extends it
+// from bit logq - 1 over all nlimbs words. Conversions to residues and to ZZ read the top bit of the top word
+// as the sign, so an unsigned value needs logq < 64 * nlimbs.
+// data stays NULL until alloc, which the kernels call on every array they touch, so an array that was never
+// written costs no memory and reads as zero.
+// Storage is limb-major: word j of coefficient n is data[(j << logN) + n], so the carry chains of
+// neighbouring coefficients run in neighbouring words and the kernels vectorize across coefficients.
+class CoeffArray {
+
+public:
+
+	long nlimbs; ///< at most cbnd
+	uint64_t* data = NULL;
+
+	CoeffArray(long nlimbs = cbnd); ///< does not allocate
+
+	CoeffArray(const CoeffArray& o);
+
+	CoeffArray(CoeffArray&& o) noexcept; ///< takes the words of o, which may then only be assigned to, copied into or destroyed
+
+	CoeffArray& operator=(const CoeffArray& o);
+
+	CoeffArray& operator=(CoeffArray&& o) noexcept;
+
+	void swap(CoeffArray& o);
+
+	void copy(const CoeffArray& o);
+
+	void alloc(); ///< allocates zeroed words if data is NULL
+
+	virtual ~CoeffArray();
+};
+
+#endif
@@ -8,10 +8,47 @@
 
 #include "Key.h"
 
-Key::Key() {
+static residue_t* truncateResidues(residue_t* ra, long np) {
+	if(ra == NULL) return NULL;
+	residue_t* res = new residue_t[np << logN];
+	for (long n = 0; n < (np << logN); ++n) {
+		res[n] = ra[n];
+	}
+	delete[] ra;
+	return res;
+}
+
+Key::Key(bool isSeeded, long np) : np(np) {
+	if(isSeeded) {
+		seed = new unsigned char[NTL_PRG_KEYLEN];
+	} else {
+		rax = new residue_t[np << logN];
+	}
+	rbx = new residue_t[np << logN];
+}
+
+Key::Key(unsigned char* seed, residue_t* rax, residue_t* rbx, long np) : np(np), rax(rax), rbx(rbx), seed(seed), isView(true) {
+}
+
+void Key::truncate(long np) {
+	if(isView) {
+		if(np < this->np) this->np = np;
+	} else if(np < this->np) {
+		rax = truncateResidues(rax, np);
+		rbx = truncateResidues(rbx, np);
+		raxShoup = truncateResidues(raxShoup, np);
+		rbxShoup = truncateResidues(rbxShoup, np);
+		this->np = np;
+	}
 }
 
 Key::~Key() {
-	delete[] rax;
-	delete[] rbx;
+	if(!isView) {
+		delete[] rbx;
+		delete[] seed;
+	}
+	// the rax of a seeded view can only come from Scheme::expandKey
+	if(!isView || seed != NULL) delete[] rax;
+	delete[] raxShoup;
+	delete[] rbxShoup;
 }
@@ -17,10 +17,23 @@ using namespace NTL;
 class Key {
 public:
 
-	uint64_t* rax = new uint64_t[Nnprimes];
-	uint64_t* rbx = new uint64_t[Nnprimes];
+	long np; ///< residues are kept for the first np primes, a key switch needing more primes cannot use the key
 
-	Key();
+	residue_t* rax = NULL; ///< NULL for a seeded key until Scheme::expandKey
+	residue_t* rbx;
+
+	residue_t* raxShoup = NULL; ///< optional Shoup companions of rax, see RingMultiplier::toShoup
+	residue_t* rbxShoup = NULL;
+
+	unsigned char* seed = NULL; ///< NTL_PRG_KEYLEN bytes, ax is the uniform sample expanded from them
+
+	bool isView = false; ///< rax, rbx and seed point into a key file mapped by a KeyStore and are not freed
+
+	Key(bool isSeeded = false, long np = nprimes);
+
+	Key(unsigned char* seed, residue_t* rax, residue_t* rbx, long np); ///< view of residues owned elsewhere
+
+	void truncate(long np); ///< drops the residues of primes np and above, releasing their memory
 
 	virtual ~Key();
 };
@@ -0,0 +1,123 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#include "KeyCache.h"
+
+KeyCache::KeyCache(long budget) : budget(budget) {
+}
+
+long KeyCache::keyBytes(Key& key) {
+	long arrays = 1;
+	if(key.rax != NULL) arrays++;
+	if(key.raxShoup != NULL) arrays++;
+	if(key.rbxShoup != NULL) arrays++;
+	return ((arrays * key.np) << logN) * sizeof(residue_t);
+}
+
+Key* KeyCache::acquire(string path) {
+	m.lock();
+	auto it = entries.find(path);
+	if(it == entries.end()) {
+		misses++;
+		m.unlock();
+		return NULL;
+	}
+	hits++;
+	it->second.refs++;
+	it->second.tick = ++clock;
+	Key* key = it->second.key;
+	m.unlock();
+	return key;
+}
+
+Key& KeyCache::insert(string path, Key* key) {
+	m.lock();
+	auto it = entries.find(path);
+	if(it != entries.end()) {
+		delete key;
+		it->second.refs++;
+		it->second.tick = ++clock;
+		key = it->second.key;
+		m.unlock();
+		return *key;
+	}
+	long kbytes = keyBytes(*key);
+	while(bytes + kbytes > budget) {
+		auto lru = entries.end();
+		for (auto e = entries.begin(); e != entries.end(); ++e) {
+			if(e->second.refs == 0 && pinned.find(e->first) == pinned.end() && (lru == entries.end() || e->second.tick < lru->second.tick)) {
+				lru = e;
+			}
+		}
+		if(lru == entries.end()) break;
+		bytes -= lru->second.bytes;
+		paths.erase(lru->second.key);
+		delete lru->second.key;
+		entries.erase(lru);
+		evictions++;
+	}
+	entries.insert(pair<string, KeyCacheEntry>(path, {key, kbytes, 1, ++clock}));
+	paths.insert(pair<Key*, string>(key, path));
+	bytes += kbytes;
+	m.unlock();
+	return *key;
+}
+
+void KeyCache::release(Key& key) {
+	m.lock();
+	auto it = paths.find(&key);
+	if(it != paths.end()) {
+		entries.at(it->second).refs--;
+	}
+	m.unlock();
+}
+
+void KeyCache::pin(string path) {
+	m.lock();
+	pinned.insert(path);
+	m.unlock();
+}
+
+void KeyCache::unpin(string path) {
+	m.lock();
+	pinned.erase(path);
+	m.unlock();
+}
+
+void KeyCache::drop(string path) {
+	m.lock();
+	auto it = entries.find(path);
+	if(it != entries.end() && it->second.refs == 0) {
+		bytes -= it->second.bytes;
+		paths.erase(it->second.key);
+		delete it->second.key;
+		entries.erase(it);
+	}
+	m.unlock();
+}
+
+void KeyCache::clear() {
+	m.lock();
+	for (auto it = entries.begin(); it != entries.end();) {
+		if(it->second.refs == 0) {
+			bytes -= it->second.bytes;
+			paths.erase(it->second.key);
+			delete it->second.key;
+			it = entries.erase(it);
+		} else {
+			++it;
+		}
+	}
+	m.unlock();
+}
+
+KeyCache::~KeyCache() {
+	for (auto& it : entries) {
+		delete it.second.key;
+	}
+}
@@ -0,0 +1,65 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#ifndef MHEAAN_KEYCACHE_H_
+#define MHEAAN_KEYCACHE_H_
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "Key.h"
+
+using namespace std;
+
+struct KeyCacheEntry {
+	Key* key;
+	long bytes;
+	long refs; ///< operations currently using the key, an entry in use is never evicted
+	long tick; ///< time of the last acquire, the smallest tick is evicted first
+};
+
+// In-memory copies of serialized keys under a byte budget, evicted least recently used first.
+// Keys are acquired for the duration of one operation and released after it.
+class KeyCache {
+
+public:
+
+	long budget; ///< bytes of cached keys, 0 keeps no copies
+	long bytes = 0;
+
+	map<string, KeyCacheEntry> entries;
+	map<Key*, string> paths;
+	set<string> pinned; ///< paths that are never evicted once loaded
+
+	long clock = 0;
+	long hits = 0;
+	long misses = 0;
+	long evictions = 0;
+
+	mutex m;
+
+	KeyCache(long budget = 0);
+
+	static long keyBytes(Key& key); ///< residues held by the key, Shoup companions included
+
+	Key* acquire(string path); ///< NULL on a miss
+	Key& insert(string path, Key* key); ///< takes ownership of key and acquires it, evicting to fit the budget
+	void release(Key& key); ///< ignores keys the cache does not hold
+
+	void pin(string path);
+	void unpin(string path);
+	void drop(string path); ///< deletes an unused entry, to be called before its file is rewritten
+
+	void clear(); ///< deletes all unused entries
+
+	virtual ~KeyCache();
+};
+
+#endif
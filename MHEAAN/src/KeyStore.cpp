@@ -0,0 +1,68 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#include "KeyStore.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SerializationUtils.h"
+
+Key& KeyStore::at(string path, bool isSeeded) {
+	lock_guard<mutex> lock(m);
+	auto it = keys.find(path);
+	if(it != keys.end()) {
+		return *it->second;
+	}
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) throw invalid_argument("cannot open key file " + path);
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		throw runtime_error("cannot stat key file " + path);
+	}
+	long bytes = st.st_size;
+	long np = SerializationUtils::keyFilePrimes(bytes, isSeeded);
+	long rbytes = (np << logN) * sizeof(residue_t);
+	if(np <= 0 || bytes != (isSeeded ? NTL_PRG_KEYLEN + rbytes : 2 * rbytes)) {
+		close(fd);
+		throw invalid_argument("key file " + path + " of " + to_string(bytes) + " bytes does not hold whole residue arrays");
+	}
+	char* base = (char*) mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED) throw runtime_error("cannot map key file " + path);
+	unsigned char* seed = isSeeded ? (unsigned char*) base : NULL;
+	residue_t* rax = isSeeded ? NULL : (residue_t*) base;
+	residue_t* rbx = isSeeded ? (residue_t*) (base + NTL_PRG_KEYLEN) : rax + (np << logN);
+	Key* key = new Key(seed, rax, rbx, np);
+	keys.insert(pair<string, Key*>(path, key));
+	regions.insert(pair<string, pair<void*, long>>(path, {base, bytes}));
+	return *key;
+}
+
+void KeyStore::drop(string path) {
+	m.lock();
+	auto it = keys.find(path);
+	if(it != keys.end()) {
+		delete it->second;
+		keys.erase(it);
+		munmap(regions.at(path).first, regions.at(path).second);
+		regions.erase(path);
+	}
+	m.unlock();
+}
+
+KeyStore::~KeyStore() {
+	for (auto& it : keys) {
+		delete it.second;
+		munmap(regions.at(it.first).first, regions.at(it.first).second);
+	}
+}
@@ -0,0 +1,44 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#ifndef MHEAAN_KEYSTORE_H_
+#define MHEAAN_KEYSTORE_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "Key.h"
+
+using namespace std;
+
+// Key files written by SerializationUtils::writeKey, mapped read-only on first use and kept mapped.
+// The returned keys are views into the mappings, so nothing is copied per operation and
+// processes mapping the same files share their pages through the page cache.
+class KeyStore {
+
+public:
+
+	map<string, Key*> keys;
+	map<string, pair<void*, long>> regions; ///< path -> address and length of the mapping
+
+	mutex m;
+
+	// maps the file if needed, throws invalid_argument if it cannot be opened or is not a whole key file
+	// and runtime_error if it cannot be mapped. Views never carry Shoup companions, whatever
+	// Scheme::isShoupKeys says: they would be private memory per process, so key switches with a view use Barrett products
+	Key& at(string path, bool isSeeded = false);
+
+	// unmaps the file, to be called before it is rewritten. Every view of it becomes dangling, so no caller
+	// may hold one across Scheme::addEncKey/addMultKey/addConjKey/addLeftRotKey/eraseLeftRotKey of the same key
+	void drop(string path);
+
+	virtual ~KeyStore();
+};
+
+#endif
@@ -25,6 +25,8 @@ int main() {
 //	TestScheme::testimult(300, 30, 2, 2);
 //	TestScheme::testRotateFast(300, 30, 3, 3, 1, 0);
 //	TestScheme::testConjugate(300, 30, 2, 2);
+//	TestScheme::testRotKeyBudget(300, 30, 4, 6);
+//	TestScheme::testRotateCompose(300, 30, false);
 
 //----------------------------------------------------------------------------------
 //   POWER & PRODUCT TESTS
@@ -53,6 +55,14 @@ int main() {
 
 //	TestScheme::testBootstrap(50, 43, 7, 8, 4, 4);
 //	TestScheme::testCiphertextWriteAndRead(10, 65, 30, 2);
+//	TestScheme::testMoveAndCopy(300, 30, 2, 2);
+//	TestScheme::testKeyStore(300, 30, 2, 2);
+//	TestScheme::testSeededKeys(300, 30, 2, 2);
+//	TestScheme::testTruncatedKeys(300, 30, 2, 2);
+//	TestScheme::testKeyCache(300, 30, 2, 2, 3);
+//	TestScheme::testResidues(1200, 24);
+//	TestScheme::testNTTSimd(4);
+//	TestScheme::testNTTOps(300, 30, 2, 2);
 //	TestScheme::test();
 
 	return 0;
@@ -2,16 +2,31 @@
 #define MHEAAN_PARAMS_H_
 
 #include <NTL/ZZ.h>
+#include <stdint.h>
 using namespace NTL;
 
+// MHEAAN_RNS32 selects the RNS backend with primes below 2^30: residues are stored in 32-bit words,
+// every lazy value (< 4p) fits one word and the AVX2 kernels work on 8 lanes per register.
+// Keys and serialized keys are laid out in residue words, so they are not portable between backends.
+#ifdef MHEAAN_RNS32
+typedef uint32_t residue_t;
+#else
+typedef uint64_t residue_t;
+#endif
+
 static const long logN0 = 8;
 static const long logN1 = 8;
 static const long logQ = 1200;
 static const double sigma = 3.2;
 static const long h = 64;
+#ifdef MHEAAN_RNS32
+static const long pbnd = 29;
+#else
 static const long pbnd = 59;
-static const long kbar = 60;
-static const long kbar2 = 120;
+#endif
+static const long kbar = pbnd + 1;
+static const long kbar2 = 2 * kbar;
+static const long residueBits = 8 * sizeof(residue_t);
 
 static const long logN0h = (logN0 - 1);
 static const long logN = (logN0 + logN1);
@@ -30,6 +45,7 @@ static const long N1nprimes = (nprimes << logN1);
 static const long Nnprimes = (nprimes << logN);
 
 static const long cbnd = (logQQ + NTL_ZZ_NBITS - 1) / NTL_ZZ_NBITS;
+static const long qbnd = logQ / 64 + 1; ///< CoeffArray words of ciphertext and plaintext coefficients, at least one bit above logQ for the sign
 static const long bignum = 0xfffffff;
 static const ZZ Q = power2_ZZ(logQ);
 static const ZZ QQ = power2_ZZ(logQQ);
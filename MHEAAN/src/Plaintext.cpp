@@ -10,6 +10,33 @@
 Plaintext::Plaintext(long logp, long n0, long n1) : logp(logp), n0(n0), n1(n1) {
 }
 
+Plaintext::Plaintext(const Plaintext& o) : mx(o.mx), logp(o.logp), n0(o.n0), n1(o.n1) {
+}
+
+Plaintext::Plaintext(Plaintext&& o) noexcept : mx(std::move(o.mx)), logp(o.logp), n0(o.n0), n1(o.n1) {
+}
+
+Plaintext& Plaintext::operator=(const Plaintext& o) {
+	if(this != &o) {
+		logp = o.logp;
+		n0 = o.n0;
+		n1 = o.n1;
+		mx.copy(o.mx);
+	}
+	return *this;
+}
+
+Plaintext& Plaintext::operator=(Plaintext&& o) noexcept {
+	swap(o);
+	return *this;
+}
+
+void Plaintext::swap(Plaintext& o) {
+	mx.swap(o.mx);
+	std::swap(logp, o.logp);
+	std::swap(n0, o.n0);
+	std::swap(n1, o.n1);
+}
+
 Plaintext::~Plaintext() {
-	delete[] mx;
 }
@@ -10,6 +10,7 @@
 
 #include <NTL/ZZ.h>
 #include "Params.h"
+#include "CoeffArray.h"
 
 using namespace std;
 using namespace NTL;
@@ -17,7 +18,7 @@ using namespace NTL;
 class Plaintext {
 public:
 
-	ZZ* mx = new ZZ[N];
+	CoeffArray mx = CoeffArray(qbnd); ///< signed coefficients, allocated by encode or decryptMsg
 
 	long logp;
 	long n0;
@@ -25,6 +26,16 @@ public:
 
 	Plaintext(long logp = 0, long n0 = 0, long n1 = 0);
 
+	Plaintext(const Plaintext& o);
+
+	Plaintext(Plaintext&& o) noexcept; ///< takes the array of o, which may then only be assigned to, copied into or destroyed
+
+	Plaintext& operator=(const Plaintext& o);
+
+	Plaintext& operator=(Plaintext&& o) noexcept;
+
+	void swap(Plaintext& o);
+
 	virtual ~Plaintext();
 };
 
@@ -24,6 +24,12 @@ Ring::Ring() {
 	}
 	gM0Pows[N0h] = gM0Pows[0];
 
+	autIdxNTTX0 = new long[N0 << logN0];
+	for (long i = 0; i < N0h; ++i) {
+		multiplier.automorphismIndexX0(autIdxNTTX0 + (i << logN0), gM0Pows[i]);
+		multiplier.automorphismIndexX0(autIdxNTTX0 + ((i + N0h) << logN0), M0 - gM0Pows[i]);
+	}
+
 	uint64_t g1 = multiplier.findPrimitiveRoot(M1);
 	uint64_t g1Pow = 1;
 	for (long i = 0; i < N1; ++i) {
@@ -300,22 +306,85 @@ long Ring::MaxBits(ZZ* f, long n) {
 	return m;
 }
 
-void Ring::toNTTX0(uint64_t* ra, ZZ* a, long np) {
+long Ring::MaxBits(CoeffArray& f) {
+	f.alloc();
+	long m = 0;
+	uint64_t* w = new uint64_t[f.nlimbs];
+	for (long n = 0; n < N; ++n) {
+		for (long j = 0; j < f.nlimbs; ++j) {
+			w[j] = f.data[(j << logN) + n];
+		}
+		if (w[f.nlimbs - 1] >> 63) {
+			uint64_t c = 1;
+			for (long j = 0; j < f.nlimbs; ++j) {
+				w[j] = ~w[j] + c;
+				c = c && w[j] == 0;
+			}
+		}
+		long j = f.nlimbs - 1;
+		while (j > 0 && w[j] == 0) j--;
+		if (w[j] != 0) m = max(m, (j << 6) + 64 - __builtin_clzll(w[j]));
+	}
+	delete[] w;
+	return m;
+}
+
+void Ring::toNTTX0(residue_t* ra, ZZ* a, long np) {
 	multiplier.toNTTX0(ra, a, np);
 }
 
-void Ring::toNTTX1(uint64_t* ra, ZZ* a, long np) {
+void Ring::toNTTX1(residue_t* ra, ZZ* a, long np) {
 	multiplier.toNTTX1(ra, a, np);
 }
 
-void Ring::toNTT(uint64_t* ra, ZZ* a, long np) {
+void Ring::toNTT(residue_t* ra, ZZ* a, long np) {
+	multiplier.toNTT(ra, a, np);
+}
+
+void Ring::toNTT(residue_t* ra, CoeffArray& a, long np) {
 	multiplier.toNTT(ra, a, np);
 }
 
-void Ring::addNTTAndEqual(uint64_t* ra, uint64_t* rb, long np) {
+void Ring::toShoup(residue_t* rbs, residue_t* rb, long np, long logn) {
+	multiplier.toShoup(rbs, rb, np, logn);
+}
+
+void Ring::fromNTT(ZZ* x, residue_t* ra, long np, const ZZ& q) {
+	multiplier.fromNTT(x, ra, np, q);
+}
+
+void Ring::fromNTT(CoeffArray& x, residue_t* ra, long np, long logq) {
+	multiplier.fromNTT(x, ra, np, logq);
+}
+
+void Ring::addNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np) {
+	multiplier.addNTT(rx, ra, rb, np);
+}
+
+void Ring::addNTTAndEqual(residue_t* ra, residue_t* rb, long np) {
 	multiplier.addNTTAndEqual(ra, rb, np);
 }
 
+void Ring::subNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np) {
+	multiplier.subNTT(rx, ra, rb, np);
+}
+
+void Ring::negateNTT(residue_t* rx, residue_t* ra, long np) {
+	multiplier.negateNTT(rx, ra, np);
+}
+
+void Ring::multByConstNTT(residue_t* rx, residue_t* ra, const ZZ& cnst, long np) {
+	multiplier.multByConstNTT(rx, ra, cnst, np);
+}
+
+void Ring::multDNTT(residue_t* rx, residue_t* ra, residue_t* rb, residue_t* rbs, long np) {
+	multiplier.mulModBatch(rx, ra, rb, rbs, np);
+}
+
+void Ring::scaleNTT(residue_t* ry, long npy, residue_t* ra, long npx, long logd, long logq) {
+	multiplier.scaleNTT(ry, npy, ra, npx, logd, logq);
+}
+
 void Ring::multX0(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
 	multiplier.multX0(x, a, b, np, q);
 }
@@ -324,15 +393,23 @@ void Ring::multX0AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
 	multiplier.multX0AndEqual(a, b, np, q);
 }
 
-void Ring::multNTTX0(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q) {
+void Ring::multNTTX0(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q) {
 	multiplier.multNTTX0(x, a, rb, np, q);
 }
 
-void Ring::multNTTX0AndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q) {
+void Ring::multNTTX0AndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q) {
 	multiplier.multNTTX0AndEqual(a, rb, np, q);
 }
 
-void Ring::multDNTTX0(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q) {
+void Ring::multNTTX0AndEqual(ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	multiplier.multNTTX0AndEqual(a, rb, rbs, np, q);
+}
+
+void Ring::multNTTX0AndEqual(CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq) {
+	multiplier.multNTTX0AndEqual(a, rb, rbs, np, logq);
+}
+
+void Ring::multDNTTX0(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q) {
 	multiplier.multDNTTX0(x, ra, rb, np, q);
 }
 
@@ -344,14 +421,18 @@ void Ring::multX1AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
 	multiplier.multX1AndEqual(a, b, np, q);
 }
 
-void Ring::multNTTX1(ZZ* x, ZZ* a, uint64_t* b, long np, const ZZ& q) {
+void Ring::multNTTX1(ZZ* x, ZZ* a, residue_t* b, long np, const ZZ& q) {
 	multiplier.multNTTX1(x, a, b, np, q);
 }
 
-void Ring::multNTTX1AndEqual(ZZ* a, uint64_t* b, long np, const ZZ& q) {
+void Ring::multNTTX1AndEqual(ZZ* a, residue_t* b, long np, const ZZ& q) {
 	multiplier.multNTTX1AndEqual(a, b, np, q);
 }
 
+void Ring::multNTTX1AndEqual(CoeffArray& a, residue_t* rb, long np, long logq) {
+	multiplier.multNTTX1AndEqual(a, rb, np, logq);
+}
+
 void Ring::mult(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
 	multiplier.mult(x, a, b, np, q);
 }
@@ -364,22 +445,50 @@ void Ring::multAndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
 	multiplier.multAndEqual(a, b, np, q);
 }
 
-void Ring::multNTT(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q) {
+void Ring::multNTT(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q) {
 	multiplier.multNTT(x, a, rb, np, q);
 }
 
-void Ring::multNTT(ZZ* x, long* a, uint64_t* rb, long np, const ZZ& q) {
+void Ring::multNTT(ZZ* x, ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	multiplier.multNTT(x, a, rb, rbs, np, q);
+}
+
+void Ring::multNTT(ZZ* x, long* a, residue_t* rb, long np, const ZZ& q) {
 	multiplier.multNTT(x, a, rb, np, q);
 }
 
-void Ring::multNTTAndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q) {
+void Ring::multNTT(ZZ* x, long* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	multiplier.multNTT(x, a, rb, rbs, np, q);
+}
+
+void Ring::multNTTAndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q) {
 	multiplier.multNTTAndEqual(a, rb, np, q);
 }
 
-void Ring::multDNTT(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q) {
+void Ring::multNTT(CoeffArray& x, CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq) {
+	multiplier.multNTT(x, a, rb, rbs, np, logq);
+}
+
+void Ring::multNTT(CoeffArray& x, long* a, residue_t* rb, residue_t* rbs, long np, long logq) {
+	multiplier.multNTT(x, a, rb, rbs, np, logq);
+}
+
+void Ring::multNTTAndEqual(CoeffArray& a, residue_t* rb, long np, long logq) {
+	multiplier.multNTT(a, a, rb, NULL, np, logq);
+}
+
+void Ring::multDNTT(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q) {
 	multiplier.multDNTT(x, ra, rb, np, q);
 }
 
+void Ring::multDNTT(ZZ* x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	multiplier.multDNTT(x, ra, rb, rbs, np, q);
+}
+
+void Ring::multDNTT(CoeffArray& x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, long logq) {
+	multiplier.multDNTT(x, ra, rb, rbs, np, logq);
+}
+
 void Ring::square(ZZ* x, ZZ* a, long np, const ZZ& q) {
 	multiplier.square(x, a, np, q);
 }
@@ -392,7 +501,7 @@ void Ring::squareAndEqual(ZZ* a, long np, const ZZ& q) {
 	multiplier.squareAndEqual(a, np, q);
 }
 
-void Ring::squareNTT(ZZ* x, uint64_t* ra, long np, const ZZ& q) {
+void Ring::squareNTT(ZZ* x, residue_t* ra, long np, const ZZ& q) {
 	multiplier.squareNTT(x, ra, np, q);
 }
 
@@ -569,100 +678,494 @@ void Ring::rightShiftAndEqual(ZZ* p, long bits) {
 
 
 //----------------------------------------------------------------------------------
-//   ROTATION & CONJUGATION & TRANSPOSITION
+//   FLAT COEFFICIENTS
 //----------------------------------------------------------------------------------
 
 
-void Ring::leftRotate(ZZ* res, ZZ* p, long r0, long r1) {
-	long deg0 = gM0Pows[r0];
-	for (long j = 0; j < N; j += N0) {
-		for (long i = 0; i < N0; ++i) {
-			long ipow = i * deg0;
-			long shift = ipow % M0;
-			if (shift < N0) {
-				res[shift + j] = p[i + j];
-			} else {
-				res[shift - N0 + j] = -p[i + j];
+// The kernels walk the array in blocks of N0 coefficients and, inside a block, limb by limb,
+// carrying between limbs through a per-coefficient array. Inputs are read modulo 2^logq from their
+// low (logq + 63) / 64 words, which they must hold, results are in [0, 2^logq) with the words above zero.
+
+void Ring::toCoeffArray(CoeffArray& res, ZZ* p, long logq) {
+	res.alloc();
+	const ZZ& q = qvec[logq];
+	NTL_EXEC_RANGE(N, first, last);
+	uint64_t* w = new uint64_t[res.nlimbs];
+	ZZ tmp;
+	for (long n = first; n < last; ++n) {
+		rem(tmp, p[n], q);
+		BytesFromZZ((unsigned char*) w, tmp, res.nlimbs << 3);
+		for (long j = 0; j < res.nlimbs; ++j) {
+			res.data[(j << logN) + n] = w[j];
+		}
+	}
+	delete[] w;
+	NTL_EXEC_RANGE_END;
+}
+
+void Ring::fromCoeffArray(ZZ* res, CoeffArray& p) {
+	p.alloc();
+	NTL_EXEC_RANGE(N, first, last);
+	uint64_t* w = new uint64_t[p.nlimbs];
+	for (long n = first; n < last; ++n) {
+		for (long j = 0; j < p.nlimbs; ++j) {
+			w[j] = p.data[(j << logN) + n];
+		}
+		ZZFromBytes(res[n], (unsigned char*) w, p.nlimbs << 3);
+		if (w[p.nlimbs - 1] >> 63) res[n] -= power2_ZZ(p.nlimbs << 6);
+	}
+	delete[] w;
+	NTL_EXEC_RANGE_END;
+}
+
+void Ring::normalizeAndEqual(CoeffArray& p, long logq) {
+	p.alloc();
+	long top = (logq - 1) >> 6;
+	long b = (logq - 1) & 63;
+	NTL_EXEC_RANGE(N, first, last);
+	for (long n = first; n < last; ++n) {
+		uint64_t* x = p.data + (top << logN) + n;
+		uint64_t fill = (uint64_t) ((int64_t) (x[0] << (63 - b)) >> 63);
+		if (b < 63) x[0] = (x[0] & ((1ULL << (b + 1)) - 1)) | (fill << (b + 1));
+		for (long j = top + 1; j < p.nlimbs; ++j) {
+			p.data[(j << logN) + n] = fill;
+		}
+	}
+	NTL_EXEC_RANGE_END;
+}
+
+void Ring::add(CoeffArray& res, CoeffArray& p1, CoeffArray& p2, long logq) {
+	res.alloc();
+	p1.alloc();
+	p2.alloc();
+	long nl = (logq + 63) >> 6;
+	NTL_EXEC_RANGE(N1, first, last);
+	uint64_t c[N0];
+	for (long k = first; k < last; ++k) {
+		for (long n = 0; n < N0; ++n) c[n] = 0;
+		for (long j = 0; j < nl; ++j) {
+			uint64_t* x = res.data + (j << logN) + (k << logN0);
+			uint64_t* a = p1.data + (j << logN) + (k << logN0);
+			uint64_t* b = p2.data + (j << logN) + (k << logN0);
+			for (long n = 0; n < N0; ++n) {
+				uint64_t s = a[n] + c[n];
+				uint64_t c1 = s < c[n];
+				s += b[n];
+				c[n] = c1 | (s < b[n]);
+				x[n] = s;
+			}
+		}
+	}
+	NTL_EXEC_RANGE_END;
+	modAndEqual(res, logq);
+}
+
+void Ring::addAndEqual(CoeffArray& p1, CoeffArray& p2, long logq) {
+	add(p1, p1, p2, logq);
+}
+
+void Ring::sub(CoeffArray& res, CoeffArray& p1, CoeffArray& p2, long logq) {
+	res.alloc();
+	p1.alloc();
+	p2.alloc();
+	long nl = (logq + 63) >> 6;
+	NTL_EXEC_RANGE(N1, first, last);
+	uint64_t c[N0];
+	for (long k = first; k < last; ++k) {
+		for (long n = 0; n < N0; ++n) c[n] = 0;
+		for (long j = 0; j < nl; ++j) {
+			uint64_t* x = res.data + (j << logN) + (k << logN0);
+			uint64_t* a = p1.data + (j << logN) + (k << logN0);
+			uint64_t* b = p2.data + (j << logN) + (k << logN0);
+			for (long n = 0; n < N0; ++n) {
+				uint64_t d = a[n] - b[n];
+				uint64_t c1 = a[n] < b[n];
+				c1 |= d < c[n];
+				x[n] = d - c[n];
+				c[n] = c1;
 			}
 		}
 	}
+	NTL_EXEC_RANGE_END;
+	modAndEqual(res, logq);
+}
+
+void Ring::subAndEqual(CoeffArray& p1, CoeffArray& p2, long logq) {
+	sub(p1, p1, p2, logq);
+}
+
+void Ring::subAndEqual2(CoeffArray& p1, CoeffArray& p2, long logq) {
+	sub(p2, p1, p2, logq);
+}
+
+void Ring::negate(CoeffArray& res, CoeffArray& p, long logq) {
+	res.alloc();
+	p.alloc();
+	long nl = (logq + 63) >> 6;
+	NTL_EXEC_RANGE(N1, first, last);
+	uint64_t c[N0];
+	for (long k = first; k < last; ++k) {
+		for (long n = 0; n < N0; ++n) c[n] = 0;
+		for (long j = 0; j < nl; ++j) {
+			uint64_t* x = res.data + (j << logN) + (k << logN0);
+			uint64_t* a = p.data + (j << logN) + (k << logN0);
+			for (long n = 0; n < N0; ++n) {
+				uint64_t d = 0 - a[n];
+				uint64_t c1 = a[n] != 0;
+				c1 |= d < c[n];
+				x[n] = d - c[n];
+				c[n] = c1;
+			}
+		}
+	}
+	NTL_EXEC_RANGE_END;
+	modAndEqual(res, logq);
+}
 
-	r1 %= N1;
-	if(r1 != 0) {
-		long divisor = GCD(r1, N1);
-		long steps = N1 / divisor;
-		for (long i = 0; i < N0; ++i) {
-			for (long j = 0; j < divisor; ++j) {
-				ZZ tmp = res[i + (j << logN0)];
-				long idx = j;
-				for (long k = 0; k < steps - 1; ++k) {
-					res[i + (idx << logN0)] = res[i + (((idx + r1) % N1) << logN0)];
-					idx = (idx + r1) % N1;
+void Ring::negateAndEqual(CoeffArray& p, long logq) {
+	negate(p, p, logq);
+}
+
+void Ring::mod(CoeffArray& res, CoeffArray& p, long logq) {
+	res.alloc();
+	p.alloc();
+	if (&res != &p) {
+		long nl = min((logq + 63) >> 6, min(res.nlimbs, p.nlimbs));
+		for (long i = 0; i < (nl << logN); ++i) {
+			res.data[i] = p.data[i];
+		}
+	}
+	modAndEqual(res, logq);
+}
+
+void Ring::modAndEqual(CoeffArray& p, long logq) {
+	p.alloc();
+	long top = logq >> 6;
+	if (top < p.nlimbs && (logq & 63)) {
+		uint64_t mask = (1ULL << (logq & 63)) - 1;
+		uint64_t* x = p.data + (top << logN);
+		for (long n = 0; n < N; ++n) {
+			x[n] &= mask;
+		}
+		top++;
+	}
+	for (long i = (top << logN); i < (p.nlimbs << logN); ++i) {
+		p.data[i] = 0;
+	}
+}
+
+// x[m] = +-a[idx0[m]] over nl limb rows of strides xs and as, the negation as the complement plus one
+static void permuteRow(uint64_t* x, long xs, uint64_t* a, long as, long nl, long* idx0, uint64_t* neg0) {
+	uint64_t c[N0];
+	for (long m = 0; m < N0; ++m) c[m] = neg0[m] & 1;
+	for (long j = 0; j < nl; ++j) {
+		uint64_t* xj = x + j * xs;
+		uint64_t* aj = a + j * as;
+		for (long m = 0; m < N0; ++m) {
+			uint64_t v = (aj[idx0[m]] ^ neg0[m]) + c[m];
+			c[m] = v < c[m];
+			xj[m] = v;
+		}
+	}
+}
+
+void Ring::permute(CoeffArray& res, CoeffArray& p, long* rows, long* idx0, uint64_t* neg0, long spread, long logq) {
+	p.alloc();
+	long nl = (logq + 63) >> 6;
+	CoeffArray* x = &res == &p ? new CoeffArray(res.nlimbs) : &res;
+	x->alloc();
+	NTL_EXEC_RANGE(N1, first, last);
+	for (long k = first; k < last; ++k) {
+		if (rows[k] >= 0) {
+			permuteRow(x->data + (k << logN0), N, p.data + (rows[k] << logN0), N, nl, idx0, neg0);
+		} else {
+			for (long j = 0; j < nl; ++j) {
+				for (long m = 0; m < N0; ++m) x->data[(j << logN) + (k << logN0) + m] = 0;
+			}
+		}
+	}
+	NTL_EXEC_RANGE_END;
+	if (spread >= 0) {
+		uint64_t* sp = new uint64_t[nl << logN0];
+		permuteRow(sp, N0, p.data + (spread << logN0), N, nl, idx0, neg0);
+		NTL_EXEC_RANGE(N1, first, last);
+		uint64_t c[N0];
+		for (long k = first; k < last; ++k) {
+			for (long m = 0; m < N0; ++m) c[m] = 0;
+			for (long j = 0; j < nl; ++j) {
+				uint64_t* xj = x->data + (j << logN) + (k << logN0);
+				uint64_t* sj = sp + (j << logN0);
+				for (long m = 0; m < N0; ++m) {
+					uint64_t d = xj[m] - sj[m];
+					uint64_t c1 = xj[m] < sj[m];
+					c1 |= d < c[m];
+					xj[m] = d - c[m];
+					c[m] = c1;
 				}
-				res[i + (idx << logN0)] = tmp;
 			}
 		}
+		NTL_EXEC_RANGE_END;
+		delete[] sp;
+	}
+	modAndEqual(*x, logq);
+	if (x != &res) {
+		res.swap(*x);
+		delete x;
 	}
 }
 
-void Ring::leftRotate(ZZ* res, long* p, long r0, long r1) {
+void Ring::multByMonomial(CoeffArray& res, CoeffArray& p, long deg0, long deg1, long logq) {
+	long rows[N1];
+	long idx0[N0];
+	uint64_t neg0[N0];
+	deg0 = (deg0 % M0 + M0) % M0;
+	deg1 = (deg1 % M1 + M1) % M1;
+	for (long i = 0; i < N0; ++i) {
+		long d = (deg0 + i) % M0;
+		idx0[d < N0 ? d : d - N0] = i;
+		neg0[d < N0 ? d : d - N0] = d < N0 ? 0 : ~0ULL;
+	}
+	// X1^j is row j - 1 for 1 <= j <= N1, X1^0 = -(X1 + ... + X1^N1) spreads over every row
+	long spread = -1;
+	for (long k = 0; k < N1; ++k) rows[k] = -1;
+	for (long j = 1; j < M1; ++j) {
+		long t = (deg1 + j) % M1;
+		if (t > 0) rows[t - 1] = j - 1;
+		else spread = j - 1;
+	}
+	permute(res, p, rows, idx0, neg0, spread, logq);
+}
+
+void Ring::multByMonomialAndEqual(CoeffArray& p, long deg0, long deg1, long logq) {
+	multByMonomial(p, p, deg0, deg1, logq);
+}
+
+void Ring::multByConst(CoeffArray& res, CoeffArray& p, ZZ& cnst, long logq) {
+	res.alloc();
+	p.alloc();
+	long nl = (logq + 63) >> 6;
+	long cl = min(nl, (NumBits(cnst) + 63) >> 6);
+	bool neg = sign(cnst) < 0;
+	uint64_t c[cbnd];
+	BytesFromZZ((unsigned char*) c, cnst, cl << 3);
+	NTL_EXEC_RANGE(N, first, last);
+	uint64_t a[cbnd];
+	uint64_t x[cbnd];
+	for (long n = first; n < last; ++n) {
+		for (long j = 0; j < nl; ++j) {
+			a[j] = p.data[(j << logN) + n];
+			x[j] = 0;
+		}
+		// schoolbook product by |cnst| truncated to nl words, x[i + m] is still zero when row i reaches it
+		for (long i = 0; i < nl; ++i) {
+			if (a[i] == 0) continue;
+			long m = min(cl, nl - i);
+			uint64_t carry = 0;
+			for (long t = 0; t < m; ++t) {
+				unsigned __int128 v = static_cast<unsigned __int128>(a[i]) * c[t] + x[i + t] + carry;
+				x[i + t] = static_cast<uint64_t>(v);
+				carry = static_cast<uint64_t>(v >> 64);
+			}
+			if (i + m < nl) x[i + m] = carry;
+		}
+		uint64_t cn = neg;
+		for (long j = 0; j < nl; ++j) {
+			uint64_t v = (neg ? ~x[j] : x[j]) + cn;
+			cn = v < cn;
+			res.data[(j << logN) + n] = v;
+		}
+	}
+	NTL_EXEC_RANGE_END;
+	modAndEqual(res, logq);
+}
+
+void Ring::multByConstAndEqual(CoeffArray& p, ZZ& cnst, long logq) {
+	multByConst(p, p, cnst, logq);
+}
+
+void Ring::addConstAndEqual(CoeffArray& p, const ZZ& cnst, long logq) {
+	p.alloc();
+	long nl = (logq + 63) >> 6;
+	uint64_t c[cbnd];
+	ZZ tmp;
+	rem(tmp, cnst, qvec[logq]);
+	BytesFromZZ((unsigned char*) c, tmp, nl << 3);
+	uint64_t mask = (logq & 63) ? (1ULL << (logq & 63)) - 1 : ~0ULL;
+	for (long n = 0; n < N; n += N0) {
+		uint64_t carry = 0;
+		for (long j = 0; j < nl; ++j) {
+			uint64_t* x = p.data + (j << logN) + n;
+			uint64_t s = *x + carry;
+			carry = s < carry;
+			s += c[j];
+			carry |= s < c[j];
+			*x = s;
+		}
+		p.data[((nl - 1) << logN) + n] &= mask;
+		for (long j = nl; j < p.nlimbs; ++j) {
+			p.data[(j << logN) + n] = 0;
+		}
+	}
+}
+
+void Ring::leftShift(CoeffArray& res, CoeffArray& p, long bits, long logq) {
+	res.alloc();
+	p.alloc();
+	long nl = min((logq + 63) >> 6, res.nlimbs);
+	long w = bits >> 6;
+	long b = bits & 63;
+	// from the top word down, so that res may alias p
+	for (long j = nl - 1; j >= 0; --j) {
+		uint64_t* x = res.data + (j << logN);
+		uint64_t* hi = (j - w >= 0 && j - w < p.nlimbs) ? p.data + ((j - w) << logN) : NULL;
+		uint64_t* lo = (b != 0 && j - w - 1 >= 0 && j - w - 1 < p.nlimbs) ? p.data + ((j - w - 1) << logN) : NULL;
+		for (long n = 0; n < N; ++n) {
+			uint64_t v = hi ? hi[n] << b : 0;
+			if (lo) v |= lo[n] >> (64 - b);
+			x[n] = v;
+		}
+	}
+	modAndEqual(res, logq);
+}
+
+void Ring::leftShiftAndEqual(CoeffArray& p, long bits, long logq) {
+	leftShift(p, p, bits, logq);
+}
+
+void Ring::rightShift(CoeffArray& res, CoeffArray& p, long bits) {
+	res.alloc();
+	p.alloc();
+	long w = bits >> 6;
+	long b = bits & 63;
+	// from the bottom word up, so that res may alias p
+	for (long j = 0; j < res.nlimbs; ++j) {
+		uint64_t* x = res.data + (j << logN);
+		uint64_t* lo = j + w < p.nlimbs ? p.data + ((j + w) << logN) : NULL;
+		uint64_t* hi = (b != 0 && j + w + 1 < p.nlimbs) ? p.data + ((j + w + 1) << logN) : NULL;
+		for (long n = 0; n < N; ++n) {
+			uint64_t v = lo ? lo[n] >> b : 0;
+			if (hi) v |= hi[n] << (64 - b);
+			x[n] = v;
+		}
+	}
+}
+
+void Ring::rightShiftAndEqual(CoeffArray& p, long bits) {
+	rightShift(p, p, bits);
+}
+
+
+//----------------------------------------------------------------------------------
+//   ROTATION & CONJUGATION & TRANSPOSITION
+//----------------------------------------------------------------------------------
+
+
+void Ring::leftRotate(ZZ* res, ZZ* p, long r0, long r1) {
 	long deg0 = gM0Pows[r0];
-	for (long j = 0; j < N; j += N0) {
+	r1 %= N1;
+	if(r1 < 0) r1 += N1;
+	for (long k = 0; k < N1; ++k) {
+		ZZ* resk = res + (k << logN0);
+		ZZ* pk = p + (((k + r1) % N1) << logN0);
+		long shift = 0;
 		for (long i = 0; i < N0; ++i) {
-			long ipow = i * deg0;
-			long shift = ipow % M0;
 			if (shift < N0) {
-				res[shift + j] = ZZ(p[i + j]);
+				resk[shift] = pk[i];
 			} else {
-				res[shift - N0 + j] = ZZ(-p[i + j]);
+				resk[shift - N0] = -pk[i];
 			}
+			shift += deg0;
+			if(shift >= M0) shift -= M0;
 		}
 	}
+}
 
+void Ring::leftRotate(ZZ* res, long* p, long r0, long r1) {
+	long deg0 = gM0Pows[r0];
 	r1 %= N1;
-	if(r1 != 0) {
-		long divisor = GCD(r1, N1);
-		long steps = N1 / divisor;
+	if(r1 < 0) r1 += N1;
+	for (long k = 0; k < N1; ++k) {
+		ZZ* resk = res + (k << logN0);
+		long* pk = p + (((k + r1) % N1) << logN0);
+		long shift = 0;
 		for (long i = 0; i < N0; ++i) {
-			for (long j = 0; j < divisor; ++j) {
-				ZZ tmp = res[i + (j << logN0)];
-				long idx = j;
-				for (long k = 0; k < steps - 1; ++k) {
-					res[i + (idx << logN0)] = res[i + (((idx + r1) % N1) << logN0)];
-					idx = (idx + r1) % N1;
-				}
-				res[i + (idx << logN0)] = tmp;
+			if (shift < N0) {
+				resk[shift] = ZZ(pk[i]);
+			} else {
+				resk[shift - N0] = ZZ(-pk[i]);
 			}
+			shift += deg0;
+			if(shift >= M0) shift -= M0;
 		}
 	}
 }
 
+void Ring::leftRotate(CoeffArray& res, CoeffArray& p, long r0, long r1, long logq) {
+	long rows[N1];
+	long idx0[N0];
+	uint64_t neg0[N0];
+	long deg0 = gM0Pows[r0];
+	r1 %= N1;
+	if(r1 < 0) r1 += N1;
+	long shift = 0;
+	for (long i = 0; i < N0; ++i) {
+		idx0[shift < N0 ? shift : shift - N0] = i;
+		neg0[shift < N0 ? shift : shift - N0] = shift < N0 ? 0 : ~0ULL;
+		shift += deg0;
+		if(shift >= M0) shift -= M0;
+	}
+	for (long k = 0; k < N1; ++k) {
+		rows[k] = (k + r1) % N1;
+	}
+	permute(res, p, rows, idx0, neg0, -1, logq);
+}
+
+void Ring::leftRotateNTT(residue_t* rx, residue_t* ra, long r0, long r1, long np) {
+	r1 %= N1;
+	if(r1 < 0) r1 += N1;
+	multiplier.automorphismNTT(rx, ra, autIdxNTTX0 + (r0 << logN0), r1, np);
+}
+
 void Ring::conjugate(ZZ* res, ZZ* p) {
-	for (long j = 0; j < N; j += N0) {
-		res[j] = p[j];
+	for (long k = 0; k < N1; ++k) {
+		ZZ* resk = res + (k << logN0);
+		ZZ* pk = p + (((k + (N1 >> 1)) % N1) << logN0);
+		resk[0] = pk[0];
 		for (long i = 1; i < N0; ++i) {
-			res[N0 - i + j] = -p[i + j];
-		}
-	}
-	for (long i = 0; i < N0; ++i) {
-		for (long j = 0; j < Nh; j+=N0) {
-			swap(res[i+j], res[i+j+Nh]);
+			resk[N0 - i] = -pk[i];
 		}
 	}
 }
 
 void Ring::conjugate(ZZ* res, long* p) {
-	for (long j = 0; j < N; j += N0) {
-		res[j] = p[j];
+	for (long k = 0; k < N1; ++k) {
+		ZZ* resk = res + (k << logN0);
+		long* pk = p + (((k + (N1 >> 1)) % N1) << logN0);
+		resk[0] = ZZ(pk[0]);
 		for (long i = 1; i < N0; ++i) {
-			res[N0 - i + j] = -p[i + j];
+			resk[N0 - i] = ZZ(-pk[i]);
 		}
 	}
-	for (long i = 0; i < N0; ++i) {
-		for (long j = 0; j < Nh; j+=N0) {
-			swap(res[i+j], res[i+j+Nh]);
-		}
+}
+
+void Ring::conjugate(CoeffArray& res, CoeffArray& p, long logq) {
+	long rows[N1];
+	long idx0[N0];
+	uint64_t neg0[N0];
+	idx0[0] = 0;
+	neg0[0] = 0;
+	for (long i = 1; i < N0; ++i) {
+		idx0[N0 - i] = i;
+		neg0[N0 - i] = ~0ULL;
+	}
+	for (long k = 0; k < N1; ++k) {
+		rows[k] = (k + (N1 >> 1)) % N1;
 	}
+	permute(res, p, rows, idx0, neg0, -1, logq);
+}
+
+void Ring::conjugateNTT(residue_t* rx, residue_t* ra, long np) {
+	multiplier.automorphismNTT(rx, ra, autIdxNTTX0 + (N0h << logN0), N1 >> 1, np);
 }
 
 //----------------------------------------------------------------------------------
@@ -670,12 +1173,26 @@ void Ring::conjugate(ZZ* res, long* p) {
 //----------------------------------------------------------------------------------
 
 
-void Ring::sampleRLWE(ZZ* ax, ZZ* bx, ZZ* sx, long logq) {
+void Ring::sampleRLWE(ZZ* ax, ZZ* bx, ZZ* sx, long logq, unsigned char* seed) {
+	long np = ceil((1 + logq + logN + 3)/(double)pbnd);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rsx = scratch.alloc<residue_t>(np << logN);
+	toNTT(rsx, sx, np);
+	sampleRLWE(ax, bx, rsx, logq, seed);
+	scratch.release(mark);
+}
+
+void Ring::sampleRLWE(ZZ* ax, ZZ* bx, residue_t* rsx, long logq, unsigned char* seed) {
 	ZZ q = qvec[logq];
 	long np = ceil((1 + logq + logN + 3)/(double)pbnd);
 
-	sampleUniform(ax, logq);
-	mult(bx, ax, sx, np, q);
+	if(seed != NULL) {
+		sampleUniform(ax, logq, seed);
+	} else {
+		sampleUniform(ax, logq);
+	}
+	multNTT(bx, ax, rsx, np, q);
 
 	for (long i = 0; i < N; i+=2) {
 		double r1 = (1 + RandomBnd(bignum)) / ((double)bignum + 1);
@@ -699,6 +1216,33 @@ void Ring::addGauss(ZZ* ax, const ZZ& q) {
 	}
 }
 
+void Ring::addGauss(CoeffArray& ax, long logq) {
+	ax.alloc();
+	long nl = (logq + 63) >> 6;
+	for (long i = 0; i < N; i+=2) {
+		double r1 = (1 + RandomBnd(bignum)) / ((double)bignum + 1);
+		double r2 = (1 + RandomBnd(bignum)) / ((double)bignum + 1);
+		double theta=2 * M_PI * r1;
+		double rr= sqrt(-2.0 * log(r2)) * sigma;
+
+		long e[2] = {(long) floor(rr * cos(theta) + 0.5), (long) floor(rr * sin(theta) + 0.5)};
+		for (long k = 0; k < 2; ++k) {
+			uint64_t fill = e[k] < 0 ? ~0ULL : 0;
+			uint64_t carry = 0;
+			for (long j = 0; j < nl; ++j) {
+				uint64_t* x = ax.data + (j << logN) + i + k;
+				uint64_t w = j == 0 ? (uint64_t) e[k] : fill;
+				uint64_t s = *x + carry;
+				carry = s < carry;
+				s += w;
+				carry |= s < w;
+				*x = s;
+			}
+		}
+	}
+	modAndEqual(ax, logq);
+}
+
 void Ring::sampleHWT(ZZ* res) {
 	long idx = 0;
 	while(idx < h) {
@@ -721,3 +1265,19 @@ void Ring::sampleUniform(ZZ* res, long logq) {
 		res[i] = RandomBits_ZZ(logq);
 	}
 }
+
+void Ring::sampleUniform(ZZ* res, long logq, unsigned char* seed) {
+	RandomStream stream(seed);
+	long nbytes = (logq + 7) / 8;
+	unsigned char* bytes = new unsigned char[nbytes];
+	for (long i = 0; i < N; i++) {
+		stream.get(bytes, nbytes);
+		ZZFromBytes(res[i], bytes, nbytes);
+		trunc_ZZ(res[i], res[i], logq);
+	}
+	delete[] bytes;
+}
+
+void Ring::sampleSeed(unsigned char* seed) {
+	GetCurrentRandomStream().get(seed, NTL_PRG_KEYLEN);
+}
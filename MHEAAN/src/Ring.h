@@ -37,6 +37,8 @@ public:
 	uint64_t gM0Pows[N0h + 1]; ///< auxiliary information about rotation group indexes for batch encoding
 	uint64_t gM1Pows[M1]; ///< auxiliary information about rotation group indexes for batch encoding
 
+	long* autIdxNTTX0; ///< NTT slot gathers of X0 -> X0^(5^r0) for r0 < N0h, then of X0 -> X0^(-5^r0), N0 entries each
+
 	complex<double> ksiM0Pows[M0 + 1]; ///< storing ksi pows for fft calculation
 	complex<double> ksiM1Pows[M1 + 1];
 	complex<double> ksiN1Pows[N1 + 1]; ///< storing ksi pows for fft calculation
@@ -78,36 +80,57 @@ public:
 	//----------------------------------------------------------------------------------
 
 	long MaxBits(ZZ* f, long n);
-	void addNTTAndEqual(uint64_t* ra, uint64_t* rb, long np);
-
-	void toNTTX0(uint64_t* ra, ZZ* a, long np);
-	void toNTTX1(uint64_t* ra, ZZ* a, long np);
-	void toNTT(uint64_t* ra, ZZ* a, long np);
+	long MaxBits(CoeffArray& f); ///< bits of the largest |f[n]|, reading f as signed
+	void fromNTT(ZZ* x, residue_t* ra, long np, const ZZ& q);
+	void fromNTT(CoeffArray& x, residue_t* ra, long np, long logq);
+	void addNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np);
+	void addNTTAndEqual(residue_t* ra, residue_t* rb, long np);
+	void subNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np);
+	void negateNTT(residue_t* rx, residue_t* ra, long np);
+	void multByConstNTT(residue_t* rx, residue_t* ra, const ZZ& cnst, long np);
+	void multDNTT(residue_t* rx, residue_t* ra, residue_t* rb, residue_t* rbs, long np); ///< pointwise product, stays in NTT form
+	void scaleNTT(residue_t* ry, long npy, residue_t* ra, long npx, long logd, long logq); ///< image over npy primes of round(a / 2^logd) mod 2^logq, centered; ry may alias ra
+
+	void toNTTX0(residue_t* ra, ZZ* a, long np);
+	void toNTTX1(residue_t* ra, ZZ* a, long np);
+	void toNTT(residue_t* ra, ZZ* a, long np);
+	void toNTT(residue_t* ra, CoeffArray& a, long np);
+	void toShoup(residue_t* rbs, residue_t* rb, long np, long logn = logN);
 
 	void multX0(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q);
 	void multX0AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q);
-	void multNTTX0(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTTX0AndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multDNTTX0(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q);
+	void multNTTX0(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX0AndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX0AndEqual(ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multNTTX0AndEqual(CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq);
+	void multDNTTX0(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q);
 
 	void multX1(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q);
 	void multX1AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q);
-	void multNTTX1(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTTX1AndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multDNTTX1(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q);
+	void multNTTX1(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX1AndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX1AndEqual(CoeffArray& a, residue_t* rb, long np, long logq);
+	void multDNTTX1(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q);
 
 	void mult(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q);
 	void mult(ZZ* x, ZZ* a, long* b, long np, const ZZ& q);
 	void multAndEqual(ZZ* a, ZZ* b, long np, const ZZ& q);
-	void multNTT(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTT(ZZ* x, long* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTTAndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multDNTT(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q);
+	void multNTT(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTT(ZZ* x, ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multNTT(ZZ* x, long* a, residue_t* rb, long np, const ZZ& q);
+	void multNTT(ZZ* x, long* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multNTT(CoeffArray& x, CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq);
+	void multNTT(CoeffArray& x, long* a, residue_t* rb, residue_t* rbs, long np, long logq);
+	void multNTTAndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTAndEqual(CoeffArray& a, residue_t* rb, long np, long logq);
+	void multDNTT(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q);
+	void multDNTT(ZZ* x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multDNTT(CoeffArray& x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, long logq);
 
 	void square(ZZ* x, ZZ* a, long np, const ZZ& q);
 	void square(ZZ* x, long* a, const ZZ& q);
 	void squareAndEqual(ZZ* a, long np, const ZZ& q);
-	void squareNTT(ZZ* x, uint64_t* ra, long np, const ZZ& q);
+	void squareNTT(ZZ* x, residue_t* ra, long np, const ZZ& q);
 
 
 	//----------------------------------------------------------------------------------
@@ -149,6 +172,48 @@ public:
 	void rightShiftAndEqual(ZZ* p, long bits);
 
 
+	//----------------------------------------------------------------------------------
+	//   FLAT COEFFICIENTS
+	//----------------------------------------------------------------------------------
+
+
+	void toCoeffArray(CoeffArray& res, ZZ* p, long logq); ///< p mod 2^logq, with logq = 64 * res.nlimbs p is kept signed
+	void fromCoeffArray(ZZ* res, CoeffArray& p); ///< signed, see CoeffArray
+
+	void normalizeAndEqual(CoeffArray& p, long logq); ///< sign-extends from bit logq - 1, into [-2^(logq - 1), 2^(logq - 1))
+
+	void add(CoeffArray& res, CoeffArray& p1, CoeffArray& p2, long logq);
+	void addAndEqual(CoeffArray& p1, CoeffArray& p2, long logq);
+
+	void sub(CoeffArray& res, CoeffArray& p1, CoeffArray& p2, long logq);
+	void subAndEqual(CoeffArray& p1, CoeffArray& p2, long logq);
+	void subAndEqual2(CoeffArray& p1, CoeffArray& p2, long logq);
+
+	void negate(CoeffArray& res, CoeffArray& p, long logq);
+	void negateAndEqual(CoeffArray& p, long logq);
+
+	void mod(CoeffArray& res, CoeffArray& p, long logq);
+	void modAndEqual(CoeffArray& p, long logq);
+
+	// res row k is row rows[k] of p (zero for -1) with X0 coefficient m taken from idx0[m] and negated where
+	// neg0[m] is all ones; with spread >= 0 the row spread of p, so permuted, is then subtracted from every row
+	void permute(CoeffArray& res, CoeffArray& p, long* rows, long* idx0, uint64_t* neg0, long spread, long logq);
+
+	void multByMonomial(CoeffArray& res, CoeffArray& p, long deg0, long deg1, long logq);
+	void multByMonomialAndEqual(CoeffArray& p, long deg0, long deg1, long logq);
+
+	void multByConst(CoeffArray& res, CoeffArray& p, ZZ& cnst, long logq);
+	void multByConstAndEqual(CoeffArray& p, ZZ& cnst, long logq);
+
+	void addConstAndEqual(CoeffArray& p, const ZZ& cnst, long logq); ///< adds cnst to the coefficients of X0^0
+
+	void leftShift(CoeffArray& res, CoeffArray& p, long bits, long logq);
+	void leftShiftAndEqual(CoeffArray& p, long bits, long logq);
+
+	void rightShift(CoeffArray& res, CoeffArray& p, long bits);
+	void rightShiftAndEqual(CoeffArray& p, long bits);
+
+
 	//----------------------------------------------------------------------------------
 	//   ROTATION & CONJUGATION & TRANSPOSITION
 	//----------------------------------------------------------------------------------
@@ -156,9 +221,14 @@ public:
 
 	void leftRotate(ZZ* res, ZZ* p, long r0, long r1);
 	void leftRotate(ZZ* res, long* p, long r0, long r1);
+	void leftRotateNTT(residue_t* rx, residue_t* ra, long r0, long r1, long np); ///< same rotation applied to an NTT image
+
+	void leftRotate(CoeffArray& res, CoeffArray& p, long r0, long r1, long logq);
 
 	void conjugate(ZZ* res, ZZ* p);
 	void conjugate(ZZ* res, long* p);
+	void conjugate(CoeffArray& res, CoeffArray& p, long logq);
+	void conjugateNTT(residue_t* rx, residue_t* ra, long np);
 
 
 	//----------------------------------------------------------------------------------
@@ -166,12 +236,16 @@ public:
 	//----------------------------------------------------------------------------------
 
 
-	void sampleRLWE(ZZ* ax, ZZ* bx, ZZ* sx, long logq);
+	void sampleRLWE(ZZ* ax, ZZ* bx, ZZ* sx, long logq, unsigned char* seed = NULL); ///< with a seed, ax is sampleUniform(ax, logq, seed)
+	void sampleRLWE(ZZ* ax, ZZ* bx, residue_t* rsx, long logq, unsigned char* seed = NULL); ///< rsx is the NTT image of sx for the primes of a product at logq
 
 	void addGauss(ZZ* ax, const ZZ& q);
+	void addGauss(CoeffArray& ax, long logq);
 	void sampleHWT(ZZ* res);
 	void sampleZO(long* res);
 	void sampleUniform(ZZ* res, long logq);
+	void sampleUniform(ZZ* res, long logq, unsigned char* seed); ///< deterministic in the NTL_PRG_KEYLEN byte seed
+	void sampleSeed(unsigned char* seed);
 
 };
 
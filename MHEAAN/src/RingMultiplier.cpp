@@ -12,9 +12,15 @@
 #include <cmath>
 #include <cstdint>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MHEAAN_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 RingMultiplier::RingMultiplier() {
 
+	simdLevel = detectSIMDLevel();
+
 	uint64_t g1 = findPrimitiveRoot(M1);
 	uint64_t gM1Pow = 1;
 	for (long i = 0; i < N1; ++i) {
@@ -44,6 +50,14 @@ RingMultiplier::RingMultiplier() {
 		uint64_t NxInvModp = powMod(N0, pVec[i] - 2, pVec[i]);
 		mulMod(scaledN0Inv[i], NxInvModp, (1ULL << 32), pVec[i]);
 		mulMod(scaledN0Inv[i], scaledN0Inv[i],(1ULL << 32), pVec[i]);
+#ifdef MHEAAN_RNS32
+		N0Inv[i] = NxInvModp;
+		N0InvShoup[i] = (NxInvModp << 32) / pVec[i];
+		rootM0Pows[i] = new residue_t[N0]();
+		rootM0PowsShoup[i] = new residue_t[N0]();
+		rootM0PowsInv[i] = new residue_t[N0]();
+		rootM0PowsInvShoup[i] = new residue_t[N0]();
+#endif
 
 		uint64_t NyInvModp = powMod(N1, pVec[i] - 2, pVec[i]);
 		mulMod(scaledN1Inv[i], NyInvModp, (1ULL << 32), pVec[i]);
@@ -63,6 +77,12 @@ RingMultiplier::RingMultiplier() {
 			uint64_t rootpowinv = powerInv;
 			mulMod(scaledRootM0PowsInv[i][jprime], rootpowinv, (1ULL << 32), pVec[i]);
 			mulMod(scaledRootM0PowsInv[i][jprime], scaledRootM0PowsInv[i][jprime], (1ULL << 32), pVec[i]);
+#ifdef MHEAAN_RNS32
+			rootM0Pows[i][jprime] = rootpow;
+			rootM0PowsShoup[i][jprime] = (rootpow << 32) / pVec[i];
+			rootM0PowsInv[i][jprime] = rootpowinv;
+			rootM0PowsInvShoup[i][jprime] = (rootpowinv << 32) / pVec[i];
+#endif
 			mulMod(power, power, rootM0, pVec[i]);
 			mulMod(powerInv, powerInv, rootM0inv, pVec[i]);
 		}
@@ -85,8 +105,8 @@ RingMultiplier::RingMultiplier() {
 		}
 
 		uint64_t rootM1 = findMthRootOfUnity(M1, pVec[i]);
-		rootM1DFTPows[i] = new uint64_t[N1]();
-		rootM1DFTPowsInv[i] = new uint64_t[N1]();
+		rootM1DFTPows[i] = new residue_t[N1]();
+		rootM1DFTPowsInv[i] = new residue_t[N1]();
 		for (long j = 0; j < N1; ++j) {
 			rootM1DFTPows[i][j] = powMod(rootM1, gM1Pows[j], pVec[i]);
 		}
@@ -94,6 +114,12 @@ RingMultiplier::RingMultiplier() {
 		for (long j = 0; j < N1; ++j) {
 			rootM1DFTPowsInv[i][j] = powMod(rootM1DFTPows[i][j], pVec[i] - 2, pVec[i]);
 		}
+		scaledRootM1DFTPows[i] = new uint64_t[N1]();
+		scaledRootM1DFTPowsInv[i] = new uint64_t[N1]();
+		for (long j = 0; j < N1; ++j) {
+			mulMod(scaledRootM1DFTPows[i][j], rootM1DFTPows[i][j], scaledN1Inv[i], pVec[i]);
+			mulMod(scaledRootM1DFTPowsInv[i][j], rootM1DFTPowsInv[i][j], scaledN1Inv[i], pVec[i]);
+		}
 	}
 
 	for (long i = 0; i < nprimes; ++i) {
@@ -115,6 +141,18 @@ RingMultiplier::RingMultiplier() {
 			coeffpinv_array[i][j] = PrepMulModPrecon(pHatInvModp[i][j], pVec[j]);
 		}
 	}
+
+	for (long i = 0; i < nprimes; ++i) {
+		limbPows[i] = new residue_t[cbnd * limbPieces + 1];
+		limbPowsShoup[i] = new residue_t[cbnd * limbPieces + 1];
+		uint64_t pow = 1;
+		for (long j = 0; j <= cbnd * limbPieces; ++j) {
+			limbPows[i][j] = pow;
+			limbPowsShoup[i][j] = static_cast<residue_t>((static_cast<unsigned __int128>(pow) << residueBits) / pVec[i]);
+			mulMod(pow, pow, (1ULL << (residueBits - 1)), pVec[i]);
+			mulMod(pow, pow, 2, pVec[i]);
+		}
+	}
 }
 
 bool RingMultiplier::primeTest(uint64_t p) {
@@ -139,6 +177,21 @@ bool RingMultiplier::primeTest(uint64_t p) {
 	return true;
 }
 
+long RingMultiplier::detectSIMDLevel() {
+#ifdef MHEAAN_X86_SIMD
+	__builtin_cpu_init();
+#ifdef MHEAAN_RNS32
+	// with 32-bit residues a product is a single vpmuludq, eight lanes per register
+	if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+#else
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) return SIMD_AVX512;
+	// the AVX2 kernel needs four 32-bit products per 64-bit one and does not beat mulx,
+	// so it is only used when simdLevel is set to SIMD_AVX2 explicitly
+#endif
+#endif
+	return SIMD_NONE;
+}
+
 void RingMultiplier::arrayBitReverse(uint64_t* vals, long n) {
 	for (long i = 1, j = 0; i < n; ++i) {
 		long bit = n >> 1;
@@ -152,12 +205,223 @@ void RingMultiplier::arrayBitReverse(uint64_t* vals, long n) {
 	}
 }
 
-void RingMultiplier::NTTX0(uint64_t* a, long index) {
+// Radix-4 kernels: each pass fuses two radix-2 stages of the lazy butterflies, so a transform reads and
+// writes its data half as often. Recursing on the template argument fixes every loop bound at compile time,
+// and the last pass (quarter span 1, plus a radix-2 stage when logN0 is odd) is unrolled completely.
+// N1 + 1 is a Fermat prime, so logN1 is even and the X1 kernels need no radix-2 stage.
+
+template<long logt>
+void RingMultiplier::NTTX0Radix4(residue_t* a, long m, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows) {
+	const long t = 1L << logt;
+	for (long i = 0; i < m; ++i) {
+		uint64_t W1 = pows[m + i];
+		uint64_t W2 = pows[(m + i) << 1];
+		uint64_t W3 = pows[((m + i) << 1) + 1];
+		residue_t* a0 = a + (i << (logt + 2));
+		residue_t* a1 = a0 + t;
+		residue_t* a2 = a1 + t;
+		residue_t* a3 = a2 + t;
+		for (long j = 0; j < t; ++j) {
+			butt2Lazy(a0[j], a2[j], p, p2, pInv, W1);
+			butt2Lazy(a1[j], a3[j], p, p2, pInv, W1);
+			butt2Lazy(a0[j], a1[j], p, p2, pInv, W2);
+			butt2Lazy(a2[j], a3[j], p, p2, pInv, W3);
+		}
+	}
+	if (logt >= 2) {
+		NTTX0Radix4<(logt >= 2 ? logt - 2 : 0)>(a, m << 2, p, p2, pInv, pows);
+	} else if (logt == 1) {
+		for (long i = 0; i < (m << 2); ++i) {
+			butt2Lazy(a[2 * i], a[2 * i + 1], p, p2, pInv, pows[(m << 2) + i]);
+		}
+	}
+}
+
+template<long logt>
+void RingMultiplier::INTTX0Radix4(residue_t* a, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows) {
+	const long t = 1L << logt;
+	const long m = N0 >> (logt + 2);
+	for (long i = 0; i < m; ++i) {
+		uint64_t W1 = pows[(m + i) << 1];
+		uint64_t W2 = pows[((m + i) << 1) + 1];
+		uint64_t W3 = pows[m + i];
+		residue_t* a0 = a + (i << (logt + 2));
+		residue_t* a1 = a0 + t;
+		residue_t* a2 = a1 + t;
+		residue_t* a3 = a2 + t;
+		for (long j = 0; j < t; ++j) {
+			butt1Lazy(a0[j], a1[j], p, p2, pInv, W1);
+			butt1Lazy(a2[j], a3[j], p, p2, pInv, W2);
+			butt1Lazy(a0[j], a2[j], p, p2, pInv, W3);
+			butt1Lazy(a1[j], a3[j], p, p2, pInv, W3);
+		}
+	}
+	if (logt + 4 <= logN0) {
+		INTTX0Radix4<(logt + 4 <= logN0 ? logt + 2 : logt)>(a, p, p2, pInv, pows);
+	} else if (logt + 3 == logN0) {
+		for (long j = 0; j < N0h; ++j) {
+			butt1Lazy(a[j], a[j + N0h], p, p2, pInv, pows[1]);
+		}
+	}
+}
+
+// M1 = N1 + 1 must be a Fermat prime, so logN1 is 2, 4, 8 or 16 and the X1 passes need no radix-2 stage
+static_assert(logN1 >= 2 && logN1 % 2 == 0, "the radix-4 X1 passes need an even logN1");
+
+template<long logh, long width, long stride>
+void RingMultiplier::DIFRadix4X1(residue_t* a, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows) {
+	const long h = 1L << logh;
+	const long s = logN1 - logh - 2;
+	for (long j = 0; j < N1; j += 4 * h) {
+		for (long k = 0; k < h; ++k) {
+			uint64_t W1 = pows[k << s];
+			uint64_t W2 = pows[(k + h) << s];
+			uint64_t W3 = pows[k << (s + 1)];
+			residue_t* a0 = a + (j + k) * stride;
+			residue_t* a1 = a0 + h * stride;
+			residue_t* a2 = a1 + h * stride;
+			residue_t* a3 = a2 + h * stride;
+			for (long c = 0; c < width; ++c) {
+				butt1Lazy(a0[c], a2[c], p, p2, pInv, W1);
+				butt1Lazy(a1[c], a3[c], p, p2, pInv, W2);
+				butt1Lazy(a0[c], a1[c], p, p2, pInv, W3);
+				butt1Lazy(a2[c], a3[c], p, p2, pInv, W3);
+			}
+		}
+	}
+	if (logh >= 2) {
+		DIFRadix4X1<(logh >= 2 ? logh - 2 : 0), width, stride>(a, p, p2, pInv, pows);
+	}
+}
+
+template<long logh, long width, long stride>
+void RingMultiplier::DITRadix4X1(residue_t* a, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows) {
+	const long h = 1L << logh;
+	const long s = logN1 - logh - 1;
+	for (long j = 0; j < N1; j += 4 * h) {
+		for (long k = 0; k < h; ++k) {
+			uint64_t W1 = pows[k << s];
+			uint64_t W2 = pows[k << (s - 1)];
+			uint64_t W3 = pows[(k + h) << (s - 1)];
+			residue_t* a0 = a + (j + k) * stride;
+			residue_t* a1 = a0 + h * stride;
+			residue_t* a2 = a1 + h * stride;
+			residue_t* a3 = a2 + h * stride;
+			for (long c = 0; c < width; ++c) {
+				butt2Lazy(a0[c], a1[c], p, p2, pInv, W1);
+				butt2Lazy(a2[c], a3[c], p, p2, pInv, W1);
+				butt2Lazy(a0[c], a2[c], p, p2, pInv, W2);
+				butt2Lazy(a1[c], a3[c], p, p2, pInv, W3);
+			}
+		}
+	}
+	if (logh + 4 <= logN1) {
+		DITRadix4X1<(logh + 4 <= logN1 ? logh + 2 : logh), width, stride>(a, p, p2, pInv, pows);
+	}
+}
+
+void RingMultiplier::NTTX0(residue_t* a, long index) {
+#ifdef MHEAAN_X86_SIMD
+#ifndef MHEAAN_RNS32
+	if (simdLevel == SIMD_AVX512) {
+		NTTX0AVX512(a, index);
+		return;
+	}
+#endif
+	if (simdLevel == SIMD_AVX2) {
+		NTTX0AVX2(a, index);
+		return;
+	}
+#endif
+	uint64_t p = pVec[index];
+	uint64_t pInv = pInvVec[index];
+	uint64_t p2 = p << 1;
+	NTTX0Radix4<logN0 - 2>(a, 1, p, p2, pInv, scaledRootM0Pows[index]);
+	for (long i = 0; i < N0; i++) {
+		normalizeLazy(a[i], p, p2);
+	}
+}
+
+void RingMultiplier::INTTX0(residue_t* a, long index) {
+#ifdef MHEAAN_X86_SIMD
+#ifndef MHEAAN_RNS32
+	if (simdLevel == SIMD_AVX512) {
+		INTTX0AVX512(a, index);
+		return;
+	}
+#endif
+	if (simdLevel == SIMD_AVX2) {
+		INTTX0AVX2(a, index);
+		return;
+	}
+#endif
+	uint64_t p = pVec[index];
+	uint64_t pInv = pInvVec[index];
+	uint64_t p2 = p << 1;
+	INTTX0Radix4<0>(a, p, p2, pInv, scaledRootM0PowsInv[index]);
+
+	uint64_t NxScale = scaledN0Inv[index];
+	for (long i = 0; i < N0; i++) {
+		divByN(a[i], p, pInv, NxScale);
+	}
+}
+
+#if defined(MHEAAN_X86_SIMD) && !defined(MHEAAN_RNS32)
+
+// The vector kernels below reproduce butt1Lazy, butt2Lazy, normalizeLazy and
+// divByN lane by lane. Neither AVX2 nor AVX-512F has a 64x64->128 multiply, so
+// the Montgomery products are assembled from 32x32->64 partial products and the
+// low word Q = T * (W * pInv) uses a per-twiddle precomputed W * pInv. All
+// operands stay below 4p < 2^61, so signed 64-bit compares are safe for AVX2.
+
+__attribute__((target("avx2")))
+static inline __m256i mulHiAVX2(__m256i a, __m256i b, __m256i bh) {
+	__m256i mask = _mm256_set1_epi64x(0xffffffff);
+	__m256i ah = _mm256_srli_epi64(a, 32);
+	__m256i ll = _mm256_mul_epu32(a, b);
+	__m256i lh = _mm256_mul_epu32(a, bh);
+	__m256i hl = _mm256_mul_epu32(ah, b);
+	__m256i hh = _mm256_mul_epu32(ah, bh);
+	__m256i mid = _mm256_add_epi64(_mm256_srli_epi64(ll, 32), _mm256_add_epi64(_mm256_and_si256(lh, mask), _mm256_and_si256(hl, mask)));
+	__m256i hi = _mm256_add_epi64(hh, _mm256_srli_epi64(mid, 32));
+	return _mm256_add_epi64(hi, _mm256_add_epi64(_mm256_srli_epi64(lh, 32), _mm256_srli_epi64(hl, 32)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mulLoAVX2(__m256i a, __m256i b, __m256i bh) {
+	__m256i ah = _mm256_srli_epi64(a, 32);
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(a, bh), _mm256_mul_epu32(ah, b));
+	return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+// returns T * W / 2^64 mod p in [0, 2p)
+__attribute__((target("avx2")))
+static inline __m256i mulModMontLazyAVX2(__m256i T, __m256i W, __m256i Wh, __m256i WpInv, __m256i WpInvh, __m256i p, __m256i ph) {
+	__m256i U1 = mulHiAVX2(T, W, Wh);
+	__m256i Q = mulLoAVX2(T, WpInv, WpInvh);
+	__m256i H = mulHiAVX2(Q, p, ph);
+	return _mm256_sub_epi64(_mm256_add_epi64(U1, p), H);
+}
+
+// subtracts m from the lanes of a that are >= m
+__attribute__((target("avx2")))
+static inline __m256i reduceOnceAVX2(__m256i a, __m256i m, __m256i m1) {
+	return _mm256_sub_epi64(a, _mm256_and_si256(m, _mm256_cmpgt_epi64(a, m1)));
+}
+
+__attribute__((target("avx2")))
+void RingMultiplier::NTTX0AVX2(residue_t* a, long index) {
 	long t = N0;
 	long logt1 = logN0 + 1;
 	uint64_t p = pVec[index];
+	uint64_t p2 = p << 1;
 	uint64_t pInv = pInvVec[index];
 	uint64_t* scaledRootM0Powsi = scaledRootM0Pows[index];
+	__m256i vp = _mm256_set1_epi64x(p);
+	__m256i vph = _mm256_set1_epi64x(p >> 32);
+	__m256i vp1 = _mm256_set1_epi64x(p - 1);
+	__m256i vp2 = _mm256_set1_epi64x(p2);
+	__m256i vp21 = _mm256_set1_epi64x(p2 - 1);
 	for (long m = 1; m < N0; m <<= 1) {
 		t >>= 1;
 		logt1 -= 1;
@@ -165,17 +429,43 @@ void RingMultiplier::NTTX0(uint64_t* a, long index) {
 			long j1 = i << logt1;
 			long j2 = j1 + t - 1;
 			uint64_t W = scaledRootM0Powsi[m + i];
-			for (long j = j1; j <= j2; j++) {
-				butt2(a[j], a[j + t], p, pInv, W);
+			if (t < 4) {
+				for (long j = j1; j <= j2; j++) {
+					butt2Lazy(a[j], a[j + t], p, p2, pInv, W);
+				}
+				continue;
+			}
+			__m256i vW = _mm256_set1_epi64x(W);
+			__m256i vWh = _mm256_set1_epi64x(W >> 32);
+			__m256i vWpInv = _mm256_set1_epi64x(W * pInv);
+			__m256i vWpInvh = _mm256_set1_epi64x((W * pInv) >> 32);
+			for (long j = j1; j <= j2; j += 4) {
+				__m256i a1 = reduceOnceAVX2(_mm256_loadu_si256((__m256i*)(a + j)), vp2, vp21);
+				__m256i a2 = _mm256_loadu_si256((__m256i*)(a + j + t));
+				__m256i V = mulModMontLazyAVX2(a2, vW, vWh, vWpInv, vWpInvh, vp, vph);
+				_mm256_storeu_si256((__m256i*)(a + j), _mm256_add_epi64(a1, V));
+				_mm256_storeu_si256((__m256i*)(a + j + t), _mm256_sub_epi64(_mm256_add_epi64(a1, vp2), V));
 			}
 		}
 	}
+	for (long i = 0; i < N0; i += 4) {
+		__m256i ai = _mm256_loadu_si256((__m256i*)(a + i));
+		ai = reduceOnceAVX2(reduceOnceAVX2(ai, vp2, vp21), vp, vp1);
+		_mm256_storeu_si256((__m256i*)(a + i), ai);
+	}
 }
 
-void RingMultiplier::INTTX0(uint64_t* a, long index) {
+__attribute__((target("avx2")))
+void RingMultiplier::INTTX0AVX2(residue_t* a, long index) {
 	uint64_t p = pVec[index];
+	uint64_t p2 = p << 1;
 	uint64_t pInv = pInvVec[index];
 	uint64_t* scaledRootM0PowsInvi = scaledRootM0PowsInv[index];
+	__m256i vp = _mm256_set1_epi64x(p);
+	__m256i vph = _mm256_set1_epi64x(p >> 32);
+	__m256i vp1 = _mm256_set1_epi64x(p - 1);
+	__m256i vp2 = _mm256_set1_epi64x(p2);
+	__m256i vp21 = _mm256_set1_epi64x(p2 - 1);
 	long t = 1;
 	for (long m = N0; m > 1; m >>= 1) {
 		long j1 = 0;
@@ -183,8 +473,23 @@ void RingMultiplier::INTTX0(uint64_t* a, long index) {
 		for (long i = 0; i < h; i++) {
 			long j2 = j1 + t - 1;
 			uint64_t W = scaledRootM0PowsInvi[h + i];
-			for (long j = j1; j <= j2; j++) {
-				butt1(a[j], a[j+t], p, pInv, W);
+			if (t < 4) {
+				for (long j = j1; j <= j2; j++) {
+					butt1Lazy(a[j], a[j+t], p, p2, pInv, W);
+				}
+			} else {
+				__m256i vW = _mm256_set1_epi64x(W);
+				__m256i vWh = _mm256_set1_epi64x(W >> 32);
+				__m256i vWpInv = _mm256_set1_epi64x(W * pInv);
+				__m256i vWpInvh = _mm256_set1_epi64x((W * pInv) >> 32);
+				for (long j = j1; j <= j2; j += 4) {
+					__m256i a1 = _mm256_loadu_si256((__m256i*)(a + j));
+					__m256i a2 = _mm256_loadu_si256((__m256i*)(a + j + t));
+					__m256i U = reduceOnceAVX2(_mm256_add_epi64(a1, a2), vp2, vp21);
+					__m256i T = _mm256_sub_epi64(_mm256_add_epi64(a1, vp2), a2);
+					_mm256_storeu_si256((__m256i*)(a + j), U);
+					_mm256_storeu_si256((__m256i*)(a + j + t), mulModMontLazyAVX2(T, vW, vWh, vWpInv, vWpInvh, vp, vph));
+				}
 			}
 			j1 += (t << 1);
 		}
@@ -192,47 +497,278 @@ void RingMultiplier::INTTX0(uint64_t* a, long index) {
 	}
 
 	uint64_t NxScale = scaledN0Inv[index];
-	for (long i = 0; i < N0; i++) {
-		divByN(a[i], p, pInv, NxScale);
+	__m256i vS = _mm256_set1_epi64x(NxScale);
+	__m256i vSh = _mm256_set1_epi64x(NxScale >> 32);
+	__m256i vSpInv = _mm256_set1_epi64x(NxScale * pInv);
+	__m256i vSpInvh = _mm256_set1_epi64x((NxScale * pInv) >> 32);
+	for (long i = 0; i < N0; i += 4) {
+		__m256i ai = _mm256_loadu_si256((__m256i*)(a + i));
+		ai = mulModMontLazyAVX2(ai, vS, vSh, vSpInv, vSpInvh, vp, vph);
+		_mm256_storeu_si256((__m256i*)(a + i), reduceOnceAVX2(ai, vp, vp1));
 	}
 }
 
-void RingMultiplier::NTTPO2X1(uint64_t* a, long index) {
+// the zero-masked forms of the shift and the 32-bit product have a defined pass-through,
+// unlike the plain ones, which GCC 12 reports as maybe-uninitialized once inlined
+__attribute__((target("avx512f")))
+static inline __m512i srli32AVX512(__m512i a) {
+	return _mm512_maskz_srli_epi64(0xff, a, 32);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i mulLoAVX512(__m512i a, __m512i b) {
+	return _mm512_maskz_mul_epu32(0xff, a, b);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i mulHiAVX512(__m512i a, __m512i b, __m512i bh) {
+	__m512i mask = _mm512_set1_epi64(0xffffffff);
+	__m512i ah = srli32AVX512(a);
+	__m512i ll = mulLoAVX512(a, b);
+	__m512i lh = mulLoAVX512(a, bh);
+	__m512i hl = mulLoAVX512(ah, b);
+	__m512i hh = mulLoAVX512(ah, bh);
+	__m512i mid = _mm512_add_epi64(srli32AVX512(ll), _mm512_add_epi64(_mm512_and_si512(lh, mask), _mm512_and_si512(hl, mask)));
+	__m512i hi = _mm512_add_epi64(hh, srli32AVX512(mid));
+	return _mm512_add_epi64(hi, _mm512_add_epi64(srli32AVX512(lh), srli32AVX512(hl)));
+}
+
+// returns T * W / 2^64 mod p in [0, 2p)
+__attribute__((target("avx512f,avx512dq")))
+static inline __m512i mulModMontLazyAVX512(__m512i T, __m512i W, __m512i Wh, __m512i WpInv, __m512i p, __m512i ph) {
+	__m512i U1 = mulHiAVX512(T, W, Wh);
+	__m512i Q = _mm512_mullo_epi64(T, WpInv);
+	__m512i H = mulHiAVX512(Q, p, ph);
+	return _mm512_sub_epi64(_mm512_add_epi64(U1, p), H);
+}
+
+// subtracts m from the lanes of a that are >= m
+__attribute__((target("avx512f")))
+static inline __m512i reduceOnceAVX512(__m512i a, __m512i m) {
+	return _mm512_mask_sub_epi64(a, _mm512_cmpge_epu64_mask(a, m), a, m);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void RingMultiplier::NTTX0AVX512(residue_t* a, long index) {
+	long t = N0;
+	long logt1 = logN0 + 1;
+	uint64_t p = pVec[index];
+	uint64_t p2 = p << 1;
+	uint64_t pInv = pInvVec[index];
+	uint64_t* scaledRootM0Powsi = scaledRootM0Pows[index];
+	__m512i vp = _mm512_set1_epi64(p);
+	__m512i vph = _mm512_set1_epi64(p >> 32);
+	__m512i vp2 = _mm512_set1_epi64(p2);
+	for (long m = 1; m < N0; m <<= 1) {
+		t >>= 1;
+		logt1 -= 1;
+		for (long i = 0; i < m; i++) {
+			long j1 = i << logt1;
+			long j2 = j1 + t - 1;
+			uint64_t W = scaledRootM0Powsi[m + i];
+			if (t < 8) {
+				for (long j = j1; j <= j2; j++) {
+					butt2Lazy(a[j], a[j + t], p, p2, pInv, W);
+				}
+				continue;
+			}
+			__m512i vW = _mm512_set1_epi64(W);
+			__m512i vWh = _mm512_set1_epi64(W >> 32);
+			__m512i vWpInv = _mm512_set1_epi64(W * pInv);
+			for (long j = j1; j <= j2; j += 8) {
+				__m512i a1 = reduceOnceAVX512(_mm512_loadu_si512(a + j), vp2);
+				__m512i a2 = _mm512_loadu_si512(a + j + t);
+				__m512i V = mulModMontLazyAVX512(a2, vW, vWh, vWpInv, vp, vph);
+				_mm512_storeu_si512(a + j, _mm512_add_epi64(a1, V));
+				_mm512_storeu_si512(a + j + t, _mm512_sub_epi64(_mm512_add_epi64(a1, vp2), V));
+			}
+		}
+	}
+	for (long i = 0; i < N0; i += 8) {
+		__m512i ai = _mm512_loadu_si512(a + i);
+		_mm512_storeu_si512(a + i, reduceOnceAVX512(reduceOnceAVX512(ai, vp2), vp));
+	}
+}
+
+__attribute__((target("avx512f,avx512dq")))
+void RingMultiplier::INTTX0AVX512(residue_t* a, long index) {
+	uint64_t p = pVec[index];
+	uint64_t p2 = p << 1;
+	uint64_t pInv = pInvVec[index];
+	uint64_t* scaledRootM0PowsInvi = scaledRootM0PowsInv[index];
+	__m512i vp = _mm512_set1_epi64(p);
+	__m512i vph = _mm512_set1_epi64(p >> 32);
+	__m512i vp2 = _mm512_set1_epi64(p2);
+	long t = 1;
+	for (long m = N0; m > 1; m >>= 1) {
+		long j1 = 0;
+		long h = m >> 1;
+		for (long i = 0; i < h; i++) {
+			long j2 = j1 + t - 1;
+			uint64_t W = scaledRootM0PowsInvi[h + i];
+			if (t < 8) {
+				for (long j = j1; j <= j2; j++) {
+					butt1Lazy(a[j], a[j+t], p, p2, pInv, W);
+				}
+			} else {
+				__m512i vW = _mm512_set1_epi64(W);
+				__m512i vWh = _mm512_set1_epi64(W >> 32);
+				__m512i vWpInv = _mm512_set1_epi64(W * pInv);
+				for (long j = j1; j <= j2; j += 8) {
+					__m512i a1 = _mm512_loadu_si512(a + j);
+					__m512i a2 = _mm512_loadu_si512(a + j + t);
+					__m512i U = reduceOnceAVX512(_mm512_add_epi64(a1, a2), vp2);
+					__m512i T = _mm512_sub_epi64(_mm512_add_epi64(a1, vp2), a2);
+					_mm512_storeu_si512(a + j, U);
+					_mm512_storeu_si512(a + j + t, mulModMontLazyAVX512(T, vW, vWh, vWpInv, vp, vph));
+				}
+			}
+			j1 += (t << 1);
+		}
+		t <<= 1;
+	}
+
+	uint64_t NxScale = scaledN0Inv[index];
+	__m512i vS = _mm512_set1_epi64(NxScale);
+	__m512i vSh = _mm512_set1_epi64(NxScale >> 32);
+	__m512i vSpInv = _mm512_set1_epi64(NxScale * pInv);
+	for (long i = 0; i < N0; i += 8) {
+		__m512i ai = _mm512_loadu_si512(a + i);
+		ai = mulModMontLazyAVX512(ai, vS, vSh, vSpInv, vp, vph);
+		_mm512_storeu_si512(a + i, reduceOnceAVX512(ai, vp));
+	}
+}
+
+#endif
+
+#if defined(MHEAAN_X86_SIMD) && defined(MHEAAN_RNS32)
+
+// With p < 2^30 every lazy value (< 4p) fits a 32-bit lane, so the butterflies use Harvey's
+// Shoup-form products on eight lanes: q = hi32(a * floor(w * 2^32 / p)), a * w - q * p in [0, 2p).
+// The lanes hold other representatives than the Montgomery scalar path, which is only used for
+// the stages with t < 8, but both stay within the lazy bounds and the outputs are canonical.
+
+// returns a * W mod p in [0, 2p) for Ws = floor(W * 2^32 / p)
+__attribute__((target("avx2")))
+static inline __m256i mulModShoupAVX2(__m256i a, __m256i W, __m256i Ws, __m256i p) {
+	__m256i qe = _mm256_srli_epi64(_mm256_mul_epu32(a, Ws), 32);
+	__m256i qo = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), Ws);
+	__m256i q = _mm256_blend_epi32(qe, qo, 0xaa);
+	return _mm256_sub_epi32(_mm256_mullo_epi32(a, W), _mm256_mullo_epi32(q, p));
+}
+
+// subtracts m from the lanes of a that are >= m
+__attribute__((target("avx2")))
+static inline __m256i reduceOnceAVX2(__m256i a, __m256i m) {
+	__m256i ge = _mm256_cmpeq_epi32(_mm256_max_epu32(a, m), a);
+	return _mm256_sub_epi32(a, _mm256_and_si256(ge, m));
+}
+
+__attribute__((target("avx2")))
+void RingMultiplier::NTTX0AVX2(residue_t* a, long index) {
+	long t = N0;
+	long logt1 = logN0 + 1;
 	uint64_t p = pVec[index];
+	uint64_t p2 = p << 1;
 	uint64_t pInv = pInvVec[index];
-	uint64_t* scaledRootN1Powsi = scaledRootN1Pows[index];
-
-	arrayBitReverse(a, N1);
-	for (long i = 0; i < logN1; ++i) {
-		long ihpow = 1 << i;
-		long ipow = 1 << (i + 1);
-		for (long j = 0; j < N1; j += ipow) {
-			for (long k = 0; k < ihpow; ++k) {
-				long idx = k << (logN1 - i - 1);
-				uint64_t W = scaledRootN1Powsi[idx];
-				butt2(a[j + k], a[j + k + ihpow], p, pInv, W);
+	uint64_t* scaledRootM0Powsi = scaledRootM0Pows[index];
+	residue_t* rootM0Powsi = rootM0Pows[index];
+	residue_t* rootM0PowsShoupi = rootM0PowsShoup[index];
+	__m256i vp = _mm256_set1_epi32(p);
+	__m256i vp2 = _mm256_set1_epi32(p2);
+	for (long m = 1; m < N0; m <<= 1) {
+		t >>= 1;
+		logt1 -= 1;
+		for (long i = 0; i < m; i++) {
+			long j1 = i << logt1;
+			long j2 = j1 + t - 1;
+			if (t < 8) {
+				uint64_t W = scaledRootM0Powsi[m + i];
+				for (long j = j1; j <= j2; j++) {
+					butt2Lazy(a[j], a[j + t], p, p2, pInv, W);
+				}
+				continue;
+			}
+			__m256i vW = _mm256_set1_epi32(rootM0Powsi[m + i]);
+			__m256i vWs = _mm256_set1_epi32(rootM0PowsShoupi[m + i]);
+			for (long j = j1; j <= j2; j += 8) {
+				__m256i a1 = reduceOnceAVX2(_mm256_loadu_si256((__m256i*)(a + j)), vp2);
+				__m256i V = mulModShoupAVX2(_mm256_loadu_si256((__m256i*)(a + j + t)), vW, vWs, vp);
+				_mm256_storeu_si256((__m256i*)(a + j), _mm256_add_epi32(a1, V));
+				_mm256_storeu_si256((__m256i*)(a + j + t), _mm256_sub_epi32(_mm256_add_epi32(a1, vp2), V));
 			}
 		}
 	}
+	for (long i = 0; i < N0; i += 8) {
+		__m256i ai = _mm256_loadu_si256((__m256i*)(a + i));
+		ai = reduceOnceAVX2(reduceOnceAVX2(ai, vp2), vp);
+		_mm256_storeu_si256((__m256i*)(a + i), ai);
+	}
 }
 
-void RingMultiplier::INTTPO2X1(uint64_t* a, long index) {
+__attribute__((target("avx2")))
+void RingMultiplier::INTTX0AVX2(residue_t* a, long index) {
 	uint64_t p = pVec[index];
+	uint64_t p2 = p << 1;
 	uint64_t pInv = pInvVec[index];
-	uint64_t* scaledRootN1PowsInvi = scaledRootN1PowsInv[index];
-
-	arrayBitReverse(a, N1);
-	for (long i = 0; i < logN1; ++i) {
-		long ihpow = 1 << i;
-		long ipow = 1 << (i + 1);
-		for (long j = 0; j < N1; j += ipow) {
-			for (long k = 0; k < ihpow; ++k) {
-				long idx = k << (logN1 - i - 1);
-				uint64_t W = scaledRootN1PowsInvi[idx];
-				butt2(a[j + k], a[j + k + ihpow], p, pInv, W);
+	uint64_t* scaledRootM0PowsInvi = scaledRootM0PowsInv[index];
+	residue_t* rootM0PowsInvi = rootM0PowsInv[index];
+	residue_t* rootM0PowsInvShoupi = rootM0PowsInvShoup[index];
+	__m256i vp = _mm256_set1_epi32(p);
+	__m256i vp2 = _mm256_set1_epi32(p2);
+	long t = 1;
+	for (long m = N0; m > 1; m >>= 1) {
+		long j1 = 0;
+		long h = m >> 1;
+		for (long i = 0; i < h; i++) {
+			long j2 = j1 + t - 1;
+			if (t < 8) {
+				uint64_t W = scaledRootM0PowsInvi[h + i];
+				for (long j = j1; j <= j2; j++) {
+					butt1Lazy(a[j], a[j+t], p, p2, pInv, W);
+				}
+			} else {
+				__m256i vW = _mm256_set1_epi32(rootM0PowsInvi[h + i]);
+				__m256i vWs = _mm256_set1_epi32(rootM0PowsInvShoupi[h + i]);
+				for (long j = j1; j <= j2; j += 8) {
+					__m256i a1 = _mm256_loadu_si256((__m256i*)(a + j));
+					__m256i a2 = _mm256_loadu_si256((__m256i*)(a + j + t));
+					__m256i U = reduceOnceAVX2(_mm256_add_epi32(a1, a2), vp2);
+					__m256i T = _mm256_sub_epi32(_mm256_add_epi32(a1, vp2), a2);
+					_mm256_storeu_si256((__m256i*)(a + j), U);
+					_mm256_storeu_si256((__m256i*)(a + j + t), mulModShoupAVX2(T, vW, vWs, vp));
+				}
 			}
+			j1 += (t << 1);
 		}
+		t <<= 1;
+	}
+
+	__m256i vS = _mm256_set1_epi32(N0Inv[index]);
+	__m256i vSs = _mm256_set1_epi32(N0InvShoup[index]);
+	for (long i = 0; i < N0; i += 8) {
+		__m256i ai = mulModShoupAVX2(_mm256_loadu_si256((__m256i*)(a + i)), vS, vSs, vp);
+		_mm256_storeu_si256((__m256i*)(a + i), reduceOnceAVX2(ai, vp));
+	}
+}
+
+#endif
+
+void RingMultiplier::NTTPO2X1(residue_t* a, long index) {
+	uint64_t p = pVec[index];
+	uint64_t pInv = pInvVec[index];
+	uint64_t p2 = p << 1;
+	DIFRadix4X1<logN1 - 2, 1, 1>(a, p, p2, pInv, scaledRootN1Pows[index]);
+	for (long i = 0; i < N1; i++) {
+		normalizeLazy(a[i], p, p2);
 	}
+}
+
+void RingMultiplier::INTTPO2X1(residue_t* a, long index) {
+	uint64_t p = pVec[index];
+	uint64_t pInv = pInvVec[index];
+	uint64_t p2 = p << 1;
+	DITRadix4X1<0, 1, 1>(a, p, p2, pInv, scaledRootN1PowsInv[index]);
 
 	uint64_t NyScale = scaledN1Inv[index];
 	for (long i = 0; i < N1; i++) {
@@ -240,887 +776,1095 @@ void RingMultiplier::INTTPO2X1(uint64_t* a, long index) {
 	}
 }
 
-void RingMultiplier::NTTX1(uint64_t* a, long index) {
-	uint64_t pi = pVec[index];
-	uint64_t pri = prVec[index];
-	uint64_t* rootM1DFTPowsi = rootM1DFTPows[index];
+template<long width, long stride>
+void RingMultiplier::convX1(residue_t* a, long index, uint64_t* scaledDFTPows) {
+	uint64_t p = pVec[index];
+	uint64_t pInv = pInvVec[index];
+	uint64_t p2 = p << 1;
+
+	DIFRadix4X1<logN1 - 2, width, stride>(a, p, p2, pInv, scaledRootN1Pows[index]);
 
-	NTTPO2X1(a, index);
 	for (long i = 0; i < N1; ++i) {
-		mulModBarrettAndEqual(a[i], rootM1DFTPowsi[i], pi, pri);
+		uint64_t W = scaledDFTPows[i];
+		residue_t* ai = a + i * stride;
+		for (long c = 0; c < width; ++c) {
+			mulModMontLazy(ai[c], p, pInv, W);
+		}
 	}
-	INTTPO2X1(a, index);
-}
 
-void RingMultiplier::INTTX1(uint64_t* a, long index) {
-	uint64_t pi = pVec[index];
-	uint64_t pri = prVec[index];
-	uint64_t* rootM1DFTPowsInvi = rootM1DFTPowsInv[index];
+	DITRadix4X1<0, width, stride>(a, p, p2, pInv, scaledRootN1PowsInv[index]);
 
-	NTTPO2X1(a, index);
 	for (long i = 0; i < N1; ++i) {
-		mulModBarrettAndEqual(a[i], rootM1DFTPowsInvi[i], pi, pri);
+		residue_t* ai = a + i * stride;
+		for (long c = 0; c < width; ++c) {
+			normalizeLazy(ai[c], p, p2);
+		}
 	}
-	INTTPO2X1(a, index);
 }
 
-void RingMultiplier::NTT(uint64_t* a, long index) {
-	for (long j = 0; j < N1; ++j) {
-		uint64_t* aj = a + (j << logN0);
-		NTTX0(aj, index);
+void RingMultiplier::NTTX1(residue_t* a, long index) {
+	convX1<1, 1>(a, index, scaledRootM1DFTPows[index]);
+}
+
+void RingMultiplier::INTTX1(residue_t* a, long index) {
+	convX1<1, 1>(a, index, scaledRootM1DFTPowsInv[index]);
+}
+
+void RingMultiplier::NTTX1Tiled(residue_t* a, long index) {
+	for (long j = 0; j < N0; j += tileX1) {
+		convX1<tileX1, N0>(a + j, index, scaledRootM1DFTPows[index]);
 	}
-	uint64_t* tmp = new uint64_t[N1];
-	for (long j = 0; j < N0; ++j) {
-		for (long k = 0; k < N1; ++k) {
-			tmp[k] = a[j + (k << logN0)];
-		}
-		NTTX1(tmp, index);
-		for (long k = 0; k < N1; ++k) {
-			a[j + (k << logN0)] = tmp[k];
-		}
+}
+
+void RingMultiplier::INTTX1Tiled(residue_t* a, long index) {
+	for (long j = 0; j < N0; j += tileX1) {
+		convX1<tileX1, N0>(a + j, index, scaledRootM1DFTPowsInv[index]);
 	}
-	delete[] tmp;
 }
 
-void RingMultiplier::INTT(uint64_t* a, long index) {
-	uint64_t* tmp = new uint64_t[N1];
-	for (long j = 0; j < N0; ++j) {
-		for (long k = 0; k < N1; ++k) {
-			tmp[k] = a[j + (k << logN0)];
-		}
-		INTTX1(tmp, index);
-		for (long k = 0; k < N1; ++k) {
-			a[j + (k << logN0)] = tmp[k];
-		}
+void RingMultiplier::NTT(residue_t* a, long index) {
+	for (long j = 0; j < N1; ++j) {
+		residue_t* aj = a + (j << logN0);
+		NTTX0(aj, index);
 	}
-	delete[] tmp;
+	NTTX1Tiled(a, index);
+}
 
+void RingMultiplier::INTT(residue_t* a, long index) {
+	INTTX1Tiled(a, index);
 	for (long j = 0; j < N1; ++j) {
-		uint64_t* aj = a + (j << logN0);
+		residue_t* aj = a + (j << logN0);
 		INTTX0(aj, index);
 	}
 }
 
-void RingMultiplier::toNTTX0(uint64_t* ra, ZZ* a, long np) {
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+// each batched phase is one NTL_EXEC_RANGE over prime-major (prime, row) or (prime, tile) units,
+// so a single product uses every thread even when np is small, and threads keep their primes across phases
 
-		uint64_t* rai = ra + (i << logN0);
-		for (long n = 0; n < N0; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		NTTX0(rai, i);
+void RingMultiplier::toResidues(residue_t* ra, ZZ* a, long np) {
+	NTL_EXEC_RANGE(N1, first, last);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	uint64_t* buf = scratch.alloc<uint64_t>(cbnd << logN0);
+	for (long k = first; k < last; ++k) {
+		toResiduesBlock(ra + (k << logN0), logN, a + (k << logN0), N0, np, buf);
 	}
+	scratch.release(mark);
 	NTL_EXEC_RANGE_END;
 }
 
-void RingMultiplier::toNTTX1(uint64_t* ra, ZZ* a, long np) {
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
+void RingMultiplier::toResiduesPrimes(residue_t* ra, ZZ* a, long np) {
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	for (long u = first; u < last; ++u) {
+		long i = u >> logN1;
 		uint64_t pi = pVec[i];
 		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
 
-		uint64_t* rai = ra + (i << logN1);
-		for (long n = 0; n < N1; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
+		residue_t* rau = ra + (u << logN0);
+		ZZ* au = a + ((u & (N1 - 1)) << logN0);
+		for (long n = 0; n < N0; ++n) {
+			rau[n] = _ntl_general_rem_one_struct_apply(au[n].rep, pi, red_ss);
 		}
-		NTTX1(rai, i);
 	}
 	NTL_EXEC_RANGE_END;
 }
 
-void RingMultiplier::toNTT(uint64_t* ra, ZZ* a, long np) {
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-
-		uint64_t* rai = ra + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss); // an mod pi
+void RingMultiplier::toResiduesBlock(residue_t* ra, long logstride, ZZ* a, long len, long np, uint64_t* buf) {
+	// gather the limbs of |a[n]| once, limb-major, then sweep all primes over them
+	long nl = 0;
+	for (long n = 0; n < len; ++n) {
+		nl = max(nl, a[n].size());
+	}
+	nl = min(nl, cbnd);
+	for (long n = 0; n < len; ++n) {
+		const ZZ_limb_t* an = ZZ_limbs_get(a[n]);
+		long sn = a[n].size();
+		if (sn > cbnd) sn = 0;
+		for (long j = 0; j < nl; ++j) {
+			buf[j * len + n] = j < sn ? an[j] : 0;
 		}
-		NTT(rai, i);
 	}
-	NTL_EXEC_RANGE_END;
-}
-
-void RingMultiplier::addNTTAndEqual(uint64_t* ra, uint64_t* rb, long np) {
 	for (long i = 0; i < np; ++i) {
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
 		uint64_t pi = pVec[i];
-		for (long n = 0; n < N; ++n) {
-			rai[n] = rai[n] + rbi[n];
-			if(rai[n] > pi) rai[n] -= pi;
+		uint64_t p2 = pi << 1;
+		residue_t* limbPowsi = limbPows[i];
+		residue_t* limbPowsShoupi = limbPowsShoup[i];
+		residue_t* rai = ra + (i << logstride);
+		for (long n = 0; n < len; ++n) rai[n] = 0;
+		for (long j = 0; j < nl * limbPieces; ++j) {
+			uint64_t* bj = buf + (j / limbPieces) * len;
+			long sh = (j % limbPieces) * residueBits;
+			uint64_t W = limbPowsi[j];
+			uint64_t Ws = limbPowsShoupi[j];
+			for (long n = 0; n < len; ++n) {
+				uint64_t b = static_cast<residue_t>(bj[n] >> sh);
+				uint64_t q = static_cast<uint64_t>((static_cast<unsigned __int128>(b) * Ws) >> residueBits);
+				uint64_t t = (uint64_t) rai[n] + static_cast<residue_t>(b * W - q * pi);
+				t = t >= p2 ? t - p2 : t;
+				rai[n] = t;
+			}
+		}
+		for (long n = 0; n < len; ++n) {
+			if (rai[n] >= pi) rai[n] -= pi;
+			if (a[n].size() > cbnd) {
+				rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss_array[i]);
+			} else if (sign(a[n]) < 0 && rai[n] != 0) {
+				rai[n] = pi - rai[n];
+			}
 		}
 	}
 }
 
-void RingMultiplier::reconstruct(ZZ* x, uint64_t* rx, long np, const ZZ& q) {
-	ZZ* pHatnp = pHat[np - 1];
-	uint64_t* pHatInvModpnp = pHatInvModp[np - 1];
-	mulmod_precon_t* coeffpinv_arraynp = coeffpinv_array[np - 1];
-	ZZ& pProdnp = pProd[np - 1];
-	ZZ& pProdhnp = pProdh[np - 1];
-	NTL_EXEC_RANGE(N, first, last);
-	for (long n = first; n < last; ++n) {
-		ZZ& acc = x[n];
-		QuickAccumBegin(acc, pProdnp.size());
-		for (long i = 0; i < np; i++) {
-			long p = pVec[i];
-			long tt = pHatInvModpnp[i];
-			mulmod_precon_t ttpinv = coeffpinv_arraynp[i];
-			long s = MulModPrecon(rx[n + (i << logN)], tt, p, ttpinv);
-			QuickAccumMulAdd(acc, pHatnp[i], s);
-		}
-		QuickAccumEnd(acc);
-		rem(x[n], x[n], pProdnp);
-		if (x[n] > pProdhnp) x[n] -= pProdnp;
-		x[n] %= q;
+long RingMultiplier::signedLimbs(CoeffArray& a, long off, long len) {
+	long nl = a.nlimbs;
+	while (nl > 1) {
+		uint64_t* top = a.data + ((nl - 1) << logN) + off;
+		uint64_t* below = a.data + ((nl - 2) << logN) + off;
+		uint64_t diff = 0;
+		for (long n = 0; n < len; ++n) {
+			diff |= top[n] ^ (uint64_t) ((int64_t) below[n] >> 63);
+		}
+		if (diff != 0) break;
+		nl--;
 	}
-	NTL_EXEC_RANGE_END;
+	return nl;
 }
 
-void RingMultiplier::multX0(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN0];
+void RingMultiplier::toResidues(residue_t* ra, CoeffArray& a, long np) {
+	a.alloc();
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	long* rowLimbs = scratch.alloc<long>(N1);
+	NTL_EXEC_RANGE(N1, first, last);
+	for (long k = first; k < last; ++k) {
+		rowLimbs[k] = signedLimbs(a, k << logN0, N0);
+	}
+	NTL_EXEC_RANGE_END;
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN0);
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	uint64_t acc[N0];
+	for (long u = first; u < last; ++u) {
+		long i = u >> logN1;
 		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
+		uint64_t p2 = pi << 1;
+		residue_t* limbPowsi = limbPows[i];
+		residue_t* limbPowsShoupi = limbPowsShoup[i];
+
+		residue_t* rau = ra + (u << logN0);
+		long off = (u & (N1 - 1)) << logN0;
+		long nl = rowLimbs[u & (N1 - 1)];
+		for (long n = 0; n < N0; ++n) acc[n] = 0;
+		for (long j = 0; j < nl * limbPieces; ++j) {
+			uint64_t* aj = a.data + ((j / limbPieces) << logN) + off;
+			long sh = (j % limbPieces) * residueBits;
+			uint64_t W = limbPowsi[j];
+			uint64_t Ws = limbPowsShoupi[j];
+			for (long n = 0; n < N0; ++n) {
+				uint64_t b = static_cast<residue_t>(aj[n] >> sh);
+				uint64_t q = static_cast<uint64_t>((static_cast<unsigned __int128>(b) * Ws) >> residueBits);
+				uint64_t t = acc[n] + static_cast<residue_t>(b * W - q * pi);
+				acc[n] = t >= p2 ? t - p2 : t;
+			}
 		}
-		for (long iy = 0; iy < N; iy += N0) {
-			uint64_t* raij = rai + iy;
-			NTTX0(raij, i);
+		// a negative coefficient was read as its value plus 2^(64 nl)
+		uint64_t* top = a.data + ((nl - 1) << logN) + off;
+		uint64_t wrap = limbPowsi[nl * limbPieces];
+		for (long n = 0; n < N0; ++n) {
+			uint64_t t = acc[n] >= pi ? acc[n] - pi : acc[n];
+			if (top[n] >> 63) t = t >= wrap ? t - wrap : t + pi - wrap;
+			rau[n] = t;
 		}
+	}
+	NTL_EXEC_RANGE_END;
+	scratch.release(mark);
+}
 
-		for (int ix = 0; ix < N0; ++ix) {
-			rbi[ix] = _ntl_general_rem_one_struct_apply(b[ix].rep, pi, red_ss);
-		}
-		NTTX0(rbi, i);
+void RingMultiplier::toResidues(residue_t* ra, long* a, long np) {
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	for (long u = first; u < last; ++u) {
+		uint64_t pi = pVec[u >> logN1];
 
-		for (long ix = 0; ix < N0; ++ix) {
-			for (long iy = 0; iy < N; iy += N0) {
-				long n = ix + iy;
-				mulModBarrettAndEqual(rai[n], rbi[ix], pi, pri);
-			}
+		residue_t* rau = ra + (u << logN0);
+		long* au = a + ((u & (N1 - 1)) << logN0);
+		for (long n = 0; n < N0; ++n) {
+			rau[n] = au[n] >= 0 ? au[n] : pi - au[n];
 		}
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		for (long iy = 0; iy < N; iy += N0) {
-			uint64_t* raij = rai + iy;
-			INTTX0(raij, i);
-		}
+void RingMultiplier::NTTX0Batch(residue_t* ra, long np) {
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	for (long u = first; u < last; ++u) {
+		NTTX0(ra + (u << logN0), u >> logN1);
 	}
 	NTL_EXEC_RANGE_END;
-	delete[] rb;
+}
 
-	reconstruct(x, ra, np, q);
-	delete[] ra;
+void RingMultiplier::INTTX0Batch(residue_t* ra, long np) {
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	for (long u = first; u < last; ++u) {
+		INTTX0(ra + (u << logN0), u >> logN1);
+	}
+	NTL_EXEC_RANGE_END;
 }
 
-void RingMultiplier::multX0AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN0];
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN0);
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
+void RingMultiplier::NTTX1Batch(residue_t* ra, long np) {
+	long tiles = N0 / tileX1;
+	NTL_EXEC_RANGE(np * tiles, first, last);
+	for (long u = first; u < last; ++u) {
+		long i = u / tiles;
+		long j = (u % tiles) * tileX1;
+		convX1<tileX1, N0>(ra + (i << logN) + j, i, scaledRootM1DFTPows[i]);
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+void RingMultiplier::INTTX1Batch(residue_t* ra, long np) {
+	long tiles = N0 / tileX1;
+	NTL_EXEC_RANGE(np * tiles, first, last);
+	for (long u = first; u < last; ++u) {
+		long i = u / tiles;
+		long j = (u % tiles) * tileX1;
+		convX1<tileX1, N0>(ra + (i << logN) + j, i, scaledRootM1DFTPowsInv[i]);
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		for (long j = 0; j < N1; ++j) {
-			uint64_t* raij = rai + (j << logN0);
-			NTTX0(raij, i);
-		}
+void RingMultiplier::NTTBatch(residue_t* ra, long np) {
+	NTTX0Batch(ra, np);
+	NTTX1Batch(ra, np);
+}
 
-		for (long ix = 0; ix < N0; ++ix) {
-			rbi[ix] = _ntl_general_rem_one_struct_apply(b[ix].rep, pi, red_ss);
-		}
-		NTTX0(rbi, i);
+void RingMultiplier::INTTBatch(residue_t* ra, long np) {
+	INTTX1Batch(ra, np);
+	INTTX0Batch(ra, np);
+}
 
-		for (long ix = 0; ix < N0; ++ix) {
-			for (long iy = 0; iy < N; iy += N0) {
-				long n = ix + iy;
-				mulModBarrettAndEqual(rai[n], rbi[ix], pi, pri);
-			}
-		}
+void RingMultiplier::mulModBatch(residue_t* rx, residue_t* ra, residue_t* rb, residue_t* rbs, long np) {
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	for (long u = first; u < last; ++u) {
+		long i = u >> logN1;
+		uint64_t pi = pVec[i];
+		uint64_t pri = prVec[i];
 
-		for (long j = 0; j < N1; ++j) {
-			uint64_t* raij = rai + (j << logN0);
-			INTTX0(raij, i);
+		residue_t* rxu = rx + (u << logN0);
+		residue_t* rau = ra + (u << logN0);
+		residue_t* rbu = rb + (u << logN0);
+		if (rbs != NULL) {
+			residue_t* rbsu = rbs + (u << logN0);
+			for (long n = 0; n < N0; ++n) {
+				mulModShoup(rxu[n], rau[n], rbu[n], rbsu[n], pi);
+			}
+		} else {
+			for (long n = 0; n < N0; ++n) {
+				mulModBarrett(rxu[n], rau[n], rbu[n], pi, pri);
+			}
 		}
-
 	}
 	NTL_EXEC_RANGE_END;
-	delete[] rb;
-
-	reconstruct(a, ra, np, q);
-	delete[] ra;
 }
 
-void RingMultiplier::multNTTX0(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN0);
+void RingMultiplier::mulModX0Batch(residue_t* rx, residue_t* ra, residue_t* rb, residue_t* rbs, long np) {
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	for (long u = first; u < last; ++u) {
+		long i = u >> logN1;
 		uint64_t pi = pVec[i];
 		uint64_t pri = prVec[i];
 
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		for (long j = 0; j < N1; ++j) {
-			uint64_t* raij = rai + (j << logN0);
-			NTTX0(raij, i);
+		residue_t* rxu = rx + (u << logN0);
+		residue_t* rau = ra + (u << logN0);
+		residue_t* rbi = rb + (i << logN0);
+		if (rbs != NULL) {
+			residue_t* rbsi = rbs + (i << logN0);
+			for (long ix = 0; ix < N0; ++ix) {
+				mulModShoup(rxu[ix], rau[ix], rbi[ix], rbsi[ix], pi);
+			}
+		} else {
+			for (long ix = 0; ix < N0; ++ix) {
+				mulModBarrett(rxu[ix], rau[ix], rbi[ix], pi, pri);
+			}
 		}
+	}
+	NTL_EXEC_RANGE_END;
+}
+
+void RingMultiplier::mulModX1Batch(residue_t* rx, residue_t* ra, residue_t* rb, long np) {
+	NTL_EXEC_RANGE(np << logN1, first, last);
+	for (long u = first; u < last; ++u) {
+		long i = u >> logN1;
+		uint64_t pi = pVec[i];
+		uint64_t pri = prVec[i];
 
+		residue_t* rxu = rx + (u << logN0);
+		residue_t* rau = ra + (u << logN0);
+		uint64_t rbu = rb[u];
 		for (long ix = 0; ix < N0; ++ix) {
-			for (long n = ix; n < N; n += N0) {
-				mulModBarrettAndEqual(rai[n], rbi[ix], pi, pri);
-			}
+			mulModBarrett(rxu[ix], rau[ix], rbu, pi, pri);
 		}
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		for (long j = 0; j < N1; ++j) {
-			uint64_t* raij = rai + (j << logN0);
-			INTTX0(raij, i);
-		}
 
+void RingMultiplier::toNTTX0(residue_t* ra, ZZ* a, long np) {
+	NTL_EXEC_RANGE(N0, first, last);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	uint64_t* buf = scratch.alloc<uint64_t>(cbnd * (last - first));
+	toResiduesBlock(ra + first, logN0, a + first, last - first, np, buf);
+	scratch.release(mark);
+	NTL_EXEC_RANGE_END;
+	NTL_EXEC_RANGE(np, first, last);
+	for (long i = first; i < last; ++i) {
+		NTTX0(ra + (i << logN0), i);
 	}
 	NTL_EXEC_RANGE_END;
-
-	reconstruct(x, ra, np, q);
-	delete[] ra;
 }
 
-void RingMultiplier::multNTTX0AndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
+void RingMultiplier::toNTTX1(residue_t* ra, ZZ* a, long np) {
+	NTL_EXEC_RANGE(N1, first, last);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	uint64_t* buf = scratch.alloc<uint64_t>(cbnd * (last - first));
+	toResiduesBlock(ra + first, logN1, a + first, last - first, np, buf);
+	scratch.release(mark);
+	NTL_EXEC_RANGE_END;
 	NTL_EXEC_RANGE(np, first, last);
 	for (long i = first; i < last; ++i) {
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN0);
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
+		NTTX1(ra + (i << logN1), i);
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+void RingMultiplier::toNTT(residue_t* ra, ZZ* a, long np) {
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+}
 
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		for (long j = 0; j < N1; ++j) {
-			uint64_t* raij = rai + (j << logN0);
-			NTTX0(raij, i);
-		}
+void RingMultiplier::toNTT(residue_t* ra, CoeffArray& a, long np) {
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+}
 
-		for (long ix = 0; ix < N0; ++ix) {
-			for (long iy = 0; iy < N; iy += N0) {
-				long n = ix + iy;
-				mulModBarrettAndEqual(rai[n], rbi[ix], pi, pri);
+void RingMultiplier::fromNTT(ZZ* x, residue_t* ra, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(np << logN);
+	for (long n = 0; n < (np << logN); ++n) {
+		rx[n] = ra[n];
+	}
+	INTTBatch(rx, np);
+	reconstruct(x, rx, np, q);
+	scratch.release(mark);
+}
+
+void RingMultiplier::fromNTT(CoeffArray& x, residue_t* ra, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(np << logN);
+	for (long n = 0; n < (np << logN); ++n) {
+		rx[n] = ra[n];
+	}
+	INTTBatch(rx, np);
+	reconstruct(x, rx, np, logq);
+	scratch.release(mark);
+}
+
+void RingMultiplier::scaleResidues(residue_t* ry, long npy, residue_t* rx, long npx, long logd, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	uint64_t* frac = scratch.alloc<uint64_t>(4 * (npx + 1));
+	uint64_t* hat = scratch.alloc<uint64_t>((npx + 2) * npy);
+	double* pInvD = scratch.alloc<double>(npx);
+	prepareScale(frac, hat, npy, npx, logd, logq);
+	for (long i = 0; i < npx; ++i) {
+		pInvD[i] = 1.0 / (double) pVec[i];
+	}
+	uint64_t* pHatInvModpnp = pHatInvModp[npx - 1];
+	mulmod_precon_t* coeffpinv_arraynp = coeffpinv_array[npx - 1];
+	NTL_EXEC_RANGE(N, first, last);
+	uint64_t s[nprimes];
+	for (long n = first; n < last; ++n) {
+		double est = 0.0;
+		for (long i = 0; i < npx; ++i) {
+			s[i] = MulModPrecon(rx[(i << logN) + n], pHatInvModpnp[i], pVec[i], coeffpinv_arraynp[i]);
+			est += (double) s[i] * pInvD[i];
+		}
+		// x = sum_i s_i * pHat_i - v * P as in reconstructWords
+		uint64_t v = (uint64_t) (est + 0.5);
+		__int128 ez = scaleRound(s, npx, frac, v);
+		__int128 ew = scaleRound(s, npx, frac + 2 * (npx + 1), v);
+		for (long j = 0; j < npy; ++j) {
+			uint64_t p = pVec[j];
+			// s_i < 2^kbar and hat < p_j, so the npx products fit in 128 bits
+			unsigned __int128 acc = 0;
+			for (long i = 0; i < npx; ++i) {
+				acc += static_cast<unsigned __int128>(s[i]) * hat[i * npy + j];
 			}
+			uint64_t r = static_cast<uint64_t>(acc % p);
+			uint64_t t;
+			mulMod(t, v, hat[npx * npy + j], p);
+			r = r >= t ? r - t : r + p - t;
+			t = static_cast<uint64_t>((ez % (__int128) p + p) % p);
+			r += t;
+			if (r >= p) r -= p;
+			mulMod(t, static_cast<uint64_t>((ew % (__int128) p + p) % p), hat[(npx + 1) * npy + j], p);
+			r = r >= t ? r - t : r + p - t;
+			ry[(j << logN) + n] = r;
 		}
+	}
+	NTL_EXEC_RANGE_END;
+	scratch.release(mark);
+}
 
-		for (long j = 0; j < N1; ++j) {
-			uint64_t* raij = rai + (j << logN0);
-			INTTX0(raij, i);
+void RingMultiplier::prepareScale(uint64_t* frac, uint64_t* hat, long npy, long npx, long logd, long logq) {
+	ZZ t;
+	for (long i = 0; i <= npx; ++i) {
+		ZZ& h = i < npx ? pHat[npx - 1][i] : pProd[npx - 1];
+		for (long k = 0; k < 2; ++k) {
+			long d = k == 0 ? logd : logd + logq;
+			trunc_ZZ(t, h, d);
+			t <<= 128;
+			t >>= d;
+			if (i == npx && t != 0) t = power2_ZZ(128) - t;
+			BytesFromZZ((unsigned char*) (frac + 2 * (k * (npx + 1) + i)), t, 16);
+		}
+		t = h >> logd;
+		trunc_ZZ(t, t, logq);
+		for (long j = 0; j < npy; ++j) {
+			hat[i * npy + j] = t % (long) pVec[j];
 		}
+	}
+	for (long j = 0; j < npy; ++j) {
+		hat[(npx + 1) * npy + j] = powMod(2, logq, pVec[j]);
+	}
+}
 
+__int128 RingMultiplier::scaleRound(uint64_t* s, long np, uint64_t* frac, uint64_t v) {
+	uint64_t w0 = 0;
+	uint64_t w1 = 0;
+	unsigned __int128 ip = 0;
+	for (long i = 0; i <= np; ++i) {
+		uint64_t si = i < np ? s[i] : v;
+		unsigned __int128 t = static_cast<unsigned __int128>(si) * frac[2 * i];
+		uint64_t lo = static_cast<uint64_t>(t);
+		uint64_t carry = static_cast<uint64_t>(t >> 64);
+		w0 += lo;
+		carry += (w0 < lo);
+		t = static_cast<unsigned __int128>(si) * frac[2 * i + 1] + carry;
+		lo = static_cast<uint64_t>(t);
+		ip += t >> 64;
+		w1 += lo;
+		ip += (w1 < lo);
 	}
-	NTL_EXEC_RANGE_END;
+	// the fraction of P is stored as 1 - g, so v is taken back from the integer part
+	if (frac[2 * np] != 0 || frac[2 * np + 1] != 0) ip -= v;
+	return static_cast<__int128>(ip) + (w1 >> 63);
+}
 
-	reconstruct(a, ra, np, q);
-	delete[] ra;
+void RingMultiplier::scaleNTT(residue_t* ry, long npy, residue_t* ra, long npx, long logd, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(npx << logN);
+	for (long n = 0; n < (npx << logN); ++n) {
+		rx[n] = ra[n];
+	}
+	INTTBatch(rx, npx);
+	scaleResidues(ry, npy, rx, npx, logd, logq);
+	NTTBatch(ry, npy);
+	scratch.release(mark);
 }
 
-void RingMultiplier::multDNTTX0(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* rx = new uint64_t[np << logN];
+void RingMultiplier::addNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np) {
 	NTL_EXEC_RANGE(np, first, last);
 	for (long i = first; i < last; ++i) {
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN0);
+		residue_t* rxi = rx + (i << logN);
+		residue_t* rai = ra + (i << logN);
+		residue_t* rbi = rb + (i << logN);
 		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-
-		uint64_t* rxi = rx + (i << logN);
-		for (long ix = 0; ix < N0; ++ix) {
-			for (long n = ix; n < N; n += N0) {
-				mulModBarrett(rxi[n], rai[n], rbi[ix], pi, pri);
-			}
-		}
-
-		for (long j = 0; j < N1; ++j) {
-			uint64_t* rxij = rxi + (j << logN0);
-			INTTX0(rxij, i);
+		for (long n = 0; n < N; ++n) {
+			uint64_t s = (uint64_t) rai[n] + rbi[n];
+			rxi[n] = s >= pi ? s - pi : s;
 		}
-
 	}
 	NTL_EXEC_RANGE_END;
-
-	reconstruct(x, rx, np, q);
-	delete[] rx;
 }
 
+void RingMultiplier::addNTTAndEqual(residue_t* ra, residue_t* rb, long np) {
+	addNTT(ra, ra, rb, np);
+}
 
-void RingMultiplier::multX1(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN1];
-
+void RingMultiplier::subNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np) {
 	NTL_EXEC_RANGE(np, first, last);
 	for (long i = first; i < last; ++i) {
+		residue_t* rxi = rx + (i << logN);
+		residue_t* rai = ra + (i << logN);
+		residue_t* rbi = rb + (i << logN);
 		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-
-		uint64_t* tmp = new uint64_t[1 << logN1];
-		uint64_t* rai = ra + (i << logN);
 		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			NTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
-			}
-		}
-
-		uint64_t* rbi = rb + (i << logN1);
-		for (int iy = 0; iy < N1; ++iy) {
-			rbi[iy] = _ntl_general_rem_one_struct_apply(b[iy].rep, pi, red_ss);
-		}
-		NTTX1(rbi, i);
-
-		for (long iy = 0; iy < N1; ++iy) {
-			uint64_t rbiy = rbi[iy];
-			uint64_t* raiy = rai + (iy << logN0);
-			for (long ix = 0; ix < N0; ++ix) {
-				mulModBarrettAndEqual(raiy[ix], rbiy, pi, pri);
-			}
+			rxi[n] = rai[n] >= rbi[n] ? rai[n] - rbi[n] : rai[n] + pi - rbi[n];
 		}
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			INTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
-			}
+void RingMultiplier::negateNTT(residue_t* rx, residue_t* ra, long np) {
+	NTL_EXEC_RANGE(np, first, last);
+	for (long i = first; i < last; ++i) {
+		residue_t* rxi = rx + (i << logN);
+		residue_t* rai = ra + (i << logN);
+		uint64_t pi = pVec[i];
+		for (long n = 0; n < N; ++n) {
+			rxi[n] = rai[n] == 0 ? 0 : pi - rai[n];
 		}
-		delete[] tmp;
 	}
 	NTL_EXEC_RANGE_END;
-	delete[] rb;
-
-	reconstruct(x, ra, np, q);
-	delete[] ra;
 }
 
-void RingMultiplier::multX1AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN1];
-
+void RingMultiplier::multByConstNTT(residue_t* rx, residue_t* ra, const ZZ& cnst, long np) {
 	NTL_EXEC_RANGE(np, first, last);
 	for (long i = first; i < last; ++i) {
+		residue_t* rxi = rx + (i << logN);
+		residue_t* rai = ra + (i << logN);
 		uint64_t pi = pVec[i];
 		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-
-		uint64_t* rai = ra + (i << logN);
+		uint64_t c = cnst % (long) pi;
 		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		uint64_t* tmp = new uint64_t[1 << logN1];
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			NTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
-			}
+			mulModBarrett(rxi[n], rai[n], c, pi, pri);
 		}
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		uint64_t* rbi = rb + (i << logN1);
-		for (long iy = 0; iy < N1; ++iy) {
-			rbi[iy] = _ntl_general_rem_one_struct_apply(b[iy].rep, pi, red_ss);
-		}
-		NTTX1(rbi, i);
-
-		for (long iy = 0; iy < N1; ++iy) {
-			uint64_t rbiy = rbi[iy];
-			uint64_t* raiy = rai + (iy << logN0);
-			for (long ix = 0; ix < N0; ++ix) {
-				mulModBarrettAndEqual(raiy[ix], rbiy, pi, pri);
-			}
-		}
+void RingMultiplier::automorphismIndexX0(long* idx, long deg0) {
+	for (long j = 0; j < N0; ++j) {
+		uint64_t e = ((uint64_t) bitReverse(static_cast<uint32_t>(j)) >> (32 - logN0)) * 2 + 1;
+		uint64_t eprime = (e * deg0) % M0;
+		idx[j] = bitReverse(static_cast<uint32_t>((eprime - 1) >> 1)) >> (32 - logN0);
+	}
+}
 
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			INTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
+void RingMultiplier::automorphismNTT(residue_t* rx, residue_t* ra, long* idx0, long r1, long np) {
+	NTL_EXEC_RANGE(np, first, last);
+	for (long i = first; i < last; ++i) {
+		residue_t* rxi = rx + (i << logN);
+		residue_t* rai = ra + (i << logN);
+		for (long k = 0; k < N1; ++k) {
+			residue_t* rxik = rxi + (k << logN0);
+			residue_t* raik = rai + (((k + r1) & (N1 - 1)) << logN0);
+			for (long j = 0; j < N0; ++j) {
+				rxik[j] = raik[idx0[j]];
 			}
 		}
-		delete[] tmp;
 	}
 	NTL_EXEC_RANGE_END;
-	delete[] rb;
-
-	reconstruct(a, ra, np, q);
-	delete[] ra;
 }
 
-void RingMultiplier::multNTTX1(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-
+void RingMultiplier::toShoup(residue_t* rbs, residue_t* rb, long np, long logn) {
 	NTL_EXEC_RANGE(np, first, last);
 	for (long i = first; i < last; ++i) {
 		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-
-		uint64_t* tmp = new uint64_t[1 << logN1];
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN1);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			NTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
-			}
+		residue_t* rbi = rb + (i << logn);
+		residue_t* rbsi = rbs + (i << logn);
+		for (long n = 0; n < (1 << logn); ++n) {
+			rbsi[n] = static_cast<residue_t>((static_cast<unsigned __int128>(rbi[n]) << residueBits) / pi);
 		}
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		for (long iy = 0; iy < N1; ++iy) {
-			uint64_t rbiy = rbi[iy];
-			uint64_t* raiy = rai + (iy << logN0);
-			for (long ix = 0; ix < N0; ++ix) {
-				mulModBarrettAndEqual(raiy[ix], rbiy, pi, pri);
-			}
+void RingMultiplier::reconstruct(ZZ* x, residue_t* rx, long np, const ZZ& q) {
+	if (weight(q) == 1) {
+		long logq = NumBits(q) - 1;
+		long nl = (logq + 63) >> 6;
+		ScratchArena& scratch = ScratchArena::local();
+		ScratchMark mark = scratch.mark();
+		uint64_t* hat = scratch.alloc<uint64_t>((np + 1) * nl);
+		double* pInvD = scratch.alloc<double>(np);
+		prepareReconstruct(hat, pInvD, np, nl);
+		NTL_EXEC_RANGE(N, first, last);
+		uint64_t acc[cbnd + 1];
+		for (long n = first; n < last; ++n) {
+			reconstructWords(acc, rx + n, np, nl, logq, hat, pInvD);
+			ZZFromBytes(x[n], (unsigned char*) acc, nl << 3);
+		}
+		NTL_EXEC_RANGE_END;
+		scratch.release(mark);
+		return;
+	}
+
+	ZZ* pHatnp = pHat[np - 1];
+	uint64_t* pHatInvModpnp = pHatInvModp[np - 1];
+	mulmod_precon_t* coeffpinv_arraynp = coeffpinv_array[np - 1];
+	ZZ& pProdnp = pProd[np - 1];
+	ZZ& pProdhnp = pProdh[np - 1];
+	NTL_EXEC_RANGE(N, first, last);
+	for (long n = first; n < last; ++n) {
+		ZZ& acc = x[n];
+		QuickAccumBegin(acc, pProdnp.size());
+		for (long i = 0; i < np; i++) {
+			long p = pVec[i];
+			long tt = pHatInvModpnp[i];
+			mulmod_precon_t ttpinv = coeffpinv_arraynp[i];
+			long s = MulModPrecon(rx[n + (i << logN)], tt, p, ttpinv);
+			QuickAccumMulAdd(acc, pHatnp[i], s);
 		}
+		QuickAccumEnd(acc);
+		rem(x[n], x[n], pProdnp);
+		if (x[n] > pProdhnp) x[n] -= pProdnp;
+		x[n] %= q;
+	}
+	NTL_EXEC_RANGE_END;
+}
 
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			INTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
-			}
+void RingMultiplier::reconstruct(CoeffArray& x, residue_t* rx, long np, long logq) {
+	x.alloc();
+	long nl = (logq + 63) >> 6;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	uint64_t* hat = scratch.alloc<uint64_t>((np + 1) * nl);
+	double* pInvD = scratch.alloc<double>(np);
+	prepareReconstruct(hat, pInvD, np, nl);
+	NTL_EXEC_RANGE(N, first, last);
+	uint64_t acc[cbnd + 1];
+	for (long n = first; n < last; ++n) {
+		reconstructWords(acc, rx + n, np, nl, logq, hat, pInvD);
+		for (long k = 0; k < x.nlimbs; ++k) {
+			x.data[(k << logN) + n] = k < nl ? acc[k] : 0;
 		}
-		delete[] tmp;
 	}
 	NTL_EXEC_RANGE_END;
+	scratch.release(mark);
+}
+
+void RingMultiplier::prepareReconstruct(uint64_t* hat, double* pInvD, long np, long nl) {
+	for (long i = 0; i < np; ++i) {
+		BytesFromZZ((unsigned char*) (hat + i * nl), pHat[np - 1][i], nl << 3);
+		pInvD[i] = 1.0 / (double) pVec[i];
+	}
+	BytesFromZZ((unsigned char*) (hat + np * nl), pProd[np - 1], nl << 3);
+}
+
+void RingMultiplier::reconstructWords(uint64_t* acc, residue_t* rx, long np, long nl, long logq, uint64_t* hat, double* pInvD) {
+	uint64_t* pHatInvModpnp = pHatInvModp[np - 1];
+	mulmod_precon_t* coeffpinv_arraynp = coeffpinv_array[np - 1];
+	for (long k = 0; k < nl; ++k) acc[k] = 0;
+	double est = 0.0;
+	for (long i = 0; i < np; i++) {
+		long p = pVec[i];
+		uint64_t s = MulModPrecon(rx[i << logN], pHatInvModpnp[i], p, coeffpinv_arraynp[i]);
+		est += (double) s * pInvD[i];
+		uint64_t* hati = hat + i * nl;
+		uint64_t carry = 0;
+		for (long k = 0; k < nl; ++k) {
+			unsigned __int128 t = static_cast<unsigned __int128>(s) * hati[k] + acc[k] + carry;
+			acc[k] = static_cast<uint64_t>(t);
+			carry = static_cast<uint64_t>(t >> 64);
+		}
+	}
+	// est = x / P + v with the centered x, |x| is far below P / 2 for every np chosen by the callers
+	uint64_t v = (uint64_t) (est + 0.5);
+	uint64_t* prod = hat + np * nl;
+	uint64_t borrow = 0;
+	for (long k = 0; k < nl; ++k) {
+		unsigned __int128 t = static_cast<unsigned __int128>(v) * prod[k] + borrow;
+		uint64_t lo = static_cast<uint64_t>(t);
+		borrow = static_cast<uint64_t>(t >> 64) + (acc[k] < lo);
+		acc[k] -= lo;
+	}
+	if (logq & 63) acc[nl - 1] &= (1ULL << (logq & 63)) - 1;
+}
+
+void RingMultiplier::multX0(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rb = scratch.alloc<residue_t>(np << logN0);
+
+	toResidues(ra, a, np);
+	NTTX0Batch(ra, np);
+	toNTTX0(rb, b, np);
+	mulModX0Batch(ra, ra, rb, NULL, np);
+	INTTX0Batch(ra, np);
 
 	reconstruct(x, ra, np, q);
-	delete[] ra;
+	scratch.release(mark);
 }
 
-void RingMultiplier::multNTTX1AndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
+void RingMultiplier::multX0AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rb = scratch.alloc<residue_t>(np << logN0);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+	toResidues(ra, a, np);
+	NTTX0Batch(ra, np);
+	toNTTX0(rb, b, np);
+	mulModX0Batch(ra, ra, rb, NULL, np);
+	INTTX0Batch(ra, np);
 
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN1);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		uint64_t* tmp = new uint64_t[1 << logN1];
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			NTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
-			}
-		}
+	reconstruct(a, ra, np, q);
+	scratch.release(mark);
+}
 
-		for (long iy = 0; iy < N1; ++iy) {
-			uint64_t rbiy = rbi[iy];
-			uint64_t* raiy = rai + (iy << logN0);
-			for (long ix = 0; ix < N0; ++ix) {
-				mulModBarrettAndEqual(raiy[ix], rbiy, pi, pri);
-			}
-		}
+void RingMultiplier::multNTTX0(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rai[j + (k << logN0)];
-			}
-			INTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rai[j + (k << logN0)] = tmp[k];
-			}
-		}
-		delete[] tmp;
-	}
-	NTL_EXEC_RANGE_END;
+	toResidues(ra, a, np);
+	NTTX0Batch(ra, np);
+	mulModX0Batch(ra, ra, rb, NULL, np);
+	INTTX0Batch(ra, np);
+
+	reconstruct(x, ra, np, q);
+	scratch.release(mark);
+}
+
+void RingMultiplier::multNTTX0AndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q) {
+	multNTTX0AndEqual(a, rb, NULL, np, q);
+}
+
+void RingMultiplier::multNTTX0AndEqual(ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+
+	toResidues(ra, a, np);
+	NTTX0Batch(ra, np);
+	mulModX0Batch(ra, ra, rb, rbs, np);
+	INTTX0Batch(ra, np);
 
 	reconstruct(a, ra, np, q);
-	delete[] ra;
+	scratch.release(mark);
 }
 
-void RingMultiplier::multDNTTX1(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* rx = new uint64_t[np << logN];
+void RingMultiplier::multNTTX0AndEqual(CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN1);
-		uint64_t* rxi = rx + (i << logN);
-		for (long iy = 0; iy < N1; ++iy) {
-			uint64_t rbiy = rbi[iy];
-			uint64_t* rxiy = rxi + (iy << logN0);
-			uint64_t* raiy = rai + (iy << logN0);
-			for (long ix = 0; ix < N0; ++ix) {
-				mulModBarrett(rxiy[ix], raiy[ix], rbiy, pi, pri);
-			}
-		}
+	toResidues(ra, a, np);
+	NTTX0Batch(ra, np);
+	mulModX0Batch(ra, ra, rb, rbs, np);
+	INTTX0Batch(ra, np);
 
-		uint64_t* tmp = new uint64_t[1 << logN1];
-		for (long j = 0; j < N0; ++j) {
-			for (long k = 0; k < N1; ++k) {
-				tmp[k] = rxi[j + (k << logN0)];
-			}
-			INTTX1(tmp, i);
-			for (long k = 0; k < N1; ++k) {
-				rxi[j + (k << logN0)] = tmp[k];
-			}
-		}
-		delete[] tmp;
-	}
-	NTL_EXEC_RANGE_END;
+	reconstruct(a, ra, np, logq);
+	scratch.release(mark);
+}
+
+void RingMultiplier::multDNTTX0(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(np << logN);
+
+	mulModX0Batch(rx, ra, rb, NULL, np);
+	INTTX0Batch(rx, np);
 
 	reconstruct(x, rx, np, q);
-	delete[] rx;
+	scratch.release(mark);
 }
 
-void RingMultiplier::mult(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN];
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-			rbi[n] = _ntl_general_rem_one_struct_apply(b[n].rep, pi, red_ss);
-		}
-		NTT(rai, i);
-		NTT(rbi, i);
+void RingMultiplier::multX1(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rb = scratch.alloc<residue_t>(np << logN1);
 
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rbi[n], pi, pri);
-		}
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
-	delete[] rb;
+	toResidues(ra, a, np);
+	NTTX1Batch(ra, np);
+	toNTTX1(rb, b, np);
+	mulModX1Batch(ra, ra, rb, np);
+	INTTX1Batch(ra, np);
 
 	reconstruct(x, ra, np, q);
-	delete[] ra;
+	scratch.release(mark);
 }
 
-void RingMultiplier::mult(ZZ* x, ZZ* a, long* b, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN];
+void RingMultiplier::multX1AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rb = scratch.alloc<residue_t>(np << logN1);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
+	toResidues(ra, a, np);
+	NTTX1Batch(ra, np);
+	toNTTX1(rb, b, np);
+	mulModX1Batch(ra, ra, rb, np);
+	INTTX1Batch(ra, np);
 
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-			rbi[n] = b[n] >= 0 ? b[n] : pi - b[n];
-		}
-		NTT(rai, i);
-		NTT(rbi, i);
+	reconstruct(a, ra, np, q);
+	scratch.release(mark);
+}
 
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rbi[n], pi, pri);
-		}
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
-	delete[] rb;
+void RingMultiplier::multNTTX1(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+
+	toResidues(ra, a, np);
+	NTTX1Batch(ra, np);
+	mulModX1Batch(ra, ra, rb, np);
+	INTTX1Batch(ra, np);
 
 	reconstruct(x, ra, np, q);
-	delete[] ra;
+	scratch.release(mark);
 }
 
-void RingMultiplier::multAndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN];
+void RingMultiplier::multNTTX1AndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+	toResidues(ra, a, np);
+	NTTX1Batch(ra, np);
+	mulModX1Batch(ra, ra, rb, np);
+	INTTX1Batch(ra, np);
 
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-			rbi[n] = _ntl_general_rem_one_struct_apply(b[n].rep, pi, red_ss);
-		}
-		NTT(rai, i);
-		NTT(rbi, i);
+	reconstruct(a, ra, np, q);
+	scratch.release(mark);
+}
 
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rbi[n], pi, pri);
-		}
+void RingMultiplier::multNTTX1AndEqual(CoeffArray& a, residue_t* rb, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
-	delete[] rb;
+	toResidues(ra, a, np);
+	NTTX1Batch(ra, np);
+	mulModX1Batch(ra, ra, rb, np);
+	INTTX1Batch(ra, np);
 
-	reconstruct(a, ra, np, q);
-	delete[] ra;
+	reconstruct(a, ra, np, logq);
+	scratch.release(mark);
 }
 
-void RingMultiplier::multNTT(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
+void RingMultiplier::multDNTTX1(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(np << logN);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
+	mulModX1Batch(rx, ra, rb, np);
+	INTTX1Batch(rx, np);
 
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		NTT(rai, i);
+	reconstruct(x, rx, np, q);
+	scratch.release(mark);
+}
 
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rbi[n], pi, pri);
-		}
+void RingMultiplier::mult(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rb = scratch.alloc<residue_t>(np << logN);
+
+	toResidues(ra, a, np);
+	toResidues(rb, b, np);
+	NTTBatch(ra, np);
+	NTTBatch(rb, np);
+	mulModBatch(ra, ra, rb, NULL, np);
+	INTTBatch(ra, np);
 
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
+	reconstruct(x, ra, np, q);
+	scratch.release(mark);
+}
+
+void RingMultiplier::mult(ZZ* x, ZZ* a, long* b, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rb = scratch.alloc<residue_t>(np << logN);
+
+	toResidues(ra, a, np);
+	toResidues(rb, b, np);
+	NTTBatch(ra, np);
+	NTTBatch(rb, np);
+	mulModBatch(ra, ra, rb, NULL, np);
+	INTTBatch(ra, np);
 
 	reconstruct(x, ra, np, q);
-	delete[] ra;
+	scratch.release(mark);
 }
 
-void RingMultiplier::multNTT(ZZ* x, long* a, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
+void RingMultiplier::multAndEqual(ZZ* a, ZZ* b, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rb = scratch.alloc<residue_t>(np << logN);
+
+	toResidues(ra, a, np);
+	toResidues(rb, b, np);
+	NTTBatch(ra, np);
+	NTTBatch(rb, np);
+	mulModBatch(ra, ra, rb, NULL, np);
+	INTTBatch(ra, np);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
+	reconstruct(a, ra, np, q);
+	scratch.release(mark);
+}
 
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = a[n] >= 0 ? a[n] : pi - a[n];
-		}
-		NTT(rai, i);
+void RingMultiplier::multNTT(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q) {
+	multNTT(x, a, rb, NULL, np, q);
+}
 
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rbi[n], pi, pri);
-		}
+void RingMultiplier::multNTT(ZZ* x, ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+	mulModBatch(ra, ra, rb, rbs, np);
+	INTTBatch(ra, np);
 
 	reconstruct(x, ra, np, q);
-	delete[] ra;
+	scratch.release(mark);
 }
 
-void RingMultiplier::multNTTAndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
-
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+void RingMultiplier::multNTT(ZZ* x, long* a, residue_t* rb, long np, const ZZ& q) {
+	multNTT(x, a, rb, NULL, np, q);
+}
 
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		NTT(rai, i);
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rbi[n], pi, pri);
-		}
+void RingMultiplier::multNTT(ZZ* x, long* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+	mulModBatch(ra, ra, rb, rbs, np);
+	INTTBatch(ra, np);
 
-	reconstruct(a, ra, np, q);
-	delete[] ra;
+	reconstruct(x, ra, np, q);
+	scratch.release(mark);
 }
 
-void RingMultiplier::multDNTT(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q) {
-	uint64_t* rx = new uint64_t[np << logN];
+void RingMultiplier::multNTT(CoeffArray& x, CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+	mulModBatch(ra, ra, rb, rbs, np);
+	INTTBatch(ra, np);
 
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rbi = rb + (i << logN);
-		uint64_t* rxi = rx + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			mulModBarrett(rxi[n], rai[n], rbi[n], pi, pri);
-		}
+	reconstruct(x, ra, np, logq);
+	scratch.release(mark);
+}
 
-		INTT(rxi, i);
-	}
-	NTL_EXEC_RANGE_END;
+void RingMultiplier::multNTT(CoeffArray& x, long* a, residue_t* rb, residue_t* rbs, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-	reconstruct(x, rx, np, q);
-	delete[] rx;
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+	mulModBatch(ra, ra, rb, rbs, np);
+	INTTBatch(ra, np);
+
+	reconstruct(x, ra, np, logq);
+	scratch.release(mark);
 }
 
-void RingMultiplier::square(ZZ* x, ZZ* a, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
+void RingMultiplier::multNTTAndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+	mulModBatch(ra, ra, rb, NULL, np);
+	INTTBatch(ra, np);
 
-		uint64_t* rai = ra + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		NTT(rai, i);
+	reconstruct(a, ra, np, q);
+	scratch.release(mark);
+}
 
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rai[n], pi, pri);
-		}
+void RingMultiplier::multDNTT(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q) {
+	multDNTT(x, ra, rb, NULL, np, q);
+}
 
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
+void RingMultiplier::multDNTT(ZZ* x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(np << logN);
 
-	reconstruct(x, ra, np, q);
-	delete[] ra;
+	mulModBatch(rx, ra, rb, rbs, np);
+	INTTBatch(rx, np);
+
+	reconstruct(x, rx, np, q);
+	scratch.release(mark);
 }
 
-void RingMultiplier::square(ZZ* x, long* a, const ZZ& q) {
-	uint64_t* ra = new uint64_t[N];
+void RingMultiplier::multDNTT(CoeffArray& x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(np << logN);
 
-	for (long n = 0; n < N; ++n) {
-		ra[n] = a[n] >= 0 ? a[n] : pVec[0] - a[n];
-	}
+	mulModBatch(rx, ra, rb, rbs, np);
+	INTTBatch(rx, np);
 
-	NTT(ra, 0);
+	reconstruct(x, rx, np, logq);
+	scratch.release(mark);
+}
 
-	for (long n = 0; n < N; ++n) {
-		mulModBarrettAndEqual(ra[n], ra[n], pVec[0], prVec[0]);
-	}
+void RingMultiplier::square(ZZ* x, ZZ* a, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-	INTT(ra, 0);
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+	mulModBatch(ra, ra, ra, NULL, np);
+	INTTBatch(ra, np);
 
-	reconstruct(x, ra, 1, q);
-	delete[] ra;
+	reconstruct(x, ra, np, q);
+	scratch.release(mark);
 }
 
-void RingMultiplier::squareAndEqual(ZZ* a, long np, const ZZ& q) {
-	uint64_t* ra = new uint64_t[np << logN];
+void RingMultiplier::square(ZZ* x, long* a, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(N);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = 0; i < np; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		_ntl_general_rem_one_struct* red_ss = red_ss_array[i];
+	toResidues(ra, a, 1);
+	NTTBatch(ra, 1);
+	mulModBatch(ra, ra, ra, NULL, 1);
+	INTTBatch(ra, 1);
 
-		uint64_t* rai = ra + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			rai[n] = _ntl_general_rem_one_struct_apply(a[n].rep, pi, red_ss);
-		}
-		NTT(rai, i);
+	reconstruct(x, ra, 1, q);
+	scratch.release(mark);
+}
 
-		for (long n = 0; n < N; ++n) {
-			mulModBarrettAndEqual(rai[n], rai[n], pi, pri);
-		}
+void RingMultiplier::squareAndEqual(ZZ* a, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
 
-		INTT(rai, i);
-	}
-	NTL_EXEC_RANGE_END;
+	toResidues(ra, a, np);
+	NTTBatch(ra, np);
+	mulModBatch(ra, ra, ra, NULL, np);
+	INTTBatch(ra, np);
 
 	reconstruct(a, ra, np, q);
-	delete[] ra;
+	scratch.release(mark);
 }
 
-void RingMultiplier::squareNTT(ZZ* x, uint64_t* ra, long np, const ZZ& q) {
-	uint64_t* rx = new uint64_t[np << logN];
+void RingMultiplier::squareNTT(ZZ* x, residue_t* ra, long np, const ZZ& q) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rx = scratch.alloc<residue_t>(np << logN);
 
-	NTL_EXEC_RANGE(np, first, last);
-	for (long i = first; i < last; ++i) {
-		uint64_t pi = pVec[i];
-		uint64_t pri = prVec[i];
-		uint64_t* rai = ra + (i << logN);
-		uint64_t* rxi = rx + (i << logN);
-		for (long n = 0; n < N; ++n) {
-			mulModBarrett(rxi[n], rai[n], rai[n], pi, pri);
-		}
-		INTT(rxi, i);
-	}
-	NTL_EXEC_RANGE_END;
+	mulModBatch(rx, ra, ra, NULL, np);
+	INTTBatch(rx, np);
 
 	reconstruct(x, rx, np, q);
-	delete[] rx;
+	scratch.release(mark);
 }
 
-void RingMultiplier::butt1(uint64_t& a1, uint64_t& a2, uint64_t p, uint64_t pInv, uint64_t W) {
+void RingMultiplier::butt1(residue_t& a1, residue_t& a2, uint64_t p, uint64_t pInv, uint64_t W) {
 	uint64_t U = a1 + a2;
 	if (U > p) U -= p;
 	uint64_t T = a1 < a2 ? a1 + p - a2 : a1 - a2;
@@ -1134,7 +1878,7 @@ void RingMultiplier::butt1(uint64_t& a1, uint64_t& a2, uint64_t p, uint64_t pInv
 	a2 = (U1 < H) ? U1 + p - H : U1 - H;
 }
 
-void RingMultiplier::butt2(uint64_t& a1, uint64_t& a2, uint64_t p, uint64_t pInv, uint64_t W) {
+void RingMultiplier::butt2(residue_t& a1, residue_t& a2, uint64_t p, uint64_t pInv, uint64_t W) {
 	uint64_t T = a2;
 	unsigned __int128 U = static_cast<unsigned __int128>(T) * W;
 	uint64_t U0 = static_cast<uint64_t>(U);
@@ -1148,7 +1892,7 @@ void RingMultiplier::butt2(uint64_t& a1, uint64_t& a2, uint64_t p, uint64_t pInv
 	if (a1 > p) a1 -= p;
 }
 
-void RingMultiplier::divByN(uint64_t& a, uint64_t p, uint64_t pInv, uint64_t NScaleInv) {
+void RingMultiplier::divByN(residue_t& a, uint64_t p, uint64_t pInv, uint64_t NScaleInv) {
 	uint64_t T = a;
 	unsigned __int128 U = static_cast<unsigned __int128>(T) * NScaleInv;
 	uint64_t U0 = static_cast<uint64_t>(U);
@@ -1159,13 +1903,55 @@ void RingMultiplier::divByN(uint64_t& a, uint64_t p, uint64_t pInv, uint64_t NSc
 	a = (U1 < H) ? U1 + p - H : U1 - H;
 }
 
+void RingMultiplier::butt1Lazy(residue_t& a1, residue_t& a2, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t W) {
+	uint64_t U = a1 + a2;
+	U = U >= p2 ? U - p2 : U;
+	uint64_t T = a1 + p2 - a2;
+	unsigned __int128 UU = static_cast<unsigned __int128>(T) * W;
+	uint64_t U0 = static_cast<uint64_t>(UU);
+	uint64_t U1 = UU >> 64;
+	uint64_t Q = U0 * pInv;
+	unsigned __int128 Hx = static_cast<unsigned __int128>(Q) * p;
+	uint64_t H = Hx >> 64;
+	a1 = U;
+	a2 = U1 + p - H;
+}
+
+void RingMultiplier::butt2Lazy(residue_t& a1, residue_t& a2, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t W) {
+	uint64_t T = a1 >= p2 ? a1 - p2 : a1;
+	unsigned __int128 U = static_cast<unsigned __int128>(a2) * W;
+	uint64_t U0 = static_cast<uint64_t>(U);
+	uint64_t U1 = U >> 64;
+	uint64_t Q = U0 * pInv;
+	unsigned __int128 Hx = static_cast<unsigned __int128>(Q) * p;
+	uint64_t H = Hx >> 64;
+	uint64_t V = U1 + p - H;
+	a1 = T + V;
+	a2 = T + p2 - V;
+}
+
+void RingMultiplier::mulModMontLazy(residue_t& a, uint64_t p, uint64_t pInv, uint64_t W) {
+	unsigned __int128 U = static_cast<unsigned __int128>(a) * W;
+	uint64_t U0 = static_cast<uint64_t>(U);
+	uint64_t U1 = U >> 64;
+	uint64_t Q = U0 * pInv;
+	unsigned __int128 Hx = static_cast<unsigned __int128>(Q) * p;
+	uint64_t H = Hx >> 64;
+	a = U1 + p - H;
+}
+
+void RingMultiplier::normalizeLazy(residue_t& a, uint64_t p, uint64_t p2) {
+	a = a >= p2 ? a - p2 : a;
+	a = a >= p ? a - p : a;
+}
+
 void RingMultiplier::mulMod(uint64_t &r, uint64_t a, uint64_t b, uint64_t m) {
 	unsigned __int128 mul = static_cast<unsigned __int128>(a) * b;
 	mul = mul % static_cast<unsigned __int128>(m);
 	r = static_cast<uint64_t>(mul);
 }
 
-void RingMultiplier::mulModBarrett(uint64_t& r, uint64_t a, uint64_t b, uint64_t p, uint64_t pr) {
+void RingMultiplier::mulModBarrett(residue_t& r, uint64_t a, uint64_t b, uint64_t p, uint64_t pr) {
 	unsigned __int128 mul = static_cast<unsigned __int128>(a) * b;
 	unsigned __int128 atop = mul >> kbar;
 	atop = atop * pr;
@@ -1173,17 +1959,17 @@ void RingMultiplier::mulModBarrett(uint64_t& r, uint64_t a, uint64_t b, uint64_t
 	atop = atop * p;
 	atop = mul - atop;
 	r = static_cast<uint64_t>(atop);
-	if (r >= p) r -= p;
+	// for a, b < p the quotient estimate is short by less than ab / 2^kbar2 + 2^kbar / p + 1 < 4 as 2^pbnd < p < 2^kbar, so r < 4p
+	while (r >= p) r -= p;
 }
 
-void RingMultiplier::mulModBarrettAndEqual(uint64_t& r, uint64_t b, uint64_t p, uint64_t pr) {
-	unsigned __int128 mul = static_cast<unsigned __int128>(r) * b;
-	unsigned __int128 atop = mul >> kbar;
-	atop = atop * pr;
-	atop = atop >> kbar;
-	atop = atop * p;
-	atop = mul - atop;
-	r = static_cast<uint64_t>(atop);
+void RingMultiplier::mulModBarrettAndEqual(residue_t& r, uint64_t b, uint64_t p, uint64_t pr) {
+	mulModBarrett(r, r, b, p, pr);
+}
+
+void RingMultiplier::mulModShoup(residue_t& r, uint64_t a, uint64_t b, uint64_t bs, uint64_t p) {
+	uint64_t q = static_cast<uint64_t>((static_cast<unsigned __int128>(a) * bs) >> residueBits);
+	r = a * b - q * p;
 	if (r >= p) r -= p;
 }
 
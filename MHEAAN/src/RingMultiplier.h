@@ -13,17 +13,31 @@
 #include <NTL/ZZ.h>
 #include <vector>
 #include "Params.h"
+#include "CoeffArray.h"
+#include "ScratchArena.h"
 #include <gmp.h>
 
 using namespace std;
 using namespace NTL;
 
+static const long SIMD_NONE = 0;
+static const long SIMD_AVX2 = 1;
+static const long SIMD_AVX512 = 2;
+
+static const long limbPieces = 64 / residueBits; ///< residue-sized pieces per CoeffArray word
+
+static const long tileX1 = N0 < 16 ? N0 : 16; ///< adjacent columns transformed together by NTTX1Tiled and INTTX1Tiled
+
 class RingMultiplier {
 public:
 
+	long simdLevel; ///< butterfly kernels used by NTTX0 and INTTX0, set to SIMD_NONE to run the scalar reference path
+
 	uint64_t gM1Pows[M1];
-	uint64_t* rootM1DFTPows[nprimes];
-	uint64_t* rootM1DFTPowsInv[nprimes];
+	residue_t* rootM1DFTPows[nprimes]; ///< in bit-reversed order, as produced by NTTPO2X1
+	residue_t* rootM1DFTPowsInv[nprimes];
+	uint64_t* scaledRootM1DFTPows[nprimes]; ///< rootM1DFTPows / N1 in Montgomery form, used by NTTX1
+	uint64_t* scaledRootM1DFTPowsInv[nprimes]; ///< rootM1DFTPowsInv / N1 in Montgomery form, used by INTTX1
 
 	uint64_t pVec[nprimes];
 	uint64_t prVec[nprimes];
@@ -39,67 +53,157 @@ public:
 	uint64_t scaledN0Inv[nprimes];
 	uint64_t scaledN1Inv[nprimes];
 
+#ifdef MHEAAN_RNS32
+	residue_t* rootM0Pows[nprimes]; ///< canonical X0 twiddles in bit-reversed order, used by the 8-lane AVX2 kernels
+	residue_t* rootM0PowsShoup[nprimes]; ///< floor(w * 2^32 / p) companions of rootM0Pows
+	residue_t* rootM0PowsInv[nprimes];
+	residue_t* rootM0PowsInvShoup[nprimes];
+	residue_t N0Inv[nprimes];
+	residue_t N0InvShoup[nprimes];
+#endif
+
 	_ntl_general_rem_one_struct* red_ss_array[nprimes];
 	mulmod_precon_t* coeffpinv_array[nprimes];
 	ZZ pProd[nprimes];
 	ZZ pProdh[nprimes];
 	ZZ* pHat[nprimes];
 	uint64_t* pHatInvModp[nprimes];
+	residue_t* limbPows[nprimes]; ///< 2^(residueBits * j) mod p for the pieces of CoeffArray words, up to j = cbnd * limbPieces
+	residue_t* limbPowsShoup[nprimes];
 
 	RingMultiplier();
 
 	bool primeTest(uint64_t p);
 
-	void arrayBitReverse(uint64_t* a, long n);
+	long detectSIMDLevel();
 
-	void NTTX0(uint64_t* a, long index);
-	void INTTX0(uint64_t* a, long index);
-	void NTTPO2X1(uint64_t* a, long index);
-	void INTTPO2X1(uint64_t* a, long index);
-	void NTTX1(uint64_t* a, long index);
-	void INTTX1(uint64_t* a, long index);
-	void NTT(uint64_t* a, long index);
-	void INTT(uint64_t* a, long index);
-
-	void toNTTX0(uint64_t* ra, ZZ* a, long np);
-	void toNTTX1(uint64_t* ra, ZZ* a, long np);
-	void toNTT(uint64_t* ra, ZZ* a, long np);
-
-	void addNTTAndEqual(uint64_t* ra, uint64_t* rb, long np);
+	void arrayBitReverse(uint64_t* a, long n);
 
-	void reconstruct(ZZ* x, uint64_t* rx, long np, const ZZ& q);
+	// radix-4 passes of the scalar transforms, recursing on the quarter span 2^logt or 2^logh
+	template<long logt> void NTTX0Radix4(residue_t* a, long m, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows);
+	template<long logt> void INTTX0Radix4(residue_t* a, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows);
+	template<long logh, long width, long stride> void DIFRadix4X1(residue_t* a, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows);
+	template<long logh, long width, long stride> void DITRadix4X1(residue_t* a, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t* pows);
+
+	void NTTX0(residue_t* a, long index);
+	void INTTX0(residue_t* a, long index);
+	void NTTX0AVX2(residue_t* a, long index);
+	void INTTX0AVX2(residue_t* a, long index);
+	void NTTX0AVX512(residue_t* a, long index);
+	void INTTX0AVX512(residue_t* a, long index);
+	void NTTPO2X1(residue_t* a, long index); ///< DIF, natural order in, bit-reversed order out
+	void INTTPO2X1(residue_t* a, long index); ///< DIT, bit-reversed order in, natural order out
+	template<long width, long stride> void convX1(residue_t* a, long index, uint64_t* scaledDFTPows);
+	void NTTX1(residue_t* a, long index);
+	void INTTX1(residue_t* a, long index);
+	void NTTX1Tiled(residue_t* a, long index);
+	void INTTX1Tiled(residue_t* a, long index);
+	void NTT(residue_t* a, long index);
+	void INTT(residue_t* a, long index);
+
+	void toResidues(residue_t* ra, ZZ* a, long np); ///< coefficient-parallel, the limbs of each a[n] are read once for all np primes
+	void toResiduesPrimes(residue_t* ra, ZZ* a, long np); ///< prime-parallel, one bignum remainder per coefficient and prime
+	void toResiduesBlock(residue_t* ra, long logstride, ZZ* a, long len, long np, uint64_t* buf); ///< residues of prime i at ra + (i << logstride), buf holds cbnd * len words
+	long signedLimbs(CoeffArray& a, long off, long len); ///< fewest low words of a[off, off + len) that still hold every coefficient in two's complement
+	void toResidues(residue_t* ra, CoeffArray& a, long np); ///< reads each coefficient as a signed integer of signedLimbs words
+	void toResidues(residue_t* ra, long* a, long np);
+	void NTTX0Batch(residue_t* ra, long np);
+	void INTTX0Batch(residue_t* ra, long np);
+	void NTTX1Batch(residue_t* ra, long np);
+	void INTTX1Batch(residue_t* ra, long np);
+	void NTTBatch(residue_t* ra, long np);
+	void INTTBatch(residue_t* ra, long np);
+	void mulModBatch(residue_t* rx, residue_t* ra, residue_t* rb, residue_t* rbs, long np); ///< Shoup when rbs != NULL, Barrett otherwise
+	void mulModX0Batch(residue_t* rx, residue_t* ra, residue_t* rb, residue_t* rbs, long np); ///< rb holds np X0 transforms of length N0
+	void mulModX1Batch(residue_t* rx, residue_t* ra, residue_t* rb, long np); ///< rb holds np X1 transforms of length N1
+
+	void toNTTX0(residue_t* ra, ZZ* a, long np);
+	void toNTTX1(residue_t* ra, ZZ* a, long np);
+	void toNTT(residue_t* ra, ZZ* a, long np);
+	void toNTT(residue_t* ra, CoeffArray& a, long np);
+
+	void fromNTT(ZZ* x, residue_t* ra, long np, const ZZ& q); ///< inverse of toNTT, reduced modulo q, ra is left unchanged
+	void fromNTT(CoeffArray& x, residue_t* ra, long np, long logq);
+
+	// base conversion with scaling: for the centered x of rx over npx primes, the residues over npy primes of
+	// y = round(x / 2^logd) - 2^logq * round(x / 2^(logd + logq)), so y = round(x / 2^logd) mod 2^logq with |y| <= 2^(logq - 1) + 1.
+	// Both roundings come from the fractions of pHat_i / 2^logd and pHat_i / 2^(logd + logq) in 128-bit fixed point,
+	// the integer parts mod 2^logq are taken mod the target primes, so the coefficients never leave the residues
+	void scaleResidues(residue_t* ry, long npy, residue_t* rx, long npx, long logd, long logq); ///< ry may alias rx
+	void prepareScale(uint64_t* frac, uint64_t* hat, long npy, long npx, long logd, long logq); ///< fractions for 2^logd and 2^(logd + logq), P last and negated; integer parts, P and 2^logq mod p_j
+	__int128 scaleRound(uint64_t* s, long np, uint64_t* frac, uint64_t v); ///< round(sum_i s_i f_i - v g) for one block of fractions from prepareScale
+	void scaleNTT(residue_t* ry, long npy, residue_t* ra, long npx, long logd, long logq); ///< scaleResidues on NTT images, ra is left unchanged and ry may alias it
+
+	// residue-wise operations on NTT images, rx may alias ra or rb
+	void addNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np);
+	void addNTTAndEqual(residue_t* ra, residue_t* rb, long np);
+	void subNTT(residue_t* rx, residue_t* ra, residue_t* rb, long np);
+	void negateNTT(residue_t* rx, residue_t* ra, long np);
+	void multByConstNTT(residue_t* rx, residue_t* ra, const ZZ& cnst, long np);
+
+	// rotation with X0 -> X0^deg0 and an X1 row shift by r1 is a slot permutation of the NTT image:
+	// the X0 slot of exponent e takes the slot of exponent deg0 * e mod M0, the X1 rows shift by r1
+	void automorphismIndexX0(long* idx, long deg0);
+	void automorphismNTT(residue_t* rx, residue_t* ra, long* idx0, long r1, long np); ///< idx0 from automorphismIndexX0, rx must not alias ra
+
+	void toShoup(residue_t* rbs, residue_t* rb, long np, long logn);
+
+	// CRT with a floating-point estimate of the overflow count: for q = 2^logq only the low logq bits
+	// of sum_i s_i * pHat_i - v * P are formed in nl words, the bignum path remains for other q
+	void reconstruct(ZZ* x, residue_t* rx, long np, const ZZ& q);
+	void reconstruct(CoeffArray& x, residue_t* rx, long np, long logq);
+	void prepareReconstruct(uint64_t* hat, double* pInvD, long np, long nl); ///< pHat_i and P mod 2^(64 nl), 1 / p_i
+	void reconstructWords(uint64_t* acc, residue_t* rx, long np, long nl, long logq, uint64_t* hat, double* pInvD);
 
 	void multX0(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q);
 	void multX0AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q);
-	void multNTTX0(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTTX0AndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multDNTTX0(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q);
+	void multNTTX0(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX0AndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX0AndEqual(ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multNTTX0AndEqual(CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq);
+	void multDNTTX0(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q);
 
 	void multX1(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q);
 	void multX1AndEqual(ZZ* a, ZZ* b, long np, const ZZ& q);
-	void multNTTX1(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTTX1AndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multDNTTX1(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q);
+	void multNTTX1(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX1AndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTTX1AndEqual(CoeffArray& a, residue_t* rb, long np, long logq);
+	void multDNTTX1(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q);
 
 	void mult(ZZ* x, ZZ* a, ZZ* b, long np, const ZZ& q);
 	void mult(ZZ* x, ZZ* a, long* b, long np, const ZZ& q);
 	void multAndEqual(ZZ* a, ZZ* b, long np, const ZZ& q);
-	void multNTT(ZZ* x, ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTT(ZZ* x, long* a, uint64_t* rb, long np, const ZZ& q);
-	void multNTTAndEqual(ZZ* a, uint64_t* rb, long np, const ZZ& q);
-	void multDNTT(ZZ* x, uint64_t* ra, uint64_t* rb, long np, const ZZ& q);
+	void multNTT(ZZ* x, ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multNTT(ZZ* x, ZZ* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multNTT(ZZ* x, long* a, residue_t* rb, long np, const ZZ& q);
+	void multNTT(ZZ* x, long* a, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multNTT(CoeffArray& x, CoeffArray& a, residue_t* rb, residue_t* rbs, long np, long logq); ///< x may alias a
+	void multNTT(CoeffArray& x, long* a, residue_t* rb, residue_t* rbs, long np, long logq);
+	void multNTTAndEqual(ZZ* a, residue_t* rb, long np, const ZZ& q);
+	void multDNTT(ZZ* x, residue_t* ra, residue_t* rb, long np, const ZZ& q);
+	void multDNTT(ZZ* x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, const ZZ& q);
+	void multDNTT(CoeffArray& x, residue_t* ra, residue_t* rb, residue_t* rbs, long np, long logq);
 
 	void square(ZZ* x, ZZ* a, long np, const ZZ& q);
 	void square(ZZ* x, long* a, const ZZ& q);
 	void squareAndEqual(ZZ* a, long np, const ZZ& q);
-	void squareNTT(ZZ* x, uint64_t* ra, long np, const ZZ& q);
+	void squareNTT(ZZ* x, residue_t* ra, long np, const ZZ& q);
+
+	void butt1(residue_t& a1, residue_t& a2, uint64_t p, uint64_t pInv, uint64_t W);
+	void butt2(residue_t& a1, residue_t& a2, uint64_t p, uint64_t pInv, uint64_t W);
+	void divByN(residue_t& a, uint64_t p, uint64_t pInv, uint64_t NScaleInv);
+
+	// Harvey-style butterflies: with p < 2^pbnd the residues may grow to 4p < 2^61,
+	// butt1Lazy keeps [0, 2p) and butt2Lazy keeps [0, 4p), normalizeLazy maps back to [0, p)
+	void butt1Lazy(residue_t& a1, residue_t& a2, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t W);
+	void butt2Lazy(residue_t& a1, residue_t& a2, uint64_t p, uint64_t p2, uint64_t pInv, uint64_t W);
+	void mulModMontLazy(residue_t& a, uint64_t p, uint64_t pInv, uint64_t W);
+	void normalizeLazy(residue_t& a, uint64_t p, uint64_t p2);
 
-	void butt1(uint64_t& a1, uint64_t& a2, uint64_t p, uint64_t pInv, uint64_t W);
-	void butt2(uint64_t& a1, uint64_t& a2, uint64_t p, uint64_t pInv, uint64_t W);
-	void divByN(uint64_t& a, uint64_t p, uint64_t pInv, uint64_t NScaleInv);
 	void mulMod(uint64_t& r, uint64_t a, uint64_t b, uint64_t p);
-	void mulModBarrett(uint64_t& r, uint64_t a, uint64_t b, uint64_t p, uint64_t pr);
-	void mulModBarrettAndEqual(uint64_t& r, uint64_t b, uint64_t p, uint64_t pr);
+	void mulModBarrett(residue_t& r, uint64_t a, uint64_t b, uint64_t p, uint64_t pr);
+	void mulModBarrettAndEqual(residue_t& r, uint64_t b, uint64_t p, uint64_t pr);
+	void mulModShoup(residue_t& r, uint64_t a, uint64_t b, uint64_t bs, uint64_t p); ///< bs = floor(b * 2^residueBits / p) from toShoup
 
 	uint64_t powMod(uint64_t x, uint64_t y, uint64_t p);
 
@@ -7,37 +7,134 @@
 */
 
 #include "Scheme.h"
+#include <algorithm>
+#include <stdexcept>
 #include "NTL/BasicThreadPool.h"
 #include "StringUtils.h"
 #include "SerializationUtils.h"
 
-Scheme::Scheme(SecretKey& secretKey, Ring& ring, bool isSerialized) : ring(ring), isSerialized(isSerialized) {
+Scheme::Scheme(SecretKey& secretKey, Ring& ring, bool isSerialized, bool isShoupKeys, bool isSeededKeys, size_t poolCapacity) : ring(ring), isSerialized(isSerialized), isShoupKeys(isShoupKeys), isSeededKeys(isSeededKeys), pool(poolCapacity > 0 ? poolCapacity : 2 * AvailableThreads()) {
 	addEncKey(secretKey);
 	addMultKey(secretKey);
 };
 
+Scheme::~Scheme() {
+	for (auto& it : bootContextMap) delete &it.second;
+}
+
 
 //----------------------------------------------------------------------------------
 //   KEYS GENERATION
 //----------------------------------------------------------------------------------
 
 
+void Scheme::addShoupKey(Key& key) {
+	if(key.rax != NULL) {
+		key.raxShoup = new residue_t[key.np << logN];
+		ring.toShoup(key.raxShoup, key.rax, key.np);
+	}
+	key.rbxShoup = new residue_t[key.np << logN];
+	ring.toShoup(key.rbxShoup, key.rbx, key.np);
+}
+
+residue_t* Scheme::expandKeyAx(Key& key, long np) {
+	ZZ* ax = new ZZ[N];
+	ring.sampleUniform(ax, logQQ, key.seed);
+	residue_t* rax = new residue_t[np << logN];
+	ring.toNTT(rax, ax, np);
+	delete[] ax;
+	return rax;
+}
+
+void Scheme::expandKey(Key& key) {
+	if(key.rax == NULL) {
+		key.rax = expandKeyAx(key, key.np);
+		if(key.rbxShoup != NULL) {
+			key.raxShoup = new residue_t[key.np << logN];
+			ring.toShoup(key.raxShoup, key.rax, key.np);
+		}
+	}
+}
+
+void Scheme::switchKey(CoeffArray& ax, CoeffArray& bx, residue_t* ra, Key& key, long np, long logq) {
+	CoeffArray x((logq + logQ + 63) >> 6);
+	residue_t* rax = key.rax != NULL ? key.rax : expandKeyAx(key, np);
+	ring.multDNTT(x, ra, rax, key.raxShoup, np, logq + logQ);
+	if(rax != key.rax) delete[] rax;
+	ring.rightShift(ax, x, logQ);
+	ring.multDNTT(x, ra, key.rbx, key.rbxShoup, np, logq + logQ);
+	ring.rightShift(bx, x, logQ);
+}
+
+void Scheme::switchKeyNTT(residue_t* rxa, residue_t* rxb, residue_t* ra, long npa, Key& key, long np, long logq) {
+	long npk = ceil((logq + logQQ + logN + 3)/(double)pbnd);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rka = scratch.alloc<residue_t>(npk << logN);
+	residue_t* rkb = scratch.alloc<residue_t>(npk << logN);
+	ring.scaleNTT(rka, npk, ra, npa, 0, logq);
+	residue_t* rax = key.rax != NULL ? key.rax : expandKeyAx(key, npk);
+	ring.multDNTT(rkb, rka, key.rbx, key.rbxShoup, npk);
+	ring.multDNTT(rka, rka, rax, key.raxShoup, npk);
+	if(rax != key.rax) delete[] rax;
+	ring.scaleNTT(rxa, np, rka, npk, logQ, logq);
+	ring.scaleNTT(rxb, np, rkb, npk, logQ, logq);
+	scratch.release(mark);
+}
+
+Key& Scheme::acquireKey(string path) {
+	if(keyCache.budget == 0) return keyStore.at(path, isSeededKeys);
+	Key* key = keyCache.acquire(path);
+	if(key == NULL) {
+		key = &SerializationUtils::readKey(path, isSeededKeys);
+		if(isShoupKeys) addShoupKey(*key);
+		key = &keyCache.insert(path, key);
+	}
+	return *key;
+}
+
+void Scheme::releaseKey(Key& key) {
+	keyCache.release(key);
+}
+
+void Scheme::pinKey(long type) {
+	keyCache.pin(serKeyMap.at(type));
+}
+
+void Scheme::pinLeftRotKey(long r0, long r1) {
+	keyCache.pin(serLeftRotKeyMap.at({r0, r1}));
+}
+
+void Scheme::truncateKeys(long logq) {
+	long np = ceil((logq + logQQ + logN + 3)/(double)pbnd);
+	keyPrimes = min(keyPrimes, np);
+	for (auto& it : keyMap) {
+		if(it.first != ENCRYPTION) it.second.truncate(keyPrimes);
+	}
+	for (auto& it : leftRotKeyMap) {
+		it.second.truncate(keyPrimes);
+	}
+}
+
 void Scheme::addEncKey(SecretKey& secretKey) {
 	ZZ ax[N], bx[N];
 
-	ring.sampleRLWE(ax, bx, secretKey.sx, logQQ);
+	Key* key = new Key(isSeededKeys);
+	if(isSeededKeys) ring.sampleSeed(key->seed);
+	ring.sampleRLWE(ax, bx, secretKey.ntt(ring), logQQ, key->seed);
 
-	Key* key = new Key();
-
-	ring.toNTT(key->rax, ax, nprimes);
+	if(!isSeededKeys) ring.toNTT(key->rax, ax, nprimes);
 	ring.toNTT(key->rbx, bx, nprimes);
 
 	if(isSerialized) {
 		string path = "serkey/ENCRYPTION.txt";
+		keyStore.drop(path);
+		keyCache.drop(path);
 		SerializationUtils::writeKey(*key, path);
 		serKeyMap.insert(pair<long, string>(ENCRYPTION, path));
 		delete key;
 	} else {
+		if(isShoupKeys) addShoupKey(*key);
 		keyMap.insert(pair<long, Key&>(ENCRYPTION, *key));
 	}
 }
@@ -45,22 +142,27 @@ void Scheme::addEncKey(SecretKey& secretKey) {
 void Scheme::addMultKey(SecretKey& secretKey) {
 	ZZ sx2[N], ax[N], bx[N];
 
-	ring.sampleRLWE(ax, bx, secretKey.sx, logQQ);
+	Key* key = new Key(isSeededKeys);
+	if(isSeededKeys) ring.sampleSeed(key->seed);
+	ring.sampleRLWE(ax, bx, secretKey.ntt(ring), logQQ, key->seed);
 
-	ring.square(sx2, secretKey.sx, 1, Q);
+	ring.squareNTT(sx2, secretKey.ntt(ring), 1, Q);
 	ring.leftShiftAndEqual(sx2, logQ, QQ);
 	ring.addAndEqual(bx, sx2, QQ);
 
-	Key* key = new Key();
-	ring.toNTT(key->rax, ax, nprimes);
+	if(!isSeededKeys) ring.toNTT(key->rax, ax, nprimes);
 	ring.toNTT(key->rbx, bx, nprimes);
 
 	if(isSerialized) {
 		string path = "serkey/MULTIPLICATION.txt";
+		keyStore.drop(path);
+		keyCache.drop(path);
 		SerializationUtils::writeKey(*key, path);
 		serKeyMap.insert(pair<long, string>(MULTIPLICATION, path));
 		delete key;
 	} else {
+		key->truncate(keyPrimes);
+		if(isShoupKeys) addShoupKey(*key);
 		keyMap.insert(pair<long, Key&>(MULTIPLICATION, *key));
 	}
 }
@@ -68,80 +170,161 @@ void Scheme::addMultKey(SecretKey& secretKey) {
 void Scheme::addConjKey(SecretKey& secretKey) {
 	ZZ sxcnj[N], ax[N], bx[N];
 
-	ring.sampleRLWE(ax, bx, secretKey.sx, logQQ);
+	Key* key = new Key(isSeededKeys);
+	if(isSeededKeys) ring.sampleSeed(key->seed);
+	ring.sampleRLWE(ax, bx, secretKey.ntt(ring), logQQ, key->seed);
 
 	ring.conjugate(sxcnj, secretKey.sx);
 	ring.leftShiftAndEqual(sxcnj, logQ, QQ);
 	ring.addAndEqual(bx, sxcnj, QQ);
 
-	Key* key = new Key();
-	ring.toNTT(key->rax, ax, nprimes);
+	if(!isSeededKeys) ring.toNTT(key->rax, ax, nprimes);
 	ring.toNTT(key->rbx, bx, nprimes);
 
 	if(isSerialized) {
 		string path = "serkey/CONJUGATION.txt";
+		keyStore.drop(path);
+		keyCache.drop(path);
 		SerializationUtils::writeKey(*key, path);
 		serKeyMap.insert(pair<long, string>(CONJUGATION, path));
 		delete key;
 	} else {
+		key->truncate(keyPrimes);
+		if(isShoupKeys) addShoupKey(*key);
 		keyMap.insert(pair<long, Key&>(CONJUGATION, *key));
 	}
 }
 
-void Scheme::addLeftRotKey(SecretKey& secretKey, long r0, long r1) {
-	ZZ sxrot[N], ax[N], bx[N];
+Key* Scheme::genLeftRotKey(SecretKey& secretKey, long r0, long r1) {
+	ZZ* sxrot = new ZZ[N];
+	ZZ* ax = new ZZ[N];
+	ZZ* bx = new ZZ[N];
 
-	ring.sampleRLWE(ax, bx, secretKey.sx, logQQ);
+	Key* key = new Key(isSeededKeys);
+	if(isSeededKeys) ring.sampleSeed(key->seed);
+	ring.sampleRLWE(ax, bx, secretKey.ntt(ring), logQQ, key->seed);
 	ring.leftRotate(sxrot, secretKey.sx, r0, r1);
 	ring.leftShiftAndEqual(sxrot, logQ, QQ);
 	ring.addAndEqual(bx, sxrot, QQ);
 
-	Key* key = new Key();
-	ring.toNTT(key->rax, ax, nprimes);
+	if(!isSeededKeys) ring.toNTT(key->rax, ax, nprimes);
 	ring.toNTT(key->rbx, bx, nprimes);
 
+	delete[] sxrot;
+	delete[] ax;
+	delete[] bx;
+	return key;
+}
+
+void Scheme::storeLeftRotKey(Key* key, long r0, long r1) {
 	if(isSerialized) {
 		string path = "serkey/ROTATION_" + to_string(r0) + "_" + to_string(r1) + ".txt";
+		keyStore.drop(path);
+		keyCache.drop(path);
 		SerializationUtils::writeKey(*key, path);
 		serLeftRotKeyMap.insert(pair<pair<long, long>, string>({r0, r1}, path));
 		delete key;
 	} else {
+		key->truncate(keyPrimes);
+		if(isShoupKeys) addShoupKey(*key);
 		leftRotKeyMap.insert(pair<pair<long, long>, Key&>({r0, r1}, *key));
 	}
+	clearRotPlan();
+}
+
+void Scheme::addLeftRotKey(SecretKey& secretKey, long r0, long r1) {
+	storeLeftRotKey(genLeftRotKey(secretKey, r0, r1), r0, r1);
+}
+
+void Scheme::addLeftRotKeys(SecretKey& secretKey, vector<pair<long, long>>& rots) {
+	vector<pair<long, long>> todo;
+	for (auto& rot : rots) {
+		if(leftRotKeyMap.find(rot) == leftRotKeyMap.end() && serLeftRotKeyMap.find(rot) == serLeftRotKeyMap.end()
+				&& find(todo.begin(), todo.end(), rot) == todo.end()) {
+			todo.push_back(rot);
+		}
+	}
+	long n = todo.size();
+	if(n == 0) return;
+
+	secretKey.ntt(ring); // built before the workers share it
+
+	unsigned char* seeds = new unsigned char[n * NTL_PRG_KEYLEN];
+	for (long i = 0; i < n; ++i) {
+		ring.sampleSeed(seeds + i * NTL_PRG_KEYLEN);
+	}
+
+	mutex m;
+	NTL_EXEC_RANGE(n, first, last);
+	for (long i = first; i < last; ++i) {
+		RandomStreamPush push;
+		SetSeed(seeds + i * NTL_PRG_KEYLEN, NTL_PRG_KEYLEN);
+		Key* key = genLeftRotKey(secretKey, todo[i].first, todo[i].second);
+		m.lock();
+		storeLeftRotKey(key, todo[i].first, todo[i].second);
+		m.unlock();
+	}
+	NTL_EXEC_RANGE_END;
+
+	delete[] seeds;
 }
 
 void Scheme::addLeftX0RotKeys(SecretKey& secretKey) {
+	vector<pair<long, long>> rots;
 	for (long i = 1; i < N0h; i <<= 1) {
-		if(leftRotKeyMap.find({i, 0}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({i, 0}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, i, 0);
-		}
+		rots.push_back({i, 0});
 	}
+	addLeftRotKeys(secretKey, rots);
 }
 
 void Scheme::addLeftX1RotKeys(SecretKey& secretKey) {
-	for (long i = 1; i < N1; i <<=1) {
-		if(leftRotKeyMap.find({0, i}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({0, i}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, 0, i);
-		}
+	vector<pair<long, long>> rots;
+	for (long i = 1; i < N1; i <<= 1) {
+		rots.push_back({0, i});
 	}
+	addLeftRotKeys(secretKey, rots);
 }
 
 void Scheme::addRightX0RotKeys(SecretKey& secretKey) {
-	for (long i = 1; i < N0h; i <<=1) {
-		long idx = N0h - i;
-		if(leftRotKeyMap.find({idx, 0}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({idx, 0}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, idx, 0);
-		}
+	vector<pair<long, long>> rots;
+	for (long i = 1; i < N0h; i <<= 1) {
+		rots.push_back({N0h - i, 0});
 	}
+	addLeftRotKeys(secretKey, rots);
 }
 
 void Scheme::addRightX1RotKeys(SecretKey& secretKey) {
-	for (long i = 1; i < N1; i<<=1) {
-		long idx = N1 - i;
-		if(leftRotKeyMap.find({0, idx}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({0, idx}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, 0, idx);
-		}
+	vector<pair<long, long>> rots;
+	for (long i = 1; i < N1; i <<= 1) {
+		rots.push_back({0, N1 - i});
+	}
+	addLeftRotKeys(secretKey, rots);
+}
+
+void Scheme::addBaseRotKeys(SecretKey& secretKey, bool isMinLatency) {
+	vector<pair<long, long>> rots;
+	for (long i = 1; i < N0h; i <<= 1) {
+		rots.push_back({i, 0});
+		if(isMinLatency) rots.push_back({N0h - i, 0});
+	}
+	for (long i = 1; i < N1; i <<= 1) {
+		rots.push_back({0, i});
+		if(isMinLatency) rots.push_back({0, N1 - i});
+	}
+	addLeftRotKeys(secretKey, rots);
+}
+
+void Scheme::eraseLeftRotKey(long r0, long r1) {
+	if(leftRotKeyMap.find({r0, r1}) != leftRotKeyMap.end()) {
+		delete &leftRotKeyMap.at({r0, r1});
+		leftRotKeyMap.erase({r0, r1});
+	}
+	if(serLeftRotKeyMap.find({r0, r1}) != serLeftRotKeyMap.end()) {
+		keyStore.drop(serLeftRotKeyMap.at({r0, r1}));
+		keyCache.drop(serLeftRotKeyMap.at({r0, r1}));
+		serLeftRotKeyMap.erase({r0, r1});
 	}
+	clearRotPlan();
 }
 
 void Scheme::addBootContext(long logn0, long logn1, long logp) {
@@ -150,10 +333,12 @@ void Scheme::addBootContext(long logn0, long logn1, long logp) {
 		long logk0 = logn0 >> 1;
 		long k0 = 1 << logk0;
 
-		uint64_t** rpVec = new uint64_t*[n0];
-		uint64_t** rpInvVec = new uint64_t*[n0];
-		uint64_t* rp1 = NULL;
-		uint64_t* rp2 = NULL;
+		residue_t** rpVec = new residue_t*[n0];
+		residue_t** rpInvVec = new residue_t*[n0];
+		residue_t** rpShoupVec = new residue_t*[n0];
+		residue_t** rpInvShoupVec = new residue_t*[n0];
+		residue_t* rp1 = NULL;
+		residue_t* rp2 = NULL;
 
 		long* bndVec = new long[n0];
 		long* bndInvVec = new long[n0];
@@ -184,8 +369,10 @@ void Scheme::addBootContext(long logn0, long logn1, long logp) {
 				}
 				bndVec[pos] = ring.MaxBits(pVec, N0);
 				np = ceil((logQ + bndVec[pos] + logN0 + 3)/(double)pbnd);
-				rpVec[pos] = new uint64_t[np << logN0];
+				rpVec[pos] = new residue_t[np << logN0];
 				ring.toNTTX0(rpVec[pos], pVec, np);
+				rpShoupVec[pos] = new residue_t[np << logN0];
+				ring.toShoup(rpShoupVec[pos], rpVec[pos], np, logN0);
 			}
 		}
 
@@ -207,14 +394,16 @@ void Scheme::addBootContext(long logn0, long logn1, long logp) {
 				}
 				bndInvVec[pos] = ring.MaxBits(pVec, N0);
 				np = ceil((logQ + bndInvVec[pos] + logN0 + 3)/(double)pbnd);
-				rpInvVec[pos] = new uint64_t[np << logN0];
+				rpInvVec[pos] = new residue_t[np << logN0];
 				ring.toNTTX0(rpInvVec[pos], pVec, np);
+				rpInvShoupVec[pos] = new residue_t[np << logN0];
+				ring.toShoup(rpInvShoupVec[pos], rpInvVec[pos], np, logN0);
 			}
 		}
 
 		delete[] pvals;
 
-		BootContext* bootContext = new BootContext(rpVec, rpInvVec, rp1, rp2, bndVec, bndInvVec, bnd1, bnd2, logp);
+		BootContext* bootContext = new BootContext(rpVec, rpInvVec, rpShoupVec, rpInvShoupVec, rp1, rp2, bndVec, bndInvVec, bnd1, bnd2, logp, n0);
 		bootContextMap.insert(pair<pair<long, long>, BootContext&>({logn0, logn1}, *bootContext));
 	}
 }
@@ -242,28 +431,231 @@ void Scheme::addSqrMatContext(long logn, long logp) {
 	}
 }
 
-void Scheme::addBootKey(SecretKey& secretKey, long logn0, long logn1, long logp) {
+void Scheme::bootRotations(vector<pair<long, long>>& rots, vector<long>& weights, long logn0, long logn1) {
+	for (long i = logn0; i < logN0h; ++i) {
+		rots.push_back({1 << i, 0});
+		weights.push_back(1);
+	}
+	for (long i = 0; i < logN1; ++i) {
+		rots.push_back({0, 1 << i});
+		weights.push_back(i < logn1 ? 1 : 2);
+	}
+
+	long k0 = 1 << (logn0 / 2);
+	for (long i = 1; i < (1 << logn0); ++i) {
+		if(i < k0 || i % k0 == 0) {
+			rots.push_back({i, 0});
+			weights.push_back(2);
+		}
+	}
+
+	long k1 = 1 << (logn1 / 2);
+	for (long i = 1; i < (1 << logn1); ++i) {
+		if(i < k1 || i % k1 == 0) {
+			rots.push_back({0, i});
+			weights.push_back(2);
+		}
+	}
+}
+
+void Scheme::sqrMatRotations(vector<pair<long, long>>& rots, vector<long>& weights, long logn) {
+	long n = (1 << logn);
+	for (long i = 1; i < n; ++i) {
+		rots.push_back({N0h - i, 0});
+		weights.push_back(1);
+	}
+	for (long j = 0; j < logn; ++j) {
+		rots.push_back({0, 1 << j});
+		weights.push_back(n);
+	}
+}
+
+void Scheme::transposeRotations(vector<pair<long, long>>& rots, vector<long>& weights, long logn) {
+	long n = (1 << logn);
+	for (long i = 1; i < n; ++i) {
+		rots.push_back({i, N1 - i});
+		weights.push_back(1);
+	}
+}
+
+long Scheme::rotKeyBytes() {
+	long arrays = isSeededKeys ? 1 : 2;
+	if(isShoupKeys && !isSerialized) arrays *= 2;
+	long np = isSerialized ? nprimes : keyPrimes;
+	return ((arrays * np) << logN) * sizeof(residue_t);
+}
+
+// dist[t] = min over j of dist[t - j * (k0, k1)] + j, one orbit of the rotation at a time, going twice around each
+// orbit so that the minimum wraps around; applied once per key it gives the fewest key switches reaching each t
+static void relaxRotations(long* dist, long k0, long k1, long inf) {
+	long size = N0h * N1;
+	bool* seen = new bool[size]();
+	for (long s = 0; s < size; ++s) {
+		if(seen[s]) continue;
+		long len = 0;
+		long t = s;
+		do {
+			seen[t] = true;
+			t = (t % N0h + k0) % N0h + ((t / N0h + k1) % N1) * N0h;
+			len++;
+		} while(t != s);
+		for (long i = 0; i < 2 * len; ++i) {
+			long u = (t % N0h + k0) % N0h + ((t / N0h + k1) % N1) * N0h;
+			if(dist[t] < inf && dist[t] + 1 < dist[u]) dist[u] = dist[t] + 1;
+			t = u;
+		}
+	}
+	delete[] seen;
+}
+
+// adds at most maxKeys of cands to keys, each time the one that lowers the weighted distance to targets the most
+static void greedyRotKeys(vector<pair<long, long>>& keys, long* dist, map<long, long>& targets, vector<long>& cands, long maxKeys, long inf) {
+	long size = N0h * N1;
+	long* trial = new long[size];
+	long cur = 0;
+	for (auto& it : targets) cur += it.second * dist[it.first];
+	while((long) keys.size() < maxKeys) {
+		long best = -1;
+		long bestCost = cur;
+		for (long c : cands) {
+			if(dist[c] <= 1) continue;
+			copy(dist, dist + size, trial);
+			relaxRotations(trial, c % N0h, c / N0h, inf);
+			long trialCost = 0;
+			for (auto& it : targets) trialCost += it.second * trial[it.first];
+			if(trialCost < bestCost) {
+				best = c;
+				bestCost = trialCost;
+			}
+		}
+		if(best == -1) break;
+		keys.push_back({best % N0h, best / N0h});
+		relaxRotations(dist, best % N0h, best / N0h, inf);
+		cur = bestCost;
+	}
+	delete[] trial;
+}
+
+void Scheme::existingRotDist(long* dist, long inf) {
+	fill_n(dist, N0h * N1, inf);
+	dist[0] = 0;
+	for (auto& it : leftRotKeyMap) relaxRotations(dist, it.first.first % N0h, it.first.second % N1, inf);
+	for (auto& it : serLeftRotKeyMap) relaxRotations(dist, it.first.first % N0h, it.first.second % N1, inf);
+}
+
+long Scheme::planRotKeys(vector<pair<long, long>>& keys, vector<pair<long, long>>& rots, vector<long>& weights, long maxKeys) {
+	long size = N0h * N1;
+	long inf = size;
+
+	map<long, long> targets;
+	for (size_t i = 0; i < rots.size(); ++i) {
+		long t = (rots[i].first % N0h + N0h) % N0h + ((rots[i].second % N1 + N1) % N1) * N0h;
+		if(t != 0) targets[t] += weights[i];
+	}
+
+	long* dist = new long[size];
+	existingRotDist(dist, inf);
+
+	vector<long> cands;
+	for (auto& it : targets) {
+		if(dist[it.first] > 1) cands.push_back(it.first);
+	}
+	keys.clear();
+	if((long) cands.size() <= maxKeys) {
+		for (long t : cands) {
+			keys.push_back({t % N0h, t / N0h});
+			relaxRotations(dist, t % N0h, t / N0h, inf);
+		}
+	} else {
+		for (long i = 1; i < N0h; i <<= 1) {
+			cands.push_back(i);
+			cands.push_back(N0h - i);
+		}
+		for (long i = 1; i < N1; i <<= 1) {
+			cands.push_back(i * N0h);
+			cands.push_back((N1 - i) * N0h);
+		}
+		sort(cands.begin(), cands.end());
+		cands.erase(unique(cands.begin(), cands.end()), cands.end());
+
+		greedyRotKeys(keys, dist, targets, cands, maxKeys, inf);
+
+		bool reached = true;
+		for (auto& it : targets) {
+			if(dist[it.first] == inf) reached = false;
+		}
+		if(!reached) {
+			// the budget ran out before every rotation was composable: start over from the power-of-two
+			// generators, which reach every rotation, and spend what is left of the budget on top of them
+			keys.clear();
+			existingRotDist(dist, inf);
+			for (long i = 1; i < N0h; i <<= 1) {
+				if(dist[i] > 1) {
+					keys.push_back({i, 0});
+					relaxRotations(dist, i, 0, inf);
+				}
+			}
+			for (long i = 1; i < N1; i <<= 1) {
+				if(dist[i * N0h] > 1) {
+					keys.push_back({0, i});
+					relaxRotations(dist, 0, i, inf);
+				}
+			}
+			if((long) keys.size() > maxKeys) {
+				delete[] dist;
+				return -1;
+			}
+			greedyRotKeys(keys, dist, targets, cands, maxKeys, inf);
+		}
+	}
+
+	long cost = 0;
+	for (auto& it : targets) cost += it.second * dist[it.first];
+	delete[] dist;
+	return cost;
+}
+
+void Scheme::addRotKeys(SecretKey& secretKey, vector<pair<long, long>>& rots, vector<long>& weights, long budget) {
+	long used = 0;
+	for (auto& it : leftRotKeyMap) used += KeyCache::keyBytes(it.second);
+	used += serLeftRotKeyMap.size() * rotKeyBytes();
+	long maxKeys = max(budget - used, 0L) / rotKeyBytes();
+
+	vector<pair<long, long>> keys;
+	if(planRotKeys(keys, rots, weights, maxKeys) == -1) {
+		throw invalid_argument("rotation key budget of " + to_string(budget) + " bytes is too small to reach every rotation");
+	}
+	addLeftRotKeys(secretKey, keys);
+}
+
+void Scheme::addBootKey(SecretKey& secretKey, long logn0, long logn1, long logp, long budget) {
 	addBootContext(logn0, logn1, logp);
 
 	addConjKey(secretKey);
-	addLeftX0RotKeys(secretKey);
-	addLeftX1RotKeys(secretKey);
+
+	vector<pair<long, long>> rots;
+	if(budget > 0) {
+		vector<long> weights;
+		bootRotations(rots, weights, logn0, logn1);
+		addRotKeys(secretKey, rots, weights, budget);
+		return;
+	}
+	for (long i = 1; i < N0h; i <<= 1) {
+		rots.push_back({i, 0});
+	}
+	for (long i = 1; i < N1; i <<= 1) {
+		rots.push_back({0, i});
+	}
 
 	long logn0h = logn0 / 2;
 	long k0 = 1 << logn0h;
 	long m0 = 1 << (logn0 - logn0h);
 
 	for (long i = 1; i < k0; ++i) {
-		if(leftRotKeyMap.find({i,0}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({i, 0}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, i, 0);
-		}
+		rots.push_back({i, 0});
 	}
-
 	for (long i = 1; i < m0; ++i) {
-		long idx = i * k0;
-		if(leftRotKeyMap.find({idx, 0}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({idx, 0}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, idx, 0);
-		}
+		rots.push_back({i * k0, 0});
 	}
 
 	long logn1h = logn1 / 2;
@@ -271,39 +663,42 @@ void Scheme::addBootKey(SecretKey& secretKey, long logn0, long logn1, long logp)
 	long m1 = 1 << (logn1 - logn1h);
 
 	for (long i = 1; i < k1; ++i) {
-		if(leftRotKeyMap.find({0,i}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({0, i}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, 0, i);
-		}
+		rots.push_back({0, i});
 	}
-
 	for (long i = 1; i < m1; ++i) {
-		long idx = i * k1;
-		if(leftRotKeyMap.find({0, idx}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({0, idx}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, 0, idx);
-		}
+		rots.push_back({0, i * k1});
 	}
+	addLeftRotKeys(secretKey, rots);
 }
 
-void Scheme::addSqrMatKeys(SecretKey& secretKey, long logn, long logp) {
+void Scheme::addSqrMatKeys(SecretKey& secretKey, long logn, long logp, long budget) {
 	addSqrMatContext(logn, logp);
+	vector<pair<long, long>> rots;
+	if(budget > 0) {
+		vector<long> weights;
+		sqrMatRotations(rots, weights, logn);
+		addRotKeys(secretKey, rots, weights, budget);
+		return;
+	}
 	long n = (1 << logn);
 	for (long i = 1; i < n; ++i) {
-		long idx = N0h - i;
-		if(leftRotKeyMap.find({idx, 0}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({idx, 0}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, idx, 0);
-		}
+		rots.push_back({N0h - i, 0});
 	}
-	addLeftX1RotKeys(secretKey);
+	for (long i = 1; i < N1; i <<= 1) {
+		rots.push_back({0, i});
+	}
+	addLeftRotKeys(secretKey, rots);
 }
 
-void Scheme::addTransposeKeys(SecretKey& secretKey, long logn, long logp) {
+void Scheme::addTransposeKeys(SecretKey& secretKey, long logn, long logp, long budget) {
 	addSqrMatContext(logn, logp);
-	long n = (1 << logn);
-	for (long i = 1; i < n; ++i) {
-		long i1 = N1 - i;
-		if(leftRotKeyMap.find({i, i1}) == leftRotKeyMap.end() && serLeftRotKeyMap.find({i, i1}) == serLeftRotKeyMap.end()) {
-			addLeftRotKey(secretKey, i, i1);
-		}
+	vector<pair<long, long>> rots;
+	vector<long> weights;
+	transposeRotations(rots, weights, logn);
+	if(budget > 0) {
+		addRotKeys(secretKey, rots, weights, budget);
+	} else {
+		addLeftRotKeys(secretKey, rots);
 	}
 }
 
@@ -313,37 +708,45 @@ void Scheme::addTransposeKeys(SecretKey& secretKey, long logn, long logp) {
 //----------------------------------------------------------------------------------
 
 void Scheme::encode(Plaintext& msg, complex<double>* vals, long n0, long n1, long logp) {
-	ring.encode(msg.mx, vals, n0, n1, logp);
+	ZZ* mx = new ZZ[N];
+	ring.encode(mx, vals, n0, n1, logp);
+	ring.toCoeffArray(msg.mx, mx, msg.mx.nlimbs << 6);
+	delete[] mx;
 	msg.n0 = n0;
 	msg.n1 = n1;
 	msg.logp = logp;
 }
 
 void Scheme::encode(Plaintext& msg, double* vals, long n0, long n1, long logp) {
-	ring.encode(msg.mx, vals, n0, n1, logp);
+	ZZ* mx = new ZZ[N];
+	ring.encode(mx, vals, n0, n1, logp);
+	ring.toCoeffArray(msg.mx, mx, msg.mx.nlimbs << 6);
+	delete[] mx;
 	msg.n0 = n0;
 	msg.n1 = n1;
 	msg.logp = logp;
 }
 
 void Scheme::rlwe(Ciphertext& res, long logq) {
-	ZZ qQ = ring.qvec[logq + logQ];
+	CoeffArray x((logq + logQ + 63) >> 6);
 	long* vx = new long[N];
 
-	Key& key = isSerialized ? SerializationUtils::readKey(serKeyMap.at(ENCRYPTION)) : keyMap.at(ENCRYPTION);
 	long np = ceil((1 + logQQ + logN + 3)/(double)pbnd);
+	Key& key = isSerialized ? acquireKey(serKeyMap.at(ENCRYPTION)) : keyMap.at(ENCRYPTION);
 	ring.sampleZO(vx);
 
-	ring.multNTT(res.ax, vx, key.rax, np, qQ);
-	ring.addGauss(res.ax, qQ);
-	ring.rightShiftAndEqual(res.ax, logQ);
+	residue_t* rax = key.rax != NULL ? key.rax : expandKeyAx(key, np);
+	ring.multNTT(x, vx, rax, key.raxShoup, np, logq + logQ);
+	ring.addGauss(x, logq + logQ);
+	ring.rightShift(res.ax, x, logQ);
 
-	ring.multNTT(res.bx, vx, key.rbx, np, qQ);
-	ring.addGauss(res.bx, qQ);
-	ring.rightShiftAndEqual(res.bx, logQ);
+	ring.multNTT(x, vx, key.rbx, key.rbxShoup, np, logq + logQ);
+	ring.addGauss(x, logq + logQ);
+	ring.rightShift(res.bx, x, logQ);
 	delete[] vx;
 
-	if(isSerialized) delete &key;
+	if(rax != key.rax) delete[] rax;
+	if(isSerialized) releaseKey(key);
 }
 
 void Scheme::encrypt(Ciphertext& res, complex<double>* vals, long n0, long n1, long logp, long logq) {
@@ -379,18 +782,21 @@ void Scheme::encryptZeros(Ciphertext& res, long n0, long n1, long logp, long log
 }
 
 void Scheme::decryptMsg(Plaintext& msg, Ciphertext& cipher, SecretKey& secretKey) {
-	ZZ q = ring.qvec[cipher.logq];
 	long np = ceil((1 + cipher.logq + logN + 3)/(double)pbnd);
-	ring.mult(msg.mx, cipher.ax, secretKey.sx, np, q);
-	ring.addAndEqual(msg.mx, cipher.bx, q);
-	ring.normalizeAndEqual(msg.mx, q);
+	ring.multNTT(msg.mx, cipher.ax, secretKey.ntt(ring), NULL, np, cipher.logq);
+	ring.addAndEqual(msg.mx, cipher.bx, cipher.logq);
+	ring.normalizeAndEqual(msg.mx, cipher.logq);
 	msg.n0 = cipher.n0;
 	msg.n1 = cipher.n1;
 	msg.logp = cipher.logp;
 }
 
 complex<double>* Scheme::decode(Plaintext& msg) {
-	return ring.decode(msg.mx, msg.n0, msg.n1, msg.logp);
+	ZZ* mx = new ZZ[N];
+	ring.fromCoeffArray(mx, msg.mx);
+	complex<double>* vals = ring.decode(mx, msg.n0, msg.n1, msg.logp);
+	delete[] mx;
+	return vals;
 }
 
 complex<double>* Scheme::decrypt(SecretKey& secretKey, Ciphertext& cipher) {
@@ -412,515 +818,725 @@ complex<double> Scheme::decryptSingle(SecretKey& secretKey, Ciphertext& cipher)
 
 void Scheme::negate(Ciphertext& res, Ciphertext& cipher) {
 	res.copyParams(cipher);
-	ring.negate(res.ax, cipher.ax);
-	ring.negate(res.bx, cipher.bx);
+	ring.negate(res.ax, cipher.ax, cipher.logq);
+	ring.negate(res.bx, cipher.bx, cipher.logq);
 }
 
 void Scheme::negateAndEqual(Ciphertext& cipher) {
-	ring.negateAndEqual(cipher.ax);
-	ring.negateAndEqual(cipher.bx);
+	ring.negateAndEqual(cipher.ax, cipher.logq);
+	ring.negateAndEqual(cipher.bx, cipher.logq);
 }
 
 void Scheme::add(Ciphertext& res, Ciphertext& cipher1, Ciphertext& cipher2) {
-	ZZ q = ring.qvec[cipher1.logq];
 	res.copyParams(cipher1);
-	ring.add(res.ax, cipher1.ax, cipher2.ax, q);
-	ring.add(res.bx, cipher1.bx, cipher2.bx, q);
+	ring.add(res.ax, cipher1.ax, cipher2.ax, cipher1.logq);
+	ring.add(res.bx, cipher1.bx, cipher2.bx, cipher1.logq);
 }
 
 void Scheme::addAndEqual(Ciphertext& cipher1, Ciphertext& cipher2) {
-	ZZ q = ring.qvec[cipher1.logq];
-	ring.addAndEqual(cipher1.ax, cipher2.ax, q);
-	ring.addAndEqual(cipher1.bx, cipher2.bx, q);
+	ring.addAndEqual(cipher1.ax, cipher2.ax, cipher1.logq);
+	ring.addAndEqual(cipher1.bx, cipher2.bx, cipher1.logq);
 }
 
 void Scheme::addConst(Ciphertext& res, Ciphertext& cipher, double cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copy(cipher);
 	ZZ cnstZZ = logp < 0 ? -EvaluatorUtils::scaleUpToZZ(cnst, cipher.logp) : -EvaluatorUtils::scaleUpToZZ(cnst, logp);
-	for (long i = 0; i < N; i+=N0) {
-		AddMod(res.bx[i], res.bx[i], cnstZZ, q);
-	}
+	ring.addConstAndEqual(res.bx, cnstZZ, cipher.logq);
 }
 
 void Scheme::addConst(Ciphertext& res, Ciphertext& cipher, RR& cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copy(cipher);
 	ZZ cnstZZ = logp < 0 ? -EvaluatorUtils::scaleUpToZZ(cnst, cipher.logp) : -EvaluatorUtils::scaleUpToZZ(cnst, logp);
-	for (long i = 0; i < N; i+=N0) {
-		AddMod(res.bx[i], res.bx[i], cnstZZ, q);
-	}
+	ring.addConstAndEqual(res.bx, cnstZZ, cipher.logq);
 }
 
 void Scheme::addConstAndEqual(Ciphertext& cipher, double cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	ZZ cnstZZ = logp < 0 ? -EvaluatorUtils::scaleUpToZZ(cnst, cipher.logp) : -EvaluatorUtils::scaleUpToZZ(cnst, logp);
-	for (long i = 0; i < N; i+=N0) {
-		AddMod(cipher.bx[i], cipher.bx[i], cnstZZ, q);
-	}
+	ring.addConstAndEqual(cipher.bx, cnstZZ, cipher.logq);
 }
 
 void Scheme::addConstAndEqual(Ciphertext& cipher, RR& cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	ZZ cnstZZ = logp < 0 ? -EvaluatorUtils::scaleUpToZZ(cnst, cipher.logp) : -EvaluatorUtils::scaleUpToZZ(cnst, logp);
-	for (long i = 0; i < N; i+=N0) {
-		AddMod(cipher.bx[i], cipher.bx[i], cnstZZ, q);
-	}
+	ring.addConstAndEqual(cipher.bx, cnstZZ, cipher.logq);
 }
 
 void Scheme::add(Ciphertext& res, Ciphertext& cipher, Plaintext& msg) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copy(cipher);
-	ring.addAndEqual(res.bx, msg.mx, q);
+	ring.addAndEqual(res.bx, msg.mx, cipher.logq);
 }
 
 void Scheme::addAndEqual(Ciphertext& cipher, Plaintext& msg) {
-	ZZ q = ring.qvec[cipher.logq];
-	ring.addAndEqual(cipher.bx, msg.mx, q);
+	ring.addAndEqual(cipher.bx, msg.mx, cipher.logq);
 }
 
 void Scheme::sub(Ciphertext& res, Ciphertext& cipher1, Ciphertext& cipher2) {
-	ZZ q = ring.qvec[cipher1.logq];
 	res.copyParams(cipher1);
-	ring.sub(res.ax, cipher1.ax, cipher2.ax, q);
-	ring.sub(res.bx, cipher1.bx, cipher2.bx, q);
+	ring.sub(res.ax, cipher1.ax, cipher2.ax, cipher1.logq);
+	ring.sub(res.bx, cipher1.bx, cipher2.bx, cipher1.logq);
 }
 
 void Scheme::subAndEqual(Ciphertext& cipher1, Ciphertext& cipher2) {
-	ZZ q = ring.qvec[cipher1.logq];
-	ring.subAndEqual(cipher1.ax, cipher2.ax, q);
-	ring.subAndEqual(cipher1.bx, cipher2.bx, q);
+	ring.subAndEqual(cipher1.ax, cipher2.ax, cipher1.logq);
+	ring.subAndEqual(cipher1.bx, cipher2.bx, cipher1.logq);
 }
 
 void Scheme::subAndEqual2(Ciphertext& cipher1, Ciphertext& cipher2) {
-	ZZ q = ring.qvec[cipher1.logq];
-	ring.subAndEqual2(cipher1.ax, cipher2.ax, q);
-	ring.subAndEqual2(cipher1.bx, cipher2.bx, q);
+	ring.subAndEqual2(cipher1.ax, cipher2.ax, cipher1.logq);
+	ring.subAndEqual2(cipher1.bx, cipher2.bx, cipher1.logq);
 }
 
 void Scheme::imult(Ciphertext& res, Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copyParams(cipher);
-	ring.multByMonomial(res.ax, cipher.ax, N0h, 0, q);
-	ring.multByMonomial(res.bx, cipher.bx, N0h, 0, q);
+	ring.multByMonomial(res.ax, cipher.ax, N0h, 0, cipher.logq);
+	ring.multByMonomial(res.bx, cipher.bx, N0h, 0, cipher.logq);
 }
 
 void Scheme::idiv(Ciphertext& res, Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copyParams(cipher);
-	ring.multByMonomial(res.ax, cipher.ax, 3 * N0h, 0, q);
-	ring.multByMonomial(res.bx, cipher.bx, 3 * N0h, 0, q);
+	ring.multByMonomial(res.ax, cipher.ax, 3 * N0h, 0, cipher.logq);
+	ring.multByMonomial(res.bx, cipher.bx, 3 * N0h, 0, cipher.logq);
 }
 
 void Scheme::imultAndEqual(Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
-	ring.multByMonomialAndEqual(cipher.ax, N0h, 0, q);
-	ring.multByMonomialAndEqual(cipher.bx, N0h, 0, q);
+	ring.multByMonomialAndEqual(cipher.ax, N0h, 0, cipher.logq);
+	ring.multByMonomialAndEqual(cipher.bx, N0h, 0, cipher.logq);
 }
 
 void Scheme::idivAndEqual(Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
-	ring.multByMonomialAndEqual(cipher.ax, 3 * N0h, 0, q);
-	ring.multByMonomialAndEqual(cipher.bx, 3 * N0h, 0, q);
+	ring.multByMonomialAndEqual(cipher.ax, 3 * N0h, 0, cipher.logq);
+	ring.multByMonomialAndEqual(cipher.bx, 3 * N0h, 0, cipher.logq);
 }
 
 void Scheme::mult(Ciphertext& res, Ciphertext& cipher1, Ciphertext& cipher2) {
-	ZZ q = ring.qvec[cipher1.logq]; // 2^1200
-	ZZ qQ = ring.qvec[cipher1.logq + logQ]; // 2^2400
-
 	long np = ceil((2 + cipher1.logq + cipher2.logq + logN + 3)/(double)pbnd);
-	uint64_t* ra1 = new uint64_t[np << logN];
-	uint64_t* rb1 = new uint64_t[np << logN];
-	uint64_t* ra2 = new uint64_t[np << logN];
-	uint64_t* rb2 = new uint64_t[np << logN];
-
-	ring.toNTT(ra1, cipher1.ax, np);
-	ring.toNTT(rb1, cipher1.bx, np);
-	ring.toNTT(ra2, cipher2.ax, np);
-	ring.toNTT(rb2, cipher2.bx, np);
-
-	ZZ aax[N], bbx[N], abx[N];
-	ring.multDNTT(aax, ra1, ra2, np, q);
-	ring.multDNTT(bbx, rb1, rb2, np, q);
-
-	ring.addNTTAndEqual(ra1, rb1, np);
-	ring.addNTTAndEqual(ra2, rb2, np);
-	ring.multDNTT(abx, ra1, ra2, np, q);
-	delete[] ra1; delete[] ra2; delete[] rb1; delete[] rb2;
-
-	np = ceil((cipher1.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* raa = new uint64_t[np << logN];
-	ring.toNTT(raa, aax, np);
-	Key& key = isSerialized ? SerializationUtils::readKey(serKeyMap.at(MULTIPLICATION)) : keyMap.at(MULTIPLICATION);
-	res.copyParams(cipher1);
-	res.logp += cipher2.logp;
-	ring.multDNTT(res.ax, raa, key.rax, np, qQ);
-	ring.multDNTT(res.bx, raa, key.rbx, np, qQ);
-	delete[] raa;
-	if(isSerialized) delete &key;
-
-	ring.rightShiftAndEqual(res.ax, logQ);
-	ring.rightShiftAndEqual(res.bx, logQ);
-
-	ring.addAndEqual(res.ax, abx, q);
-	ring.subAndEqual(res.ax, bbx, q);
-	ring.subAndEqual(res.ax, aax, q);
-	ring.addAndEqual(res.bx, bbx, q);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rax1 = scratch.alloc<residue_t>(np << logN);
+	residue_t* rbx1 = scratch.alloc<residue_t>(np << logN);
+	residue_t* rax2 = scratch.alloc<residue_t>(np << logN);
+	residue_t* rbx2 = scratch.alloc<residue_t>(np << logN);
+	ring.toNTT(rax1, cipher1.ax, np);
+	ring.toNTT(rbx1, cipher1.bx, np);
+	ring.toNTT(rax2, cipher2.ax, np);
+	ring.toNTT(rbx2, cipher2.bx, np);
+	multNTT(res.ax, res.bx, rax1, rbx1, rax2, rbx2, np, cipher1.logq);
+	res.logp = cipher1.logp + cipher2.logp;
+	res.logq = cipher1.logq;
+	res.n0 = cipher1.n0;
+	res.n1 = cipher1.n1;
+	scratch.release(mark);
 }
 
 void Scheme::multAndEqual(Ciphertext& cipher1, Ciphertext& cipher2) {
-	ZZ q = ring.qvec[cipher1.logq];
-	ZZ qQ = ring.qvec[cipher1.logq + logQ];
-
-	long np = ceil((2 + cipher1.logq + cipher2.logq + logN + 3)/(double)pbnd);
-	uint64_t* ra1 = new uint64_t[np << logN];
-	uint64_t* rb1 = new uint64_t[np << logN];
-	uint64_t* ra2 = new uint64_t[np << logN];
-	uint64_t* rb2 = new uint64_t[np << logN];
-	ZZ* aax = new ZZ[N];
-	ZZ* bbx = new ZZ[N];
-	ZZ* abx = new ZZ[N];
-
-	ring.toNTT(ra1, cipher1.ax, np);
-	ring.toNTT(rb1, cipher1.bx, np);
-	ring.toNTT(ra2, cipher2.ax, np);
-	ring.toNTT(rb2, cipher2.bx, np);
-
-	ring.multDNTT(aax, ra1, ra2, np, q);
-	ring.multDNTT(bbx, rb1, rb2, np, q);
-
-	ring.addNTTAndEqual(ra1, rb1, np);
-	ring.addNTTAndEqual(ra2, rb2, np);
-	ring.multDNTT(abx, ra1, ra2, np, q);
-	delete[] ra1; delete[] ra2; delete[] rb1; delete[] rb2;
-
-	np = ceil((cipher1.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* raa = new uint64_t[np << logN];
-	ring.toNTT(raa, aax, np);
-	Key& key = isSerialized ? SerializationUtils::readKey(serKeyMap.at(MULTIPLICATION)) : keyMap.at(MULTIPLICATION);
-	ring.multDNTT(cipher1.ax, raa, key.rax, np, qQ);
-	ring.multDNTT(cipher1.bx, raa, key.rbx, np, qQ);
-	delete[] raa;
-	if(isSerialized) delete &key;
-
-	ring.rightShiftAndEqual(cipher1.ax, logQ);
-	ring.rightShiftAndEqual(cipher1.bx, logQ);
-
-	ring.addAndEqual(cipher1.ax, abx, q);
-	ring.subAndEqual(cipher1.ax, bbx, q);
-	ring.subAndEqual(cipher1.ax, aax, q);
-	ring.addAndEqual(cipher1.bx, bbx, q);
-	delete[] aax; delete[] bbx; delete[] abx;
-	cipher1.logp += cipher2.logp;
+	mult(cipher1, cipher1, cipher2);
 }
 
 void Scheme::square(Ciphertext& res, Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ qQ = ring.qvec[cipher.logq + logQ];
-
 	long np = ceil((2 * cipher.logq + logN + 3)/(double)pbnd);
-
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN];
-	ring.toNTT(ra, cipher.ax, np);
-	ring.toNTT(rb, cipher.bx, np);
-
-	ZZ aax[N], bbx[N], abx[N];
-	ring.squareNTT(bbx, rb, np, q);
-	ring.squareNTT(aax, ra, np, q);
-	ring.multDNTT(abx, ra, rb, np, q);
-	ring.leftShiftAndEqual(abx, 1, q);
-	delete[] ra; delete[] rb;
-	res.copyParams(cipher);
-	res.logp *= 2;
-	np = ceil((cipher.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* raa = new uint64_t[np << logN];
-	ring.toNTT(raa, aax, np);
-	Key& key = isSerialized ? SerializationUtils::readKey(serKeyMap.at(MULTIPLICATION)) : keyMap.at(MULTIPLICATION);
-	ring.multDNTT(res.ax, raa, key.rax, np, qQ);
-	ring.multDNTT(res.bx, raa, key.rbx, np, qQ);
-	delete[] raa;
-	if(isSerialized) delete &key;
-
-	ring.rightShiftAndEqual(res.ax, logQ);
-	ring.rightShiftAndEqual(res.bx, logQ);
-
-	ring.addAndEqual(res.ax, abx, q);
-	ring.addAndEqual(res.bx, bbx, q);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rax = scratch.alloc<residue_t>(np << logN);
+	residue_t* rbx = scratch.alloc<residue_t>(np << logN);
+	ring.toNTT(rax, cipher.ax, np);
+	ring.toNTT(rbx, cipher.bx, np);
+	squareNTT(res.ax, res.bx, rax, rbx, np, cipher.logq);
+	res.logp = 2 * cipher.logp;
+	res.logq = cipher.logq;
+	res.n0 = cipher.n0;
+	res.n1 = cipher.n1;
+	scratch.release(mark);
 }
 
 void Scheme::squareAndEqual(Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ qQ = ring.qvec[cipher.logq + logQ];
-	long np = ceil((2 * cipher.logq + logN + 3)/(double)pbnd);
-	uint64_t* ra = new uint64_t[np << logN];
-	uint64_t* rb = new uint64_t[np << logN];
-	ring.toNTT(ra, cipher.ax, np);
-	ring.toNTT(rb, cipher.bx, np);
-
-	ZZ aax[N], bbx[N], abx[N];
-	ring.squareNTT(bbx, rb, np, q);
-	ring.multDNTT(abx, ra, rb, np, q);
-	ring.leftShiftAndEqual(abx, 1, q);
-	ring.squareNTT(aax, ra, np, q);
-	delete[] ra; delete[] rb;
-
-	np = ceil((cipher.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* raa = new uint64_t[np << logN];
-	ring.toNTT(raa, aax, np);
-	Key& key = isSerialized ? SerializationUtils::readKey(serKeyMap.at(MULTIPLICATION)) : keyMap.at(MULTIPLICATION);
-	ring.multDNTT(cipher.ax, raa, key.rax, np, qQ);
-	ring.multDNTT(cipher.bx, raa, key.rbx, np, qQ);
-	delete[] raa;
-	if(isSerialized) delete &key;
-
-	ring.rightShiftAndEqual(cipher.ax, logQ);
-	ring.rightShiftAndEqual(cipher.bx, logQ);
-	ring.addAndEqual(cipher.ax, abx, q);
-	ring.addAndEqual(cipher.bx, bbx, q);
-	cipher.logp *= 2;
+	square(cipher, cipher);
 }
 
 void Scheme::multConst(Ciphertext& res, Ciphertext& cipher, RR& cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	ZZ cnstZZ = EvaluatorUtils::scaleUpToZZ(cnst, logp);
 	res.copyParams(cipher);
-	ring.multByConst(res.ax, cipher.ax, cnstZZ, q);
-	ring.multByConst(res.bx, cipher.bx, cnstZZ, q);
+	ring.multByConst(res.ax, cipher.ax, cnstZZ, cipher.logq);
+	ring.multByConst(res.bx, cipher.bx, cnstZZ, cipher.logq);
 	res.logp += logp;
 }
 
 
 void Scheme::multConst(Ciphertext& res, Ciphertext& cipher, double cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	ZZ cnstZZ = EvaluatorUtils::scaleUpToZZ(cnst, logp);
 	res.copyParams(cipher);
-	ring.multByConst(res.ax, cipher.ax, cnstZZ, q);
-	ring.multByConst(res.bx, cipher.bx, cnstZZ, q);
+	ring.multByConst(res.ax, cipher.ax, cnstZZ, cipher.logq);
+	ring.multByConst(res.bx, cipher.bx, cnstZZ, cipher.logq);
 	res.logp += logp;
 }
 
 void Scheme::multConst(Ciphertext& res, Ciphertext& cipher, complex<double> cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ axi[N], bxi[N];
-	ring.multByMonomial(axi, cipher.ax, N0h, 0, q);
-	ring.multByMonomial(bxi, cipher.bx, N0h, 0, q);
+	CoeffArray axi(qbnd), bxi(qbnd);
+	ring.multByMonomial(axi, cipher.ax, N0h, 0, cipher.logq);
+	ring.multByMonomial(bxi, cipher.bx, N0h, 0, cipher.logq);
 	ZZ cnstrZZ = EvaluatorUtils::scaleUpToZZ(cnst.real(), logp);
 	ZZ cnstiZZ = EvaluatorUtils::scaleUpToZZ(cnst.imag(), logp);
 	res.copyParams(cipher);
-	ring.multByConst(res.ax, cipher.ax, cnstrZZ, q);
-	ring.multByConst(res.bx, cipher.bx, cnstrZZ, q);
-	ring.multByConstAndEqual(axi, cnstiZZ, q);
-	ring.multByConstAndEqual(bxi, cnstiZZ, q);
-	ring.addAndEqual(res.ax, axi, q);
-	ring.addAndEqual(res.bx, bxi, q);
+	ring.multByConst(res.ax, cipher.ax, cnstrZZ, cipher.logq);
+	ring.multByConst(res.bx, cipher.bx, cnstrZZ, cipher.logq);
+	ring.multByConstAndEqual(axi, cnstiZZ, cipher.logq);
+	ring.multByConstAndEqual(bxi, cnstiZZ, cipher.logq);
+	ring.addAndEqual(res.ax, axi, cipher.logq);
+	ring.addAndEqual(res.bx, bxi, cipher.logq);
 	res.logp += logp;
 }
 
 void Scheme::multConstAndEqual(Ciphertext& cipher, RR& cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	ZZ cnstZZ = EvaluatorUtils::scaleUpToZZ(cnst, logp);
-	ring.multByConstAndEqual(cipher.ax, cnstZZ, q);
-	ring.multByConstAndEqual(cipher.bx, cnstZZ, q);
+	ring.multByConstAndEqual(cipher.ax, cnstZZ, cipher.logq);
+	ring.multByConstAndEqual(cipher.bx, cnstZZ, cipher.logq);
 	cipher.logp += logp;
 }
 
 void Scheme::multConstAndEqual(Ciphertext& cipher, double cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	ZZ cnstZZ = EvaluatorUtils::scaleUpToZZ(cnst, logp);
-	ring.multByConstAndEqual(cipher.ax, cnstZZ, q);
-	ring.multByConstAndEqual(cipher.bx, cnstZZ, q);
+	ring.multByConstAndEqual(cipher.ax, cnstZZ, cipher.logq);
+	ring.multByConstAndEqual(cipher.bx, cnstZZ, cipher.logq);
 	cipher.logp += logp;
 }
 
 void Scheme::multConstAndEqual(Ciphertext& cipher, complex<double> cnst, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	ZZ cnstrZZ = EvaluatorUtils::scaleUpToZZ(cnst.real(), logp);
 	ZZ cnstiZZ = EvaluatorUtils::scaleUpToZZ(cnst.imag(), logp);
-	ZZ axi[N], bxi[N];
-	ring.multByMonomial(axi, cipher.ax, N0h, 0, q);
-	ring.multByMonomial(bxi, cipher.bx, N0h, 0, q);
-	ring.multByConstAndEqual(axi, cnstiZZ, q);
-	ring.multByConstAndEqual(bxi, cnstiZZ, q);
-	ring.multByConstAndEqual(cipher.ax, cnstrZZ, q);
-	ring.multByConstAndEqual(cipher.bx, cnstrZZ, q);
-	ring.addAndEqual(cipher.ax, axi, q);
-	ring.addAndEqual(cipher.bx, bxi, q);
+	CoeffArray axi(qbnd), bxi(qbnd);
+	ring.multByMonomial(axi, cipher.ax, N0h, 0, cipher.logq);
+	ring.multByMonomial(bxi, cipher.bx, N0h, 0, cipher.logq);
+	ring.multByConstAndEqual(axi, cnstiZZ, cipher.logq);
+	ring.multByConstAndEqual(bxi, cnstiZZ, cipher.logq);
+	ring.multByConstAndEqual(cipher.ax, cnstrZZ, cipher.logq);
+	ring.multByConstAndEqual(cipher.bx, cnstrZZ, cipher.logq);
+	ring.addAndEqual(cipher.ax, axi, cipher.logq);
+	ring.addAndEqual(cipher.bx, bxi, cipher.logq);
 	cipher.logp += logp;
 }
 
 void Scheme::multPolyX0(Ciphertext& res, Ciphertext& cipher, ZZ* poly, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copy(cipher);
 	long bnd = ring.MaxBits(poly, N0);
 	long np = ceil((cipher.logq + bnd + logN0 + 3)/(double)pbnd);
-	uint64_t* rpoly = new uint64_t[np << logN0];
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rpoly = scratch.alloc<residue_t>(np << logN0);
 	ring.toNTTX0(rpoly, poly, np);
-	ring.multNTTX0AndEqual(res.ax, rpoly, np, q);
-	ring.multNTTX0AndEqual(res.bx, rpoly, np, q);
-	delete[] rpoly;
+	ring.multNTTX0AndEqual(res.ax, rpoly, NULL, np, cipher.logq);
+	ring.multNTTX0AndEqual(res.bx, rpoly, NULL, np, cipher.logq);
 	res.logp += logp;
+	scratch.release(mark);
 }
 
 void Scheme::multPolyX0AndEqual(Ciphertext& cipher, ZZ* poly, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
 	long bnd = ring.MaxBits(poly, N0);
 	long np = ceil((cipher.logq + bnd + logN0 + 3)/(double)pbnd);
-	uint64_t* rpoly = new uint64_t[np << logN0];
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rpoly = scratch.alloc<residue_t>(np << logN0);
 	ring.toNTTX0(rpoly, poly, np);
-	ring.multNTTX0AndEqual(cipher.ax, rpoly, np, q);
-	ring.multNTTX0AndEqual(cipher.bx, rpoly, np, q);
-	delete[] rpoly;
+	ring.multNTTX0AndEqual(cipher.ax, rpoly, NULL, np, cipher.logq);
+	ring.multNTTX0AndEqual(cipher.bx, rpoly, NULL, np, cipher.logq);
 	cipher.logp += logp;
+	scratch.release(mark);
 }
 
-void Scheme::multPolyNTTX0(Ciphertext& res, Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
+void Scheme::multPolyNTTX0(Ciphertext& res, Ciphertext& cipher, residue_t* rpoly, long bnd, long logp) {
 	res.copy(cipher);
 	long np = ceil((cipher.logq + bnd + logN0 + 3)/(double)pbnd);
-	ring.multNTTX0AndEqual(res.ax, rpoly, np, q);
-	ring.multNTTX0AndEqual(res.bx, rpoly, np, q);
+	ring.multNTTX0AndEqual(res.ax, rpoly, NULL, np, cipher.logq);
+	ring.multNTTX0AndEqual(res.bx, rpoly, NULL, np, cipher.logq);
 	res.logp += logp;
 }
 
-void Scheme::multPolyNTTX0AndEqual(Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
+void Scheme::multPolyNTTX0AndEqual(Ciphertext& cipher, residue_t* rpoly, long bnd, long logp) {
 	long np = ceil((cipher.logq + bnd + logN0 + 3)/(double)pbnd);
-	ring.multNTTX0AndEqual(cipher.ax, rpoly, np, q);
-	ring.multNTTX0AndEqual(cipher.bx, rpoly, np, q);
+	ring.multNTTX0AndEqual(cipher.ax, rpoly, NULL, np, cipher.logq);
+	ring.multNTTX0AndEqual(cipher.bx, rpoly, NULL, np, cipher.logq);
+	cipher.logp += logp;
+}
+
+void Scheme::multPolyNTTX0AndEqual(Ciphertext& cipher, residue_t* rpoly, residue_t* rpolys, long bnd, long logp) {
+	long np = ceil((cipher.logq + bnd + logN0 + 3)/(double)pbnd);
+	ring.multNTTX0AndEqual(cipher.ax, rpoly, rpolys, np, cipher.logq);
+	ring.multNTTX0AndEqual(cipher.bx, rpoly, rpolys, np, cipher.logq);
 	cipher.logp += logp;
 }
 
 void Scheme::multPolyX1(Ciphertext& res, Ciphertext& cipher, ZZ* rpoly, ZZ* ipoly, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ axi[N], bxi[N];
-	ring.multByMonomial(axi, cipher.ax, N0h, 0, q);
-	ring.multByMonomial(bxi, cipher.bx, N0h, 0, q);
+	CoeffArray axi(qbnd), bxi(qbnd);
+	ring.multByMonomial(axi, cipher.ax, N0h, 0, cipher.logq);
+	ring.multByMonomial(bxi, cipher.bx, N0h, 0, cipher.logq);
 	long bnd = ring.MaxBits(ipoly, N1);
 	long np = ceil((cipher.logq + bnd + logN1 + 3)/(double)pbnd);
-	uint64_t* ripoly = new uint64_t[np << logN];
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ripoly = scratch.alloc<residue_t>(np << logN);
 	ring.toNTT(ripoly, ipoly, np);
-	ring.multNTTX1AndEqual(axi, ripoly, np, q);
-	ring.multNTTX1AndEqual(bxi, ripoly, np, q);
-	delete[] ripoly;
+	ring.multNTTX1AndEqual(axi, ripoly, np, cipher.logq);
+	ring.multNTTX1AndEqual(bxi, ripoly, np, cipher.logq);
 	res.copy(cipher);
 	bnd = ring.MaxBits(rpoly, N1);
 	np = ceil((cipher.logq + bnd + logN1 + 3)/(double)pbnd);
-	uint64_t* rrpoly = new uint64_t[np << logN];
+	residue_t* rrpoly = scratch.alloc<residue_t>(np << logN);
 	ring.toNTT(rrpoly, rpoly, np);
-	ring.multNTTX1AndEqual(res.ax, rrpoly, np, q);
-	ring.multNTTX1AndEqual(res.bx, rrpoly, np, q);
-	delete[] rrpoly;
-	ring.addAndEqual(res.ax, axi, q);
-	ring.addAndEqual(res.bx, bxi, q);
+	ring.multNTTX1AndEqual(res.ax, rrpoly, np, cipher.logq);
+	ring.multNTTX1AndEqual(res.bx, rrpoly, np, cipher.logq);
+	ring.addAndEqual(res.ax, axi, cipher.logq);
+	ring.addAndEqual(res.bx, bxi, cipher.logq);
 	res.logp += logp;
+	scratch.release(mark);
 }
 
 void Scheme::multPolyX1AndEqual(Ciphertext& cipher, ZZ* rpoly, ZZ* ipoly, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ axi[N], bxi[N];
-	ring.multByMonomial(axi, cipher.ax, N0h, 0, q);
-	ring.multByMonomial(bxi, cipher.bx, N0h, 0, q);
+	CoeffArray axi(qbnd), bxi(qbnd);
+	ring.multByMonomial(axi, cipher.ax, N0h, 0, cipher.logq);
+	ring.multByMonomial(bxi, cipher.bx, N0h, 0, cipher.logq);
 	long bnd = ring.MaxBits(rpoly, N1);
 	long np = ceil((cipher.logq + bnd + logN1 + 3)/(double)pbnd);
-	uint64_t* rrpoly = new uint64_t[np << logN];
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rrpoly = scratch.alloc<residue_t>(np << logN);
 	ring.toNTT(rrpoly, rpoly, np);
-	ring.multNTTX1AndEqual(cipher.ax, rrpoly, np, q);
-	ring.multNTTX1AndEqual(cipher.bx, rrpoly, np, q);
-	delete[] rrpoly;
+	ring.multNTTX1AndEqual(cipher.ax, rrpoly, np, cipher.logq);
+	ring.multNTTX1AndEqual(cipher.bx, rrpoly, np, cipher.logq);
 	bnd = ring.MaxBits(ipoly, N1);
 	np = ceil((cipher.logq + bnd + logN1 + 3)/(double)pbnd);
-	uint64_t* ripoly = new uint64_t[np << logN];
+	residue_t* ripoly = scratch.alloc<residue_t>(np << logN);
 	ring.toNTT(ripoly, ipoly, np);
-	ring.multNTTX1AndEqual(axi, ripoly, np, q);
-	ring.multNTTX1AndEqual(bxi, ripoly, np, q);
-	delete[] ripoly;
-	ring.addAndEqual(cipher.ax, axi, q);
-	ring.addAndEqual(cipher.bx, bxi, q);
+	ring.multNTTX1AndEqual(axi, ripoly, np, cipher.logq);
+	ring.multNTTX1AndEqual(bxi, ripoly, np, cipher.logq);
+	ring.addAndEqual(cipher.ax, axi, cipher.logq);
+	ring.addAndEqual(cipher.bx, bxi, cipher.logq);
 	cipher.logp += logp;
+	scratch.release(mark);
 }
 
 void Scheme::mult(Ciphertext& res, Ciphertext& cipher, Plaintext& msg) {
-	ZZ q = ring.qvec[cipher.logq];
-
-	long bnd = ring.MaxBits(msg.mx, N);
+	long bnd = ring.MaxBits(msg.mx);
 	long np = ceil((cipher.logq + bnd + logN + 3)/(double)pbnd);
-	uint64_t* rpoly = new uint64_t[np << logN];
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rpoly = scratch.alloc<residue_t>(np << logN);
 	ring.toNTT(rpoly, msg.mx, np);
 	res.copy(cipher);
-	ring.multNTTAndEqual(res.ax, rpoly, np, q);
-	ring.multNTTAndEqual(res.bx, rpoly, np, q);
-	delete[] rpoly;
+	ring.multNTTAndEqual(res.ax, rpoly, np, cipher.logq);
+	ring.multNTTAndEqual(res.bx, rpoly, np, cipher.logq);
 	res.logp += msg.logp;
+	scratch.release(mark);
 }
 
 void Scheme::multAndEqual(Ciphertext& cipher, Plaintext& msg) {
-	ZZ q = ring.qvec[cipher.logq];
-	long bnd = ring.MaxBits(msg.mx, N);
+	long bnd = ring.MaxBits(msg.mx);
 	long np = ceil((cipher.logq + bnd + logN + 3)/(double)pbnd);
-	uint64_t* rpoly = new uint64_t[np << logN];
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rpoly = scratch.alloc<residue_t>(np << logN);
 	ring.toNTT(rpoly, msg.mx, np);
-	ring.multNTTAndEqual(cipher.ax, rpoly, np, q);
-	ring.multNTTAndEqual(cipher.bx, rpoly, np, q);
-	delete[] rpoly;
+	ring.multNTTAndEqual(cipher.ax, rpoly, np, cipher.logq);
+	ring.multNTTAndEqual(cipher.bx, rpoly, np, cipher.logq);
 	cipher.logp += msg.logp;
+	scratch.release(mark);
 }
 
 
-void Scheme::multPolyNTT(Ciphertext& res, Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
+void Scheme::multPolyNTT(Ciphertext& res, Ciphertext& cipher, residue_t* rpoly, long bnd, long logp) {
 	res.copy(cipher);
 	long np = ceil((cipher.logq + bnd + logN + 3)/(double)pbnd);
-	ring.multNTTAndEqual(res.ax, rpoly, np, q);
-	ring.multNTTAndEqual(res.bx, rpoly, np, q);
+	ring.multNTTAndEqual(res.ax, rpoly, np, cipher.logq);
+	ring.multNTTAndEqual(res.bx, rpoly, np, cipher.logq);
 	res.logp += logp;
 }
 
-void Scheme::multPolyNTTAndEqual(Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp) {
-	ZZ q = ring.qvec[cipher.logq];
+void Scheme::multPolyNTTAndEqual(Ciphertext& cipher, residue_t* rpoly, long bnd, long logp) {
 	long np = ceil((cipher.logq + bnd + logN + 3)/(double)pbnd);
-	ring.multNTTAndEqual(cipher.ax, rpoly, np, q);
-	ring.multNTTAndEqual(cipher.bx, rpoly, np, q);
+	ring.multNTTAndEqual(cipher.ax, rpoly, np, cipher.logq);
+	ring.multNTTAndEqual(cipher.bx, rpoly, np, cipher.logq);
 	cipher.logp += logp;
 }
 
 void Scheme::multByMonomial(Ciphertext& res, Ciphertext& cipher, const long d0, const long d1) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copyParams(cipher);
-	ring.multByMonomial(res.ax, cipher.ax, d0, d1, q);
-	ring.multByMonomial(res.bx, cipher.bx, d0, d1, q);
+	ring.multByMonomial(res.ax, cipher.ax, d0, d1, cipher.logq);
+	ring.multByMonomial(res.bx, cipher.bx, d0, d1, cipher.logq);
 }
 
 void Scheme::multByMonomialAndEqual(Ciphertext& cipher, const long d0, const long d1) {
-	ZZ q = ring.qvec[cipher.logq];
-	ring.multByMonomialAndEqual(cipher.ax, d0, d1, q);
-	ring.multByMonomialAndEqual(cipher.bx, d0, d1, q);
+	ring.multByMonomialAndEqual(cipher.ax, d0, d1, cipher.logq);
+	ring.multByMonomialAndEqual(cipher.bx, d0, d1, cipher.logq);
 }
 
 void Scheme::multPo2(Ciphertext& res, Ciphertext& cipher, long bits) {
-	ZZ q = ring.qvec[cipher.logq];
 	res.copyParams(cipher);
-	ring.leftShift(res.ax, cipher.ax, bits, q);
-	ring.leftShift(res.bx, cipher.bx, bits, q);
+	ring.leftShift(res.ax, cipher.ax, bits, cipher.logq);
+	ring.leftShift(res.bx, cipher.bx, bits, cipher.logq);
 }
 
 void Scheme::multPo2AndEqual(Ciphertext& cipher, long bits) {
-	ZZ q = ring.qvec[cipher.logq];
-	ring.leftShiftAndEqual(cipher.ax, bits, q);
-	ring.leftShiftAndEqual(cipher.bx, bits, q);
+	ring.leftShiftAndEqual(cipher.ax, bits, cipher.logq);
+	ring.leftShiftAndEqual(cipher.bx, bits, cipher.logq);
 }
 
 void Scheme::divPo2(Ciphertext& res, Ciphertext& cipher, long logd) {
 	res.copyParams(cipher);
+	res.logq -= logd;
 	ring.rightShift(res.ax, cipher.ax, logd);
 	ring.rightShift(res.bx, cipher.bx, logd);
-	res.logq -= logd;
+	ring.modAndEqual(res.ax, res.logq);
+	ring.modAndEqual(res.bx, res.logq);
 }
 
 void Scheme::divPo2AndEqual(Ciphertext& cipher, long logd) {
+	cipher.logq -= logd;
 	ring.rightShiftAndEqual(cipher.ax, logd);
 	ring.rightShiftAndEqual(cipher.bx, logd);
-	cipher.logq -= logd;
+	ring.modAndEqual(cipher.ax, cipher.logq);
+	ring.modAndEqual(cipher.bx, cipher.logq);
+}
+
+
+//----------------------------------------------------------------------------------
+//   DOUBLE-CRT (NTT FORM) OPERATIONS
+//----------------------------------------------------------------------------------
+
+
+void Scheme::toNTT(CiphertextNTT& res, Ciphertext& cipher, long np) {
+	if (np == 0) np = ceil((2 + 2 * cipher.logq + logN + 3)/(double)pbnd);
+	res.resize(np);
+	ring.toNTT(res.rax, cipher.ax, np);
+	ring.toNTT(res.rbx, cipher.bx, np);
+	res.logb = cipher.logq;
+	res.logp = cipher.logp;
+	res.logq = cipher.logq;
+	res.n0 = cipher.n0;
+	res.n1 = cipher.n1;
+}
+
+void Scheme::fromNTT(Ciphertext& res, const CiphertextNTT& cipher) {
+	long np = min(cipher.np, (long)ceil((cipher.logb + 3)/(double)pbnd));
+	ring.fromNTT(res.ax, cipher.rax, np, cipher.logq);
+	ring.fromNTT(res.bx, cipher.rbx, np, cipher.logq);
+	res.logp = cipher.logp;
+	res.logq = cipher.logq;
+	res.n0 = cipher.n0;
+	res.n1 = cipher.n1;
+}
+
+void Scheme::reduceNTT(residue_t*& rax, residue_t*& rbx, const CiphertextNTT& cipher, long np) {
+	long npb = min(cipher.np, (long)ceil((cipher.logb + 3)/(double)pbnd));
+	ScratchArena& scratch = ScratchArena::local();
+	rax = scratch.alloc<residue_t>(np << logN);
+	rbx = scratch.alloc<residue_t>(np << logN);
+	ring.scaleNTT(rax, np, cipher.rax, npb, 0, cipher.logq);
+	ring.scaleNTT(rbx, np, cipher.rbx, npb, 0, cipher.logq);
+}
+
+void Scheme::reduceNTTAndEqual(CiphertextNTT& cipher, long np) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t *rax, *rbx;
+	reduceNTT(rax, rbx, cipher, np);
+	cipher.resize(np);
+	for (long i = 0; i < (np << logN); ++i) {
+		cipher.rax[i] = rax[i];
+		cipher.rbx[i] = rbx[i];
+	}
+	cipher.logb = cipher.logq;
+	scratch.release(mark);
+}
+
+void Scheme::negate(CiphertextNTT& res, const CiphertextNTT& cipher) {
+	res.copyParams(cipher);
+	res.resize(cipher.np);
+	ring.negateNTT(res.rax, cipher.rax, cipher.np);
+	ring.negateNTT(res.rbx, cipher.rbx, cipher.np);
+}
+
+void Scheme::negateAndEqual(CiphertextNTT& cipher) {
+	ring.negateNTT(cipher.rax, cipher.rax, cipher.np);
+	ring.negateNTT(cipher.rbx, cipher.rbx, cipher.np);
+}
+
+void Scheme::add(CiphertextNTT& res, const CiphertextNTT& cipher1, const CiphertextNTT& cipher2) {
+	long np = min(cipher1.np, cipher2.np);
+	long logb = max(cipher1.logb, cipher2.logb) + 1;
+	residue_t *rax1 = cipher1.rax, *rbx1 = cipher1.rbx, *rax2 = cipher2.rax, *rbx2 = cipher2.rbx;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	if (np * pbnd < logb + 2) {
+		np = max(np, (long)ceil((cipher1.logq + 4)/(double)pbnd));
+		reduceNTT(rax1, rbx1, cipher1, np);
+		reduceNTT(rax2, rbx2, cipher2, np);
+		logb = cipher1.logq + 1;
+	}
+	res.copyParams(cipher1);
+	res.resize(np);
+	ring.addNTT(res.rax, rax1, rax2, np);
+	ring.addNTT(res.rbx, rbx1, rbx2, np);
+	res.logb = logb;
+	scratch.release(mark);
+}
+
+void Scheme::addAndEqual(CiphertextNTT& cipher1, const CiphertextNTT& cipher2) {
+	add(cipher1, cipher1, cipher2);
+}
+
+void Scheme::sub(CiphertextNTT& res, const CiphertextNTT& cipher1, const CiphertextNTT& cipher2) {
+	long np = min(cipher1.np, cipher2.np);
+	long logb = max(cipher1.logb, cipher2.logb) + 1;
+	residue_t *rax1 = cipher1.rax, *rbx1 = cipher1.rbx, *rax2 = cipher2.rax, *rbx2 = cipher2.rbx;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	if (np * pbnd < logb + 2) {
+		np = max(np, (long)ceil((cipher1.logq + 4)/(double)pbnd));
+		reduceNTT(rax1, rbx1, cipher1, np);
+		reduceNTT(rax2, rbx2, cipher2, np);
+		logb = cipher1.logq + 1;
+	}
+	res.copyParams(cipher1);
+	res.resize(np);
+	ring.subNTT(res.rax, rax1, rax2, np);
+	ring.subNTT(res.rbx, rbx1, rbx2, np);
+	res.logb = logb;
+	scratch.release(mark);
+}
+
+void Scheme::subAndEqual(CiphertextNTT& cipher1, const CiphertextNTT& cipher2) {
+	sub(cipher1, cipher1, cipher2);
+}
+
+void Scheme::multConst(CiphertextNTT& res, const CiphertextNTT& cipher, double cnst, long logp) {
+	ZZ cnstZZ = EvaluatorUtils::scaleUpToZZ(cnst, logp);
+	long bits = NumBits(cnstZZ);
+	long np = cipher.np;
+	long logb = cipher.logb;
+	residue_t *rax = cipher.rax, *rbx = cipher.rbx;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	if (np * pbnd < logb + bits + 3) {
+		np = max(np, (long)ceil((cipher.logq + bits + 3)/(double)pbnd));
+		reduceNTT(rax, rbx, cipher, np);
+		logb = cipher.logq;
+	}
+	res.copyParams(cipher);
+	res.resize(np);
+	ring.multByConstNTT(res.rax, rax, cnstZZ, np);
+	ring.multByConstNTT(res.rbx, rbx, cnstZZ, np);
+	res.logb = logb + bits;
+	res.logp += logp;
+	scratch.release(mark);
+}
+
+void Scheme::multConstAndEqual(CiphertextNTT& cipher, double cnst, long logp) {
+	multConst(cipher, cipher, cnst, logp);
+}
+
+void Scheme::multPolyNTT(CiphertextNTT& res, const CiphertextNTT& cipher, residue_t* rpoly, long bnd, long logp) {
+	long np = ceil((cipher.logb + bnd + logN + 3)/(double)pbnd);
+	long logb = cipher.logb;
+	residue_t *rax = cipher.rax, *rbx = cipher.rbx;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	if (cipher.np < np) {
+		np = ceil((cipher.logq + bnd + logN + 3)/(double)pbnd);
+		reduceNTT(rax, rbx, cipher, np);
+		logb = cipher.logq;
+	}
+	res.copyParams(cipher);
+	res.resize(np);
+	ring.multDNTT(res.rax, rax, rpoly, NULL, np);
+	ring.multDNTT(res.rbx, rbx, rpoly, NULL, np);
+	res.logb = logb + bnd + logN;
+	res.logp += logp;
+	scratch.release(mark);
+}
+
+void Scheme::multPolyNTTAndEqual(CiphertextNTT& cipher, residue_t* rpoly, long bnd, long logp) {
+	multPolyNTT(cipher, cipher, rpoly, bnd, logp);
+}
+
+void Scheme::mult(Ciphertext& res, const CiphertextNTT& cipher1, const CiphertextNTT& cipher2) {
+	long np = ceil((2 + cipher1.logb + cipher2.logb + logN + 3)/(double)pbnd);
+	residue_t *rax1 = cipher1.rax, *rbx1 = cipher1.rbx, *rax2 = cipher2.rax, *rbx2 = cipher2.rbx;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	if (cipher1.np < np || cipher2.np < np) {
+		np = ceil((2 + cipher1.logq + cipher2.logq + logN + 3)/(double)pbnd);
+		reduceNTT(rax1, rbx1, cipher1, np);
+		if (&cipher2 != &cipher1) {
+			reduceNTT(rax2, rbx2, cipher2, np);
+		} else {
+			rax2 = rax1;
+			rbx2 = rbx1;
+		}
+	}
+	multNTT(res.ax, res.bx, rax1, rbx1, rax2, rbx2, np, cipher1.logq);
+	res.logp = cipher1.logp + cipher2.logp;
+	res.logq = cipher1.logq;
+	res.n0 = cipher1.n0;
+	res.n1 = cipher1.n1;
+	scratch.release(mark);
+}
+
+void Scheme::square(Ciphertext& res, const CiphertextNTT& cipher) {
+	long np = ceil((2 * cipher.logb + logN + 3)/(double)pbnd);
+	residue_t *rax = cipher.rax, *rbx = cipher.rbx;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	if (cipher.np < np) {
+		np = ceil((2 * cipher.logq + logN + 3)/(double)pbnd);
+		reduceNTT(rax, rbx, cipher, np);
+	}
+	squareNTT(res.ax, res.bx, rax, rbx, np, cipher.logq);
+	res.logp = 2 * cipher.logp;
+	res.logq = cipher.logq;
+	res.n0 = cipher.n0;
+	res.n1 = cipher.n1;
+	scratch.release(mark);
+}
+
+void Scheme::multNTT(CoeffArray& ax, CoeffArray& bx, residue_t* rax1, residue_t* rbx1, residue_t* rax2, residue_t* rbx2, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* raa = scratch.alloc<residue_t>(np << logN);
+	residue_t* rbb = scratch.alloc<residue_t>(np << logN);
+	residue_t* rab = scratch.alloc<residue_t>(np << logN);
+	residue_t* ra2 = scratch.alloc<residue_t>(np << logN);
+	ring.multDNTT(raa, rax1, rax2, NULL, np);
+	ring.multDNTT(rbb, rbx1, rbx2, NULL, np);
+	ring.addNTT(rab, rax1, rbx1, np);
+	ring.addNTT(ra2, rax2, rbx2, np);
+	ring.multDNTT(rab, rab, ra2, NULL, np);
+	ring.subNTT(rab, rab, raa, np);
+	ring.subNTT(rab, rab, rbb, np);
+
+	residue_t* rsa = scratch.alloc<residue_t>(np << logN);
+	residue_t* rsb = scratch.alloc<residue_t>(np << logN);
+	Key& key = isSerialized ? acquireKey(serKeyMap.at(MULTIPLICATION)) : keyMap.at(MULTIPLICATION);
+	switchKeyNTT(rsa, rsb, raa, np, key, np, logq);
+	if(isSerialized) releaseKey(key);
+
+	ring.addNTTAndEqual(rsa, rab, np);
+	ring.addNTTAndEqual(rsb, rbb, np);
+	ring.fromNTT(ax, rsa, np, logq);
+	ring.fromNTT(bx, rsb, np, logq);
+	scratch.release(mark);
+}
+
+void Scheme::squareNTT(CoeffArray& ax, CoeffArray& bx, residue_t* rax, residue_t* rbx, long np, long logq) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* raa = scratch.alloc<residue_t>(np << logN);
+	residue_t* rbb = scratch.alloc<residue_t>(np << logN);
+	residue_t* rab = scratch.alloc<residue_t>(np << logN);
+	ring.multDNTT(raa, rax, rax, NULL, np);
+	ring.multDNTT(rbb, rbx, rbx, NULL, np);
+	ring.multDNTT(rab, rax, rbx, NULL, np);
+	ring.addNTTAndEqual(rab, rab, np);
+
+	residue_t* rsa = scratch.alloc<residue_t>(np << logN);
+	residue_t* rsb = scratch.alloc<residue_t>(np << logN);
+	Key& key = isSerialized ? acquireKey(serKeyMap.at(MULTIPLICATION)) : keyMap.at(MULTIPLICATION);
+	switchKeyNTT(rsa, rsb, raa, np, key, np, logq);
+	if(isSerialized) releaseKey(key);
+
+	ring.addNTTAndEqual(rsa, rab, np);
+	ring.addNTTAndEqual(rsb, rbb, np);
+	ring.fromNTT(ax, rsa, np, logq);
+	ring.fromNTT(bx, rsb, np, logq);
+	scratch.release(mark);
+}
+
+void Scheme::switchKeyNTT(CiphertextNTT& res, residue_t* rax, residue_t* rbx, const CiphertextNTT& cipher, Key& key) {
+	long np = cipher.np;
+	long npb = min(np, (long)ceil((cipher.logb + 3)/(double)pbnd));
+	long logq = cipher.logq;
+	long logb = max(cipher.logb, logq) + 1;
+	res.copyParams(cipher);
+	res.resize(np);
+	switchKeyNTT(res.rax, res.rbx, rax, npb, key, np, logq);
+	if (np * pbnd < logb + 2) {
+		// the sum would outgrow the primes of cipher, so rbx is re-imaged from its value mod q first
+		ScratchArena& scratch = ScratchArena::local();
+		ScratchMark mark = scratch.mark();
+		residue_t* rb = scratch.alloc<residue_t>(np << logN);
+		ring.scaleNTT(rb, np, rbx, npb, 0, logq);
+		ring.addNTTAndEqual(res.rbx, rb, np);
+		logb = logq + 1;
+		scratch.release(mark);
+	} else {
+		ring.addNTTAndEqual(res.rbx, rbx, np);
+	}
+	res.logb = logb;
+}
+
+void Scheme::leftRotate(CiphertextNTT& res, const CiphertextNTT& cipher, long r0, long r1) {
+	if(!hasLeftRotKey(r0, r1)) {
+		vector<pair<long, long>> steps;
+		if(planLeftRotate(steps, r0, r1)) {
+			res.copy(cipher);
+			for (auto& step : steps) {
+				leftRotateAndEqual(res, step.first, step.second);
+			}
+			return;
+		}
+	}
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* rarot = scratch.alloc<residue_t>(cipher.np << logN);
+	residue_t* rbrot = scratch.alloc<residue_t>(cipher.np << logN);
+	ring.leftRotateNTT(rarot, cipher.rax, r0, r1, cipher.np);
+	ring.leftRotateNTT(rbrot, cipher.rbx, r0, r1, cipher.np);
+	Key& key = isSerialized ? acquireKey(serLeftRotKeyMap.at({r0, r1})) : leftRotKeyMap.at({r0, r1});
+	switchKeyNTT(res, rarot, rbrot, cipher, key);
+	if(isSerialized) releaseKey(key);
+	scratch.release(mark);
+}
+
+void Scheme::leftRotateAndEqual(CiphertextNTT& cipher, long r0, long r1) {
+	leftRotate(cipher, cipher, r0, r1);
+}
+
+void Scheme::conjugate(CiphertextNTT& res, const CiphertextNTT& cipher) {
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* racnj = scratch.alloc<residue_t>(cipher.np << logN);
+	residue_t* rbcnj = scratch.alloc<residue_t>(cipher.np << logN);
+	ring.conjugateNTT(racnj, cipher.rax, cipher.np);
+	ring.conjugateNTT(rbcnj, cipher.rbx, cipher.np);
+	Key& key = isSerialized ? acquireKey(serKeyMap.at(CONJUGATION)) : keyMap.at(CONJUGATION);
+	switchKeyNTT(res, racnj, rbcnj, cipher, key);
+	if(isSerialized) releaseKey(key);
+	scratch.release(mark);
+}
+
+void Scheme::conjugateAndEqual(CiphertextNTT& cipher) {
+	conjugate(cipher, cipher);
+}
+
+void Scheme::reScaleBy(CiphertextNTT& res, const CiphertextNTT& cipher, long dlogq) {
+	long np = cipher.np;
+	long npb = min(np, (long)ceil((cipher.logb + 3)/(double)pbnd));
+	long logq = cipher.logq - dlogq;
+	res.copyParams(cipher);
+	res.resize(np);
+	ring.scaleNTT(res.rax, np, cipher.rax, npb, dlogq, logq);
+	ring.scaleNTT(res.rbx, np, cipher.rbx, npb, dlogq, logq);
+	res.logq = logq;
+	res.logp -= dlogq;
+	res.logb = logq;
+}
+
+void Scheme::reScaleByAndEqual(CiphertextNTT& cipher, long dlogq) {
+	reScaleBy(cipher, cipher, dlogq);
+}
+
+void Scheme::modDownTo(CiphertextNTT& res, const CiphertextNTT& cipher, long logq) {
+	res.copy(cipher);
+	res.logq = logq;
+}
+
+void Scheme::modDownToAndEqual(CiphertextNTT& cipher, long logq) {
+	cipher.logq = logq;
 }
 
 
@@ -931,10 +1547,12 @@ void Scheme::divPo2AndEqual(Ciphertext& cipher, long logd) {
 
 void Scheme::reScaleBy(Ciphertext& res, Ciphertext& cipher, long dlogq) {
 	res.copyParams(cipher);
-	ring.rightShift(res.ax, cipher.ax, dlogq);
-	ring.rightShift(res.bx, cipher.bx, dlogq);
 	res.logq -= dlogq;
 	res.logp -= dlogq;
+	ring.rightShift(res.ax, cipher.ax, dlogq);
+	ring.rightShift(res.bx, cipher.bx, dlogq);
+	ring.modAndEqual(res.ax, res.logq);
+	ring.modAndEqual(res.bx, res.logq);
 }
 
 void Scheme::reScaleTo(Ciphertext& res, Ciphertext& cipher, long logq) {
@@ -943,10 +1561,12 @@ void Scheme::reScaleTo(Ciphertext& res, Ciphertext& cipher, long logq) {
 }
 
 void Scheme::reScaleByAndEqual(Ciphertext& cipher, long dlogq) {
-	ring.rightShiftAndEqual(cipher.ax, dlogq);
-	ring.rightShiftAndEqual(cipher.bx, dlogq);
 	cipher.logq -= dlogq;
 	cipher.logp -= dlogq;
+	ring.rightShiftAndEqual(cipher.ax, dlogq);
+	ring.rightShiftAndEqual(cipher.bx, dlogq);
+	ring.modAndEqual(cipher.ax, cipher.logq);
+	ring.modAndEqual(cipher.bx, cipher.logq);
 }
 
 void Scheme::reScaleToAndEqual(Ciphertext& cipher, long logq) {
@@ -965,17 +1585,15 @@ void Scheme::modDownByAndEqual(Ciphertext& cipher, long dlogq) {
 }
 
 void Scheme::modDownTo(Ciphertext& res, Ciphertext& cipher, long logq) {
-	ZZ q = ring.qvec[logq];
 	res.copyParams(cipher);
-	ring.mod(res.ax, cipher.ax, q);
-	ring.mod(res.bx, cipher.bx, q);
+	ring.mod(res.ax, cipher.ax, logq);
+	ring.mod(res.bx, cipher.bx, logq);
 	res.logq = logq;
 }
 
 void Scheme::modDownToAndEqual(Ciphertext& cipher, long logq) {
-	ZZ q = ring.qvec[logq];
-	ring.modAndEqual(cipher.ax, q);
-	ring.modAndEqual(cipher.bx, q);
+	ring.modAndEqual(cipher.ax, logq);
+	ring.modAndEqual(cipher.bx, logq);
 	cipher.logq = logq;
 }
 
@@ -985,28 +1603,114 @@ void Scheme::modDownToAndEqual(Ciphertext& cipher, long logq) {
 //----------------------------------------------------------------------------------
 
 
-void Scheme::leftRotate(Ciphertext& res, Ciphertext& cipher, long r0, long r1) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ qQ = ring.qvec[cipher.logq + logQ];
+bool Scheme::hasLeftRotKey(long r0, long r1) {
+	return leftRotKeyMap.find({r0, r1}) != leftRotKeyMap.end() || serLeftRotKeyMap.find({r0, r1}) != serLeftRotKeyMap.end();
+}
+
+bool Scheme::planLeftRotate(vector<pair<long, long>>& steps, long r0, long r1) {
+	rotPlanMutex.lock();
+	if(rotPlanPrev == NULL) {
+		rotPlanKeys.clear();
+		for (auto& it : leftRotKeyMap) rotPlanKeys.push_back(it.first);
+		for (auto& it : serLeftRotKeyMap) rotPlanKeys.push_back(it.first);
+
+		rotPlanPrev = new long[N0h * N1];
+		fill_n(rotPlanPrev, N0h * N1, -1);
+		rotPlanPrev[0] = 0;
+		vector<long> queue = {0};
+		for (size_t head = 0; head < queue.size(); ++head) {
+			long t0 = queue[head] % N0h;
+			long t1 = queue[head] / N0h;
+			for (size_t k = 0; k < rotPlanKeys.size(); ++k) {
+				long s0 = (t0 + rotPlanKeys[k].first) % N0h;
+				long s1 = (t1 + rotPlanKeys[k].second) % N1;
+				if(rotPlanPrev[s0 + s1 * N0h] == -1) {
+					rotPlanPrev[s0 + s1 * N0h] = k;
+					queue.push_back(s0 + s1 * N0h);
+				}
+			}
+		}
+	}
+	long t0 = ((r0 % N0h) + N0h) % N0h;
+	long t1 = ((r1 % N1) + N1) % N1;
+	if(rotPlanPrev[t0 + t1 * N0h] == -1) {
+		rotPlanMutex.unlock();
+		return false;
+	}
+	steps.clear();
+	while(t0 != 0 || t1 != 0) {
+		pair<long, long>& key = rotPlanKeys[rotPlanPrev[t0 + t1 * N0h]];
+		steps.push_back(key);
+		t0 = (t0 + N0h - key.first % N0h) % N0h;
+		t1 = (t1 + N1 - key.second % N1) % N1;
+	}
+	rotPlanMutex.unlock();
+	return true;
+}
 
-	ZZ axrot[N], bxrot[N];
+void Scheme::clearRotPlan() {
+	rotPlanMutex.lock();
+	delete[] rotPlanPrev;
+	rotPlanPrev = NULL;
+	rotPlanMutex.unlock();
+}
+
+void Scheme::leftRotate(Ciphertext& res, Ciphertext& cipher, long r0, long r1) {
+	if(!hasLeftRotKey(r0, r1)) {
+		res.copy(cipher);
+		leftRotateAndEqual(res, r0, r1);
+		return;
+	}
+	CoeffArray bxrot(qbnd);
+	ring.leftRotate(bxrot, cipher.bx, r0, r1, cipher.logq);
 
-	ring.leftRotate(axrot, cipher.ax, r0, r1);
-	ring.leftRotate(bxrot, cipher.bx, r0, r1);
-	res.copyParams(cipher);
 	long np = ceil((cipher.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* rarot = new uint64_t[np << logN];
-	ring.toNTT(rarot, axrot, np);
-	Key& key = isSerialized ? SerializationUtils::readKey(serLeftRotKeyMap.at({r0, r1})) : leftRotKeyMap.at({r0, r1});
-	ring.multDNTT(res.ax, rarot, key.rax, np, qQ);
-	ring.multDNTT(res.bx, rarot, key.rbx, np, qQ);
-	delete[] rarot;
-	if(isSerialized) delete &key;
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rarot = scratch.alloc<residue_t>(np << logN);
+	ring.toNTT(ra, cipher.ax, np);
+	ring.leftRotateNTT(rarot, ra, r0, r1, np);
+	res.copyParams(cipher);
+	Key& key = isSerialized ? acquireKey(serLeftRotKeyMap.at({r0, r1})) : leftRotKeyMap.at({r0, r1});
+	switchKey(res.ax, res.bx, rarot, key, np, cipher.logq);
+	if(isSerialized) releaseKey(key);
+
+	ring.addAndEqual(res.bx, bxrot, cipher.logq);
+	scratch.release(mark);
+}
 
-	ring.rightShiftAndEqual(res.ax, logQ);
-	ring.rightShiftAndEqual(res.bx, logQ);
+void Scheme::leftRotateMany(Ciphertext* res, Ciphertext& cipher, vector<pair<long, long>>& rots) {
+	CoeffArray bxrot(qbnd);
 
-	ring.addAndEqual(res.bx, bxrot, q);
+	long np = ceil((cipher.logq + logQQ + logN + 3)/(double)pbnd);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rarot = scratch.alloc<residue_t>(np << logN);
+	ring.toNTT(ra, cipher.ax, np);
+	for (size_t i = 0; i < rots.size(); ++i) {
+		long r0 = rots[i].first;
+		long r1 = rots[i].second;
+		if(r0 == 0 && r1 % N1 == 0) {
+			res[i].copy(cipher);
+			continue;
+		}
+		if(!hasLeftRotKey(r0, r1)) {
+			res[i].copy(cipher);
+			leftRotateAndEqual(res[i], r0, r1);
+			continue;
+		}
+		res[i].copyParams(cipher);
+		ring.leftRotateNTT(rarot, ra, r0, r1, np);
+		Key& key = isSerialized ? acquireKey(serLeftRotKeyMap.at({r0, r1})) : leftRotKeyMap.at({r0, r1});
+		switchKey(res[i].ax, res[i].bx, rarot, key, np, cipher.logq);
+		if(isSerialized) releaseKey(key);
+
+		ring.leftRotate(bxrot, cipher.bx, r0, r1, cipher.logq);
+		ring.addAndEqual(res[i].bx, bxrot, cipher.logq);
+	}
+	scratch.release(mark);
 }
 
 void Scheme::rightRotate(Ciphertext& res, Ciphertext& cipher, long r0, long r1) {
@@ -1016,28 +1720,31 @@ void Scheme::rightRotate(Ciphertext& res, Ciphertext& cipher, long r0, long r1)
 }
 
 void Scheme::leftRotateAndEqual(Ciphertext& cipher, long r0, long r1) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ qQ = ring.qvec[cipher.logq + logQ];
-
-	ZZ axrot[N], bxrot[N];
-
-	ring.leftRotate(axrot, cipher.ax, r0, r1);
-	ring.leftRotate(bxrot, cipher.bx, r0, r1);
-
-	Key& key = isSerialized ? SerializationUtils::readKey(serLeftRotKeyMap.at({r0, r1})) : leftRotKeyMap.at({r0, r1});
+	if(!hasLeftRotKey(r0, r1)) {
+		vector<pair<long, long>> steps;
+		if(planLeftRotate(steps, r0, r1)) {
+			for (auto& step : steps) {
+				leftRotateAndEqual(cipher, step.first, step.second);
+			}
+			return;
+		}
+	}
+	CoeffArray bxrot(qbnd);
+	ring.leftRotate(bxrot, cipher.bx, r0, r1, cipher.logq);
 
 	long np = ceil((cipher.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* rarot = new uint64_t[np << logN];
-	ring.toNTT(rarot, axrot, np);
-	ring.multDNTT(cipher.bx, rarot, key.rbx, np, qQ);
-	ring.multDNTT(cipher.ax, rarot, key.rax, np, qQ);
-	delete[] rarot;
-	if(isSerialized) delete &key;
-
-	ring.rightShiftAndEqual(cipher.ax, logQ);
-	ring.rightShiftAndEqual(cipher.bx, logQ);
+	Key& key = isSerialized ? acquireKey(serLeftRotKeyMap.at({r0, r1})) : leftRotKeyMap.at({r0, r1});
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* rarot = scratch.alloc<residue_t>(np << logN);
+	ring.toNTT(ra, cipher.ax, np);
+	ring.leftRotateNTT(rarot, ra, r0, r1, np);
+	switchKey(cipher.ax, cipher.bx, rarot, key, np, cipher.logq);
+	if(isSerialized) releaseKey(key);
 
-	ring.addAndEqual(cipher.bx, bxrot, q);
+	ring.addAndEqual(cipher.bx, bxrot, cipher.logq);
+	scratch.release(mark);
 }
 
 void Scheme::rightRotateAndEqual(Ciphertext& cipher, long r0, long r1) {
@@ -1047,51 +1754,42 @@ void Scheme::rightRotateAndEqual(Ciphertext& cipher, long r0, long r1) {
 }
 
 void Scheme::conjugate(Ciphertext& res, Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ qQ = ring.qvec[cipher.logq + logQ];
-
-	ZZ axcnj[N], bxcnj[N];
-	ring.conjugate(axcnj, cipher.ax);
-	ring.conjugate(bxcnj, cipher.bx);
+	CoeffArray bxcnj(qbnd);
+	ring.conjugate(bxcnj, cipher.bx, cipher.logq);
 
 	long np = ceil((cipher.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* racnj = new uint64_t[np << logN];
-	ring.toNTT(racnj, axcnj, np);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* racnj = scratch.alloc<residue_t>(np << logN);
+	ring.toNTT(ra, cipher.ax, np);
+	ring.conjugateNTT(racnj, ra, np);
 	res.copyParams(cipher);
-	Key& key = isSerialized ? SerializationUtils::readKey(serKeyMap.at(CONJUGATION)) : keyMap.at(CONJUGATION);
-	ring.multDNTT(res.ax, racnj, key.rax, np, qQ);
-	ring.multDNTT(res.bx, racnj, key.rbx, np, qQ);
-	delete[] racnj;
-	if(isSerialized) delete &key;
-
-	ring.rightShiftAndEqual(res.ax, logQ);
-	ring.rightShiftAndEqual(res.bx, logQ);
+	Key& key = isSerialized ? acquireKey(serKeyMap.at(CONJUGATION)) : keyMap.at(CONJUGATION);
+	switchKey(res.ax, res.bx, racnj, key, np, cipher.logq);
+	if(isSerialized) releaseKey(key);
 
-	ring.addAndEqual(res.bx, bxcnj, q);
+	ring.addAndEqual(res.bx, bxcnj, cipher.logq);
+	scratch.release(mark);
 }
 
 void Scheme::conjugateAndEqual(Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
-	ZZ qQ = ring.qvec[cipher.logq + logQ];
-
-	ZZ axcnj[N], bxcnj[N];
-	ring.conjugate(axcnj, cipher.ax);
-	ring.conjugate(bxcnj, cipher.bx);
-
-	Key& key = isSerialized ? SerializationUtils::readKey(serKeyMap.at(CONJUGATION)) : keyMap.at(CONJUGATION);
+	CoeffArray bxcnj(qbnd);
+	ring.conjugate(bxcnj, cipher.bx, cipher.logq);
 
 	long np = ceil((cipher.logq + logQQ + logN + 3)/(double)pbnd);
-	uint64_t* racnj = new uint64_t[np << logN];
-	ring.toNTT(racnj, axcnj, np);
-	ring.multDNTT(cipher.ax, racnj, key.rax, np, qQ);
-	ring.multDNTT(cipher.bx, racnj, key.rbx, np, qQ);
-	delete[] racnj;
-	if(isSerialized) delete &key;
-
-	ring.rightShiftAndEqual(cipher.ax, logQ);
-	ring.rightShiftAndEqual(cipher.bx, logQ);
+	Key& key = isSerialized ? acquireKey(serKeyMap.at(CONJUGATION)) : keyMap.at(CONJUGATION);
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchMark mark = scratch.mark();
+	residue_t* ra = scratch.alloc<residue_t>(np << logN);
+	residue_t* racnj = scratch.alloc<residue_t>(np << logN);
+	ring.toNTT(ra, cipher.ax, np);
+	ring.conjugateNTT(racnj, ra, np);
+	switchKey(cipher.ax, cipher.bx, racnj, key, np, cipher.logq);
+	if(isSerialized) releaseKey(key);
 
-	ring.addAndEqual(cipher.bx, bxcnj, q);
+	ring.addAndEqual(cipher.bx, bxcnj, cipher.logq);
+	scratch.release(mark);
 }
 
 
@@ -1101,9 +1799,8 @@ void Scheme::conjugateAndEqual(Ciphertext& cipher) {
 
 
 void Scheme::normalizeAndEqual(Ciphertext& cipher) {
-	ZZ q = ring.qvec[cipher.logq];
-	ring.normalizeAndEqual(cipher.ax, q);
-	ring.normalizeAndEqual(cipher.bx, q);
+	ring.normalizeAndEqual(cipher.ax, cipher.logq);
+	ring.normalizeAndEqual(cipher.bx, cipher.logq);
 }
 
 void Scheme::coeffToSlotX0AndEqual(Ciphertext& cipher) {
@@ -1119,12 +1816,11 @@ void Scheme::coeffToSlotX0AndEqual(Ciphertext& cipher) {
 	long k0 = 1 << logk0;
 
 	Ciphertext* rotvec = new Ciphertext[k0];
-	NTL_EXEC_RANGE(k0, first, last);
-	for (long j = first; j < last; ++j) {
-		rotvec[j].copy(cipher);
-		if(j > 0) leftRotateAndEqual(rotvec[j], j, 0);
+	vector<pair<long, long>> rots;
+	for (long j = 0; j < k0; ++j) {
+		rots.push_back({j, 0});
 	}
-	NTL_EXEC_RANGE_END;
+	leftRotateMany(rotvec, cipher, rots);
 
 	BootContext& bootContext = ring.bootContextMap.at({logn0, logn1});
 	cipher.free();
@@ -1135,11 +1831,13 @@ void Scheme::coeffToSlotX0AndEqual(Ciphertext& cipher) {
 	for (long ki = 0; ki < n0; ki += k0) {
 		NTL_EXEC_RANGE(k0, first, last);
 		for (long j = first; j < last; ++j) {
-			Ciphertext tmp(rotvec[j]);
-			multPolyNTTX0AndEqual(tmp, bootContext.rpxVec[j + ki], bootContext.bndVec[j + ki], bootContext.logp);
+			Ciphertext tmp = pool.take();
+			tmp.copy(rotvec[j]);
+			multPolyNTTX0AndEqual(tmp, bootContext.rpxVec[j + ki], bootContext.rpxShoupVec[j + ki], bootContext.bndVec[j + ki], bootContext.logp);
 			m.lock();
 			addAndEqual(aux, tmp);
 			m.unlock();
+			pool.give(tmp);
 		}
 		NTL_EXEC_RANGE_END;
 		if(ki > 0) leftRotateAndEqual(aux, ki, 0);
@@ -1173,12 +1871,11 @@ void Scheme::coeffToSlotX1AndEqual(Ciphertext& cipher) {
 	aux.free();
 
 	Ciphertext* rotvec = new Ciphertext[k1];
-	NTL_EXEC_RANGE(k1, first, last);
-	for (long j = first; j < last; ++j) {
-		rotvec[j].copy(cipher);
-		if(j > 0) leftRotateAndEqual(rotvec[j], 0, j);
+	vector<pair<long, long>> rots;
+	for (long j = 0; j < k1; ++j) {
+		rots.push_back({0, j});
 	}
-	NTL_EXEC_RANGE_END;
+	leftRotateMany(rotvec, cipher, rots);
 
 	BootContext& bootContext = ring.bootContextMap.at({logn0, logn1});
 	cipher.free();
@@ -1188,12 +1885,13 @@ void Scheme::coeffToSlotX1AndEqual(Ciphertext& cipher) {
 	for (long ki = 0; ki < n1; ki += k1) {
 		NTL_EXEC_RANGE(k1, first, last);
 		for (long j = first; j < last; ++j) {
-			Ciphertext tmp(rotvec[j]);
+			Ciphertext tmp = pool.take();
 			complex<double> cnst = conj(ring.dftM1Pows[logn1][j + ki]) * (double)n1/(double)M1;
-			multConstAndEqual(tmp, cnst, bootContext.logp);
+			multConst(tmp, rotvec[j], cnst, bootContext.logp);
 			m.lock();
 			addAndEqual(aux, tmp);
 			m.unlock();
+			pool.give(tmp);
 		}
 		NTL_EXEC_RANGE_END;
 
@@ -1227,12 +1925,11 @@ void Scheme::slotToCoeffX0AndEqual(Ciphertext& cipher) {
 	long k0 = 1 << logk0;
 
 	Ciphertext* rotvec = new Ciphertext[k0];
-	NTL_EXEC_RANGE(k0, first, last);
-	for (long j = first; j < last; ++j) {
-		rotvec[j].copy(cipher);
-		if(j > 0) leftRotateAndEqual(rotvec[j], j, 0);
+	vector<pair<long, long>> rots;
+	for (long j = 0; j < k0; ++j) {
+		rots.push_back({j, 0});
 	}
-	NTL_EXEC_RANGE_END;
+	leftRotateMany(rotvec, cipher, rots);
 
 	BootContext& bootContext = ring.bootContextMap.at({logn0, logn1});
 	cipher.free();
@@ -1243,11 +1940,13 @@ void Scheme::slotToCoeffX0AndEqual(Ciphertext& cipher) {
 	for (long ki = 0; ki < n0; ki+=k0) {
 		NTL_EXEC_RANGE(k0, first, last);
 		for (long j = first; j < last; ++j) {
-			Ciphertext tmp(rotvec[j]);
-			multPolyNTTX0AndEqual(tmp, bootContext.rpxInvVec[j + ki], bootContext.bndInvVec[j + ki], bootContext.logp);
+			Ciphertext tmp = pool.take();
+			tmp.copy(rotvec[j]);
+			multPolyNTTX0AndEqual(tmp, bootContext.rpxInvVec[j + ki], bootContext.rpxInvShoupVec[j + ki], bootContext.bndInvVec[j + ki], bootContext.logp);
 			m.lock();
 			addAndEqual(aux, tmp);
 			m.unlock();
+			pool.give(tmp);
 		}
 		NTL_EXEC_RANGE_END;
 		if(ki > 0) leftRotateAndEqual(aux, ki, 0);
@@ -1273,12 +1972,11 @@ void Scheme::slotToCoeffX1AndEqual(Ciphertext& cipher) {
 	long k1 = 1 << logk1;
 
 	Ciphertext* rotvec = new Ciphertext[k1];
-	NTL_EXEC_RANGE(k1, first, last);
-	for (long j = first; j < last; ++j) {
-		rotvec[j].copy(cipher);
-		if(j > 0) leftRotateAndEqual(rotvec[j], 0, j);
+	vector<pair<long, long>> rots;
+	for (long j = 0; j < k1; ++j) {
+		rots.push_back({0, j});
 	}
-	NTL_EXEC_RANGE_END;
+	leftRotateMany(rotvec, cipher, rots);
 
 	BootContext& bootContext = ring.bootContextMap.at({logn0, logn1});
 	cipher.free();
@@ -1290,11 +1988,12 @@ void Scheme::slotToCoeffX1AndEqual(Ciphertext& cipher) {
 		NTL_EXEC_RANGE(k1, first, last);
 		for (long j = first; j < last; ++j) {
 			complex<double> cnst = ring.dftM1Pows[logn1][n1-j-ki];
-			Ciphertext tmp(rotvec[j]);
-			multConstAndEqual(tmp, cnst, bootContext.logp);
+			Ciphertext tmp = pool.take();
+			multConst(tmp, rotvec[j], cnst, bootContext.logp);
 			m.lock();
 			addAndEqual(aux, tmp);
 			m.unlock();
+			pool.give(tmp);
 		}
 		NTL_EXEC_RANGE_END;
 
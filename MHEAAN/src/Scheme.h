@@ -14,8 +14,12 @@
 
 #include "SecretKey.h"
 #include "Ciphertext.h"
+#include "CiphertextNTT.h"
+#include "CiphertextPool.h"
 #include "Plaintext.h"
 #include "Key.h"
+#include "KeyCache.h"
+#include "KeyStore.h"
 #include "EvaluatorUtils.h"
 #include "Ring.h"
 
@@ -31,6 +35,9 @@ private:
 public:
 
 	bool isSerialized;
+	bool isShoupKeys; ///< keep Shoup companions next to in-memory and cached keys, doubles key memory, KeyStore views have none
+	bool isSeededKeys; ///< store a seed instead of rax, halves key memory and key files
+	long keyPrimes = nprimes; ///< primes kept by in-memory switching keys, lowered by truncateKeys and applied to keys added later
 
 	Ring& ring;
 
@@ -39,11 +46,21 @@ public:
 
 	map<long, string> serKeyMap;
 	map<pair<long, long>, string> serLeftRotKeyMap;
+	KeyStore keyStore; ///< mapped key files of the serialized mode
+	KeyCache keyCache; ///< in-memory copies of serialized keys, used instead of the mappings when its budget is set
+
+	vector<pair<long, long>> rotPlanKeys; ///< rotation keys the plan tree was built from
+	long* rotPlanPrev = NULL; ///< per rotation r0 + r1 * N0h, index in rotPlanKeys of the last step of a shortest composition, -1 if none
+	mutex rotPlanMutex;
 
 	map<long, SqrMatContext&> sqrMatContextMap;
 	map<pair<long, long>, BootContext&> bootContextMap;
 
-	Scheme(SecretKey& secretKey, Ring& ring, bool isSerialized = false);
+	CiphertextPool pool; ///< temporaries of the bootstrapping and SchemeAlgo loops
+
+	Scheme(SecretKey& secretKey, Ring& ring, bool isSerialized = false, bool isShoupKeys = false, bool isSeededKeys = false, size_t poolCapacity = 0); ///< poolCapacity 0 keeps two spare ciphertexts per NTL thread
+
+	virtual ~Scheme(); ///< frees the boot contexts
 
 
 	//----------------------------------------------------------------------------------
@@ -51,21 +68,74 @@ public:
 	//----------------------------------------------------------------------------------
 
 
+	void addShoupKey(Key& key);
+
+	// a seeded key has rax == NULL: key switching expands the first np primes of rax for the call,
+	// expandKey keeps the full rax (and its Shoup companion) in the key for frequently used keys
+	residue_t* expandKeyAx(Key& key, long np);
+	void expandKey(Key& key);
+
+	// ax and bx of the key switch of ra, an NTT image with np primes at level logq: the products are reconstructed
+	// mod 2^(logq + logQ) and divided by 2^logQ
+	void switchKey(CoeffArray& ax, CoeffArray& bx, residue_t* ra, Key& key, long np, long logq);
+
+	// the same in residues: a, given by its image ra with npa primes, is re-imaged mod q over the key primes,
+	// and the products are divided by 2^logQ on the way back to images rxa and rxb with np primes
+	void switchKeyNTT(residue_t* rxa, residue_t* rxb, residue_t* ra, long npa, Key& key, long np, long logq);
+
+	void truncateKeys(long logq); ///< keeps only the primes key switching needs for ciphertexts up to logq
+
+	// serialized keys are acquired for one operation: a view of the mapped file, or with a keyCache budget
+	// a cached copy (with Shoup companions if isShoupKeys) that stays cached until evicted
+	Key& acquireKey(string path);
+	void releaseKey(Key& key);
+	void pinKey(long type); ///< keeps a serialized key cached, e.g. MULTIPLICATION
+	void pinLeftRotKey(long r0, long r1);
+
 	void addEncKey(SecretKey& secretKey);
 	void addMultKey(SecretKey& secretKey);
 	void addConjKey(SecretKey& secretKey);
 
+	Key* genLeftRotKey(SecretKey& secretKey, long r0, long r1);
+	void storeLeftRotKey(Key* key, long r0, long r1); ///< writes or keeps the key and registers it
+
 	void addLeftRotKey(SecretKey& secretKey, long r0, long r1);
+	// generates the missing keys of rots concurrently, each from its own seed drawn in order from the
+	// current random stream, so the keys do not depend on how the work is split across threads
+	void addLeftRotKeys(SecretKey& secretKey, vector<pair<long, long>>& rots);
 	void addLeftX0RotKeys(SecretKey& secretKey);
 	void addLeftX1RotKeys(SecretKey& secretKey);
 	void addRightX0RotKeys(SecretKey& secretKey);
 	void addRightX1RotKeys(SecretKey& secretKey);
+	// power-of-two rotation keys on each axis, from which any rotation is composed: left ones only for
+	// minimum memory, left and right ones (signed-digit decompositions, about half the steps) for minimum latency
+	void addBaseRotKeys(SecretKey& secretKey, bool isMinLatency = false);
+	void eraseLeftRotKey(long r0, long r1); ///< rotations by (r0, r1) are composed of the remaining keys afterwards
 
 	void addBootContext(long logn0, long logn1, long logp);
 	void addSqrMatContext(long logn, long logp);
-	void addBootKey(SecretKey& secretKey, long logn0, long logn1, long logp);
-	void addSqrMatKeys(SecretKey& secretKey, long logn, long logp);
-	void addTransposeKeys(SecretKey& secretKey, long logn, long logp);
+
+	// rotations performed by a workload, appended to rots with the number of times each one is performed
+	void bootRotations(vector<pair<long, long>>& rots, vector<long>& weights, long logn0, long logn1);
+	void sqrMatRotations(vector<pair<long, long>>& rots, vector<long>& weights, long logn);
+	void transposeRotations(vector<pair<long, long>>& rots, vector<long>& weights, long logn);
+
+	long rotKeyBytes(); ///< memory of one rotation key in the current key modes, at keyPrimes primes unless serialized
+
+	void existingRotDist(long* dist, long inf); ///< fewest key switches to each rotation with the existing keys
+
+	// greedily picks at most maxKeys new rotation keys that minimize the weighted number of key switches of rots
+	// (see planLeftRotate) given the existing keys; when that leaves a rotation unreachable the missing power-of-two
+	// generators are taken first. Returns that number, or -1 if maxKeys cannot even hold the generators
+	long planRotKeys(vector<pair<long, long>>& keys, vector<pair<long, long>>& rots, vector<long>& weights, long maxKeys);
+
+	// planned keys within budget bytes, existing rotation keys included; throws invalid_argument if it cannot reach every rotation
+	void addRotKeys(SecretKey& secretKey, vector<pair<long, long>>& rots, vector<long>& weights, long budget);
+
+	// with a budget in bytes the rotation keys are planned for the workload instead of one key per rotation
+	void addBootKey(SecretKey& secretKey, long logn0, long logn1, long logp, long budget = 0);
+	void addSqrMatKeys(SecretKey& secretKey, long logn, long logp, long budget = 0);
+	void addTransposeKeys(SecretKey& secretKey, long logn, long logp, long budget = 0);
 
 
 	//----------------------------------------------------------------------------------
@@ -139,14 +209,15 @@ public:
 
 	void multPolyX0(Ciphertext& res, Ciphertext& cipher, ZZ* poly, long logp);
 	void multPolyX0AndEqual(Ciphertext& cipher, ZZ* poly, long logp);
-	void multPolyNTTX0(Ciphertext& res, Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp);
-	void multPolyNTTX0AndEqual(Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp);
+	void multPolyNTTX0(Ciphertext& res, Ciphertext& cipher, residue_t* rpoly, long bnd, long logp);
+	void multPolyNTTX0AndEqual(Ciphertext& cipher, residue_t* rpoly, long bnd, long logp);
+	void multPolyNTTX0AndEqual(Ciphertext& cipher, residue_t* rpoly, residue_t* rpolys, long bnd, long logp);
 
 	void multPolyX1(Ciphertext& res, Ciphertext& cipher, ZZ* rpoly, ZZ* ipoly, long logp);
 	void multPolyX1AndEqual(Ciphertext& cipher, ZZ* rpoly, ZZ* ipoly, long logp);
 
-	void multPolyNTT(Ciphertext& res, Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp);
-	void multPolyNTTAndEqual(Ciphertext& cipher, uint64_t* rpoly, long bnd, long logp);
+	void multPolyNTT(Ciphertext& res, Ciphertext& cipher, residue_t* rpoly, long bnd, long logp);
+	void multPolyNTTAndEqual(Ciphertext& cipher, residue_t* rpoly, long bnd, long logp);
 
 	void multByMonomial(Ciphertext& res, Ciphertext& cipher, const long d0, const long d1);
 	void multByMonomialAndEqual(Ciphertext& cipher, const long d0, const long d1);
@@ -158,6 +229,60 @@ public:
 	void divPo2AndEqual(Ciphertext& cipher, long logd);
 
 
+	//----------------------------------------------------------------------------------
+	//   DOUBLE-CRT (NTT FORM) OPERATIONS
+	//----------------------------------------------------------------------------------
+
+
+	void toNTT(CiphertextNTT& res, Ciphertext& cipher, long np = 0); ///< np = 0 takes enough primes for mult with an image at the same level
+	void fromNTT(Ciphertext& res, const CiphertextNTT& cipher);
+	void reduceNTT(residue_t*& rax, residue_t*& rbx, const CiphertextNTT& cipher, long np); ///< re-images cipher with np primes into buffers of the thread's ScratchArena
+	void reduceNTTAndEqual(CiphertextNTT& cipher, long np); ///< re-images cipher with np primes from its value mod q, resetting logb to logq
+
+	// operands are left unchanged: when their images would overflow they are re-imaged into scratch buffers
+
+	void negate(CiphertextNTT& res, const CiphertextNTT& cipher);
+	void negateAndEqual(CiphertextNTT& cipher);
+
+	void add(CiphertextNTT& res, const CiphertextNTT& cipher1, const CiphertextNTT& cipher2);
+	void addAndEqual(CiphertextNTT& cipher1, const CiphertextNTT& cipher2);
+
+	void sub(CiphertextNTT& res, const CiphertextNTT& cipher1, const CiphertextNTT& cipher2);
+	void subAndEqual(CiphertextNTT& cipher1, const CiphertextNTT& cipher2);
+
+	void multConst(CiphertextNTT& res, const CiphertextNTT& cipher, double cnst, long logp);
+	void multConstAndEqual(CiphertextNTT& cipher, double cnst, long logp);
+
+	void multPolyNTT(CiphertextNTT& res, const CiphertextNTT& cipher, residue_t* rpoly, long bnd, long logp);
+	void multPolyNTTAndEqual(CiphertextNTT& cipher, residue_t* rpoly, long bnd, long logp);
+
+	// relinearization divides by 2^logQ, so products come back as Ciphertext
+	void mult(Ciphertext& res, const CiphertextNTT& cipher1, const CiphertextNTT& cipher2);
+	void square(Ciphertext& res, const CiphertextNTT& cipher);
+
+	// relinearized products at level logq of images with np primes, also used by the Ciphertext mult and square:
+	// everything stays in residues until ax and bx are reconstructed mod q
+	void multNTT(CoeffArray& ax, CoeffArray& bx, residue_t* rax1, residue_t* rbx1, residue_t* rax2, residue_t* rbx2, long np, long logq);
+	void squareNTT(CoeffArray& ax, CoeffArray& bx, residue_t* rax, residue_t* rbx, long np, long logq);
+
+	// the key switch and rescaling stay in residues, Ring::scaleNTT divides by 2^logQ or 2^dlogq with a base conversion.
+	// The result keeps the primes of cipher
+	void switchKeyNTT(CiphertextNTT& res, residue_t* rax, residue_t* rbx, const CiphertextNTT& cipher, Key& key); ///< rax and rbx are cipher mapped by the automorphism of key
+
+	void leftRotate(CiphertextNTT& res, const CiphertextNTT& cipher, long r0, long r1);
+	void leftRotateAndEqual(CiphertextNTT& cipher, long r0, long r1);
+
+	void conjugate(CiphertextNTT& res, const CiphertextNTT& cipher);
+	void conjugateAndEqual(CiphertextNTT& cipher);
+
+	void reScaleBy(CiphertextNTT& res, const CiphertextNTT& cipher, long dlogq);
+	void reScaleByAndEqual(CiphertextNTT& cipher, long dlogq);
+
+	// q is a power of two, so the images stand for the same polynomial mod the smaller q
+	void modDownTo(CiphertextNTT& res, const CiphertextNTT& cipher, long logq);
+	void modDownToAndEqual(CiphertextNTT& cipher, long logq);
+
+
 	//----------------------------------------------------------------------------------
 	//   RESCALING & MODULUS DOWN
 	//----------------------------------------------------------------------------------
@@ -180,9 +305,20 @@ public:
 	//   ROTATIONS & CONJUGATIONS
 	//----------------------------------------------------------------------------------
 
+	// a rotation without its own key is composed of rotations by available keys with the fewest key switches,
+	// found by a breadth-first search over the rotation group that is redone when rotation keys change
+	bool hasLeftRotKey(long r0, long r1);
+	bool planLeftRotate(vector<pair<long, long>>& steps, long r0, long r1); ///< false if the keys cannot compose (r0, r1)
+	void clearRotPlan();
+
 	void leftRotate(Ciphertext& res, Ciphertext& cipher, long r0, long r1);
 	void rightRotate(Ciphertext& res, Ciphertext& cipher, long r0, long r1);
 
+	// hoisted rotations: ax is raised to the key-switch modulus and transformed once,
+	// each rotation is then a slot permutation of that image, res[i] must not alias cipher
+	void leftRotateMany(Ciphertext* res, Ciphertext& cipher, vector<pair<long, long>>& rots);
+
+
 	void leftRotateAndEqual(Ciphertext& cipher, long r0, long r1);
 	void rightRotateAndEqual(Ciphertext& cipher, long r0, long r1);
 
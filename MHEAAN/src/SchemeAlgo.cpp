@@ -88,7 +88,7 @@ void SchemeAlgo::inverseAndEqual(Ciphertext& cipher, long logp, long steps) {
 		scheme.addConstAndEqual(tmp, 1.0, logp);
 		scheme.multAndEqual(tmp, cipher);
 		scheme.reScaleByAndEqual(tmp, logp);
-		cipher.copy(tmp);
+		cipher.swap(tmp);
 	}
 }
 
@@ -140,12 +140,13 @@ void SchemeAlgo::transpose(Ciphertext& res, Ciphertext& cipher, long logp, long
 	res.logp += sqrMatContext.msgvec[0].logp;
 	NTL_EXEC_RANGE(n, first, last);
 	for (long i = first; i < last; ++i) {
-		Ciphertext tmp(cipher);
-		scheme.multAndEqual(tmp, sqrMatContext.msgvec[i]);
+		Ciphertext tmp = scheme.pool.take();
+		scheme.mult(tmp, cipher, sqrMatContext.msgvec[i]);
 		if(i > 0) scheme.leftRotateAndEqual(tmp,i, N1 - i);
 		m.lock();
 		scheme.addAndEqual(res, tmp);
 		m.unlock();
+		scheme.pool.give(tmp);
 	}
 	NTL_EXEC_RANGE_END;
 
@@ -163,10 +164,10 @@ void SchemeAlgo::sqrMatMult(Ciphertext& res, Ciphertext& cipher1, Ciphertext& ci
 
 	NTL_EXEC_RANGE(n, first, last);
 	for (long i = first; i < last; ++i) {
-		Ciphertext tmp2(cipher2);
-		scheme.multAndEqual(tmp2, sqrMatContext.msgvec[i]);
+		Ciphertext tmp2 = scheme.pool.take();
+		scheme.mult(tmp2, cipher2, sqrMatContext.msgvec[i]);
 		scheme.reScaleByAndEqual(tmp2, sqrMatContext.msgvec[i].logp);
-		Ciphertext aux;
+		Ciphertext aux = scheme.pool.take();
 		for (long j = 0; j < logn; ++j) {
 			scheme.leftRotate(aux, tmp2, 0, (1 << j));
 			scheme.addAndEqual(tmp2, aux);
@@ -178,6 +179,8 @@ void SchemeAlgo::sqrMatMult(Ciphertext& res, Ciphertext& cipher1, Ciphertext& ci
 		m.lock();
 		scheme.addAndEqual(res, aux);
 		m.unlock();
+		scheme.pool.give(tmp2);
+		scheme.pool.give(aux);
 	}
 	NTL_EXEC_RANGE_END;
 	scheme.reScaleByAndEqual(res, logp);
@@ -193,11 +196,11 @@ void SchemeAlgo::sqrMatSqr(Ciphertext& res, Ciphertext& cipher, long logp, long
 	res.logq -= sqrMatContext.msgvec[0].logp;
 	NTL_EXEC_RANGE(n, first, last);
 	for (long i = first; i < last; ++i) {
-		Ciphertext tmp(cipher);
-		scheme.multAndEqual(tmp, sqrMatContext.msgvec[i]);
+		Ciphertext tmp = scheme.pool.take();
+		scheme.mult(tmp, cipher, sqrMatContext.msgvec[i]);
 		scheme.reScaleByAndEqual(tmp, sqrMatContext.msgvec[i].logp);
 
-		Ciphertext aux;
+		Ciphertext aux = scheme.pool.take();
 		for (long j = 0; j < logn; ++j) {
 			scheme.leftRotate(aux, tmp, 0, (1 << j));
 			scheme.addAndEqual(tmp, aux);
@@ -209,6 +212,8 @@ void SchemeAlgo::sqrMatSqr(Ciphertext& res, Ciphertext& cipher, long logp, long
 		m.lock();
 		scheme.addAndEqual(res, aux);
 		m.unlock();
+		scheme.pool.give(tmp);
+		scheme.pool.give(aux);
 	}
 	NTL_EXEC_RANGE_END;
 
@@ -234,7 +239,7 @@ void SchemeAlgo::matInv(Ciphertext& res, Ciphertext& cipher, long logp, long n,
 		scheme.addAndEqual(tmp, sqrMatContext.msgvec[0]);
 		scheme.modDownToAndEqual(res, tmp.logq);
 		sqrMatMult(x, tmp, res, logp, n);
-		res.copy(x);
+		res.swap(x);
 	}
 }
 
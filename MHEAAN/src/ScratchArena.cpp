@@ -0,0 +1,109 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#include "ScratchArena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+atomic<long> ScratchArena::peak(0);
+
+static char* newBlock(long bytes) {
+	void* res = NULL;
+	if(posix_memalign(&res, ScratchArena::align, bytes) != 0) throw bad_alloc();
+	memset(res, 0, bytes);
+	return static_cast<char*>(res);
+}
+
+ScratchArena& ScratchArena::local() {
+	static thread_local ScratchArena arena;
+	return arena;
+}
+
+ScratchArena::ScratchArena() : block(0), top(0), live(0), highWater(0) {
+}
+
+ScratchMark ScratchArena::mark() {
+	ScratchMark res = {block, top, live};
+	return res;
+}
+
+void ScratchArena::release(ScratchMark& mark) {
+	block = mark.block;
+	top = mark.top;
+	live = mark.live;
+	if(live == 0 && blocks.size() > 1) {
+		long total = capacity();
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			free(blocks[i]);
+		}
+		blocks.assign(1, newBlock(total));
+		sizes.assign(1, total);
+	}
+}
+
+void* ScratchArena::allocBytes(long bytes) {
+	bytes = (bytes + align - 1) & ~(align - 1);
+	if(blocks.empty() || top + bytes > sizes[block]) {
+		long next = blocks.empty() ? 0 : block + 1;
+		if(next < (long) blocks.size() && sizes[next] < bytes) {
+			for (size_t i = next; i < blocks.size(); ++i) {
+				free(blocks[i]);
+			}
+			blocks.resize(next);
+			sizes.resize(next);
+		}
+		if(next == (long) blocks.size()) {
+			long size = blocks.empty() ? bytes : max(bytes, 2 * sizes[block]);
+			blocks.push_back(newBlock(size));
+			sizes.push_back(size);
+		}
+		block = next;
+		top = 0;
+	}
+	void* res = blocks[block] + top;
+	top += bytes;
+	live += bytes;
+	if(live > highWater) {
+		highWater = live;
+		long p = peak.load();
+		while(highWater > p && !peak.compare_exchange_weak(p, highWater));
+	}
+	return res;
+}
+
+long ScratchArena::capacity() {
+	long res = 0;
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		res += sizes[i];
+	}
+	return res;
+}
+
+void ScratchArena::trim() {
+	if(live == 0) {
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			free(blocks[i]);
+		}
+		blocks.clear();
+		sizes.clear();
+		block = 0;
+		top = 0;
+	}
+}
+
+long ScratchArena::peakBytes() {
+	return peak.load();
+}
+
+ScratchArena::~ScratchArena() {
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		free(blocks[i]);
+	}
+}
@@ -0,0 +1,66 @@
+/*
+* Copyright (c) by CryptoLab inc.
+* This program is licensed under a
+* Creative Commons Attribution-NonCommercial 3.0 Unported License.
+* You should have received a copy of the license along with this
+* work.  If not, see <http://creativecommons.org/licenses/by-nc/3.0/>.
+*/
+
+#ifndef MHEAAN_SCRATCHARENA_H_
+#define MHEAAN_SCRATCHARENA_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+struct ScratchMark {
+	long block;
+	long top;
+	long live;
+};
+
+// Per-thread stack of temporary buffers for the NTT and CRT kernels.
+// A function takes a mark, carves 64-byte aligned buffers with alloc and releases back to the mark before it returns,
+// so buffers are handed out in LIFO order and their memory stays mapped and faulted in for the next call.
+// When a release empties the arena after it had to grow into several blocks, the blocks are merged into one.
+class ScratchArena {
+
+public:
+
+	static const long align = 64;
+
+	vector<char*> blocks;
+	vector<long> sizes; ///< bytes of each block
+
+	long block; ///< block being carved
+	long top; ///< bytes used in that block
+	long live; ///< bytes handed out and not released
+
+	long highWater; ///< largest live of this arena
+
+	static atomic<long> peak; ///< largest live of any arena
+
+	static ScratchArena& local(); ///< arena of the calling thread
+
+	ScratchArena();
+
+	ScratchMark mark();
+	void release(ScratchMark& mark);
+
+	void* allocBytes(long bytes);
+
+	template<typename T> T* alloc(long len) {
+		return static_cast<T*>(allocBytes(len * sizeof(T)));
+	}
+
+	long capacity(); ///< bytes held by this arena
+	void trim(); ///< returns the blocks to the system, only when nothing is live
+
+	static long peakBytes();
+
+	virtual ~ScratchArena();
+};
+
+#endif
@@ -12,3 +12,16 @@ SecretKey::SecretKey(Ring& ring) {
 //	fill_n(sx, N, 0);
 	ring.sampleHWT(sx);
 }
+
+residue_t* SecretKey::ntt(Ring& ring) {
+	call_once(rsxOnce, [&] {
+		residue_t* res = new residue_t[Nnprimes];
+		ring.toNTT(res, sx, nprimes);
+		rsx = res;
+	});
+	return rsx;
+}
+
+SecretKey::~SecretKey() {
+	delete[] rsx;
+}
@@ -10,6 +10,7 @@
 #define MHEAAN_SECRETKEY_H_
 
 #include <NTL/ZZ.h>
+#include <mutex>
 #include "Params.h"
 #include "Ring.h"
 
@@ -21,8 +22,14 @@ public:
 
 	ZZ sx[N];
 
+	residue_t* rsx = NULL; ///< NTT image of sx at nprimes, built by ntt on first use
+	once_flag rsxOnce;
+
 	SecretKey(Ring& ring);
 
+	residue_t* ntt(Ring& ring); ///< a prefix of np primes serves any product needing np primes
+
+	virtual ~SecretKey();
 };
 
 #endif
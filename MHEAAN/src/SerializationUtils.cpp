@@ -1,5 +1,23 @@
 #include "SerializationUtils.h"
 
+// coefficient n of p mod 2^logq as nbytes little-endian bytes, and back
+static void coeffToBytes(unsigned char* bytes, CoeffArray& p, long n, long logq, long nbytes) {
+	for (long b = 0; b < nbytes; ++b) {
+		bool low = (b << 3) < logq && (b >> 3) < p.nlimbs;
+		bytes[b] = low ? (unsigned char) (p.data[((b >> 3) << logN) + n] >> ((b & 7) << 3)) : 0;
+	}
+	if (logq & 7) bytes[logq >> 3] &= (1 << (logq & 7)) - 1;
+}
+
+static void coeffFromBytes(CoeffArray& p, long n, unsigned char* bytes, long nbytes) {
+	for (long j = 0; j < p.nlimbs; ++j) {
+		p.data[(j << logN) + n] = 0;
+	}
+	for (long b = 0; b < nbytes && (b >> 3) < p.nlimbs; ++b) {
+		p.data[((b >> 3) << logN) + n] |= (uint64_t) bytes[b] << ((b & 7) << 3);
+	}
+}
+
 void SerializationUtils::writeCiphertext(Ciphertext& cipher, string path) {
 	fstream fout;
 	fout.open(path, ios::binary|ios::out);
@@ -14,15 +32,14 @@ void SerializationUtils::writeCiphertext(Ciphertext& cipher, string path) {
 
 	long np = ceil(((double)logq + 1)/8);
 	unsigned char* bytes = new unsigned char[np];
-	ZZ q = conv<ZZ>(1) << logq;
+	cipher.ax.alloc();
+	cipher.bx.alloc();
 	for (long i = 0; i < N; ++i) {
-		cipher.ax[i] %= q;
-		BytesFromZZ(bytes, cipher.ax[i], np);
+		coeffToBytes(bytes, cipher.ax, i, logq, np);
 		fout.write(reinterpret_cast<char*>(bytes), np);
 	}
 	for (long i = 0; i < N; ++i) {
-		cipher.bx[i] %= q;
-		BytesFromZZ(bytes, cipher.bx[i], np);
+		coeffToBytes(bytes, cipher.bx, i, logq, np);
 		fout.write(reinterpret_cast<char*>(bytes), np);
 	}
 	fout.close();
@@ -41,13 +58,15 @@ Ciphertext& SerializationUtils::readCiphertext(string path) {
 	unsigned char* bytes = new unsigned char[np];
 
 	Ciphertext res(logp, logq, n0, n1);
+	res.ax.alloc();
+	res.bx.alloc();
 	for (long i = 0; i < N; ++i) {
 		fin.read(reinterpret_cast<char*>(bytes), np);
-		ZZFromBytes(res.ax[i], bytes, np);
+		coeffFromBytes(res.ax, i, bytes, np);
 	}
 	for (long i = 0; i < N; ++i) {
 		fin.read(reinterpret_cast<char*>(bytes), np);
-		ZZFromBytes(res.bx[i], bytes, np);
+		coeffFromBytes(res.bx, i, bytes, np);
 	}
 	fin.close();
 	return res;
@@ -56,19 +75,34 @@ Ciphertext& SerializationUtils::readCiphertext(string path) {
 void SerializationUtils::writeKey(Key& key, string path) {
 	fstream fout;
 	fout.open(path, ios::binary|ios::out);
-	fout.write(reinterpret_cast<char*>(key.rax), Nnprimes * sizeof(uint64_t));
-	fout.write(reinterpret_cast<char*>(key.rbx), Nnprimes * sizeof(uint64_t));
+	if(key.seed != NULL) {
+		fout.write(reinterpret_cast<char*>(key.seed), NTL_PRG_KEYLEN);
+	} else {
+		fout.write(reinterpret_cast<char*>(key.rax), (key.np << logN) * sizeof(residue_t));
+	}
+	fout.write(reinterpret_cast<char*>(key.rbx), (key.np << logN) * sizeof(residue_t));
 	fout.close();
 }
 
-Key& SerializationUtils::readKey(string path) {
-	long np;
-	Key key;
+Key& SerializationUtils::readKey(string path, bool isSeeded, long np) {
+	Key* key = new Key(isSeeded, np);
 	fstream fin;
 	fin.open(path, ios::binary|ios::in);
-	fin.read(reinterpret_cast<char*>(key.rax), (Nnprimes)*sizeof(uint64_t));
-	fin.read(reinterpret_cast<char*>(key.rbx), (Nnprimes)*sizeof(uint64_t));
+	fin.seekg(0, ios::end);
+	long fnp = keyFilePrimes(fin.tellg(), isSeeded);
+	fin.seekg(0, ios::beg);
+	if(isSeeded) {
+		fin.read(reinterpret_cast<char*>(key->seed), NTL_PRG_KEYLEN);
+	} else {
+		fin.read(reinterpret_cast<char*>(key->rax), (np << logN) * sizeof(residue_t));
+		fin.seekg((fnp << logN) * sizeof(residue_t), ios::beg);
+	}
+	fin.read(reinterpret_cast<char*>(key->rbx), (np << logN) * sizeof(residue_t));
 	fin.close();
-	return key;
+	return *key;
 }
 
+long SerializationUtils::keyFilePrimes(long bytes, bool isSeeded) {
+	if(isSeeded) return (bytes - NTL_PRG_KEYLEN) / (N * sizeof(residue_t));
+	return bytes / (2 * N * sizeof(residue_t));
+}
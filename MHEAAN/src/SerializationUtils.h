@@ -17,8 +17,11 @@ public:
 	static void writeCiphertext(Ciphertext& ciphertext, string path);
 	static Ciphertext& readCiphertext(string path);
 
+	// key files hold the seed of a seeded key, then the rax residues and the rbx residues of all key primes,
+	// each in the prime-major layout of Key, so that a mapped file can be used in place (see KeyStore)
 	static void writeKey(Key& key, string path);
-	static Key& readKey(string path);
+	static Key& readKey(string path, bool isSeeded = false, long np = nprimes); ///< allocates, the caller deletes
+	static long keyFilePrimes(long bytes, bool isSeeded); ///< number of key primes in a key file of that size
 };
 
 #endif
@@ -11,6 +11,9 @@
 #include <NTL/BasicThreadPool.h>
 #include <NTL/RR.h>
 #include <NTL/ZZ.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
 
 #include "Ciphertext.h"
 #include "EvaluatorUtils.h"
@@ -234,6 +237,115 @@ void TestScheme::testConjugate(long logq, long logp, long logn0, long logn1) {
 }
 
 
+void TestScheme::testRotKeyBudget(long logq, long logp, long logn, long budgetKeys) {
+	cout << "!!! START TEST ROTATION KEY BUDGET !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring, false, true);
+	scheme.truncateKeys(logq);
+
+	vector<pair<long, long>> rots;
+	vector<long> weights;
+	scheme.sqrMatRotations(rots, weights, logn);
+	long budget = budgetKeys * scheme.rotKeyBytes();
+	scheme.addRotKeys(secretKey, rots, weights, budget);
+
+	long used = 0;
+	for (auto& it : scheme.leftRotKeyMap) used += KeyCache::keyBytes(it.second);
+	cout << "keys: " << scheme.leftRotKeyMap.size() << ", bytes: " << used << " of " << budget << endl;
+
+	complex<double>* mmat = EvaluatorUtils::randomComplexSignedArray(Nh);
+	Ciphertext cipher, crot;
+	scheme.encrypt(cipher, mmat, N0h, N1, logp, logq);
+
+	long switches = 0;
+	double maxError = 0;
+	for (auto& rot : rots) {
+		vector<pair<long, long>> steps;
+		scheme.planLeftRotate(steps, rot.first, rot.second);
+		switches += steps.size();
+		scheme.leftRotate(crot, cipher, rot.first, rot.second);
+		complex<double>* drot = scheme.decrypt(secretKey, crot);
+		for (long j = 0; j < N1; ++j) {
+			for (long i = 0; i < N0h; ++i) {
+				complex<double> mrot = mmat[(i + rot.first) % N0h + ((j + rot.second) % N1) * N0h];
+				maxError = max(maxError, abs(drot[i + j * N0h] - mrot));
+			}
+		}
+		delete[] drot;
+	}
+	cout << "rotations: " << rots.size() << ", key switches: " << switches << ", max error: " << maxError << endl;
+
+	cout << "!!! END TEST ROTATION KEY BUDGET !!!" << endl;
+}
+
+void TestScheme::testRotateCompose(long logq, long logp, bool isMinLatency) {
+	cout << "!!! START TEST ROTATE COMPOSE !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	TimeUtils timeutils;
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring);
+	scheme.addBaseRotKeys(secretKey, isMinLatency);
+
+	complex<double>* mmat = EvaluatorUtils::randomComplexSignedArray(Nh);
+	Ciphertext cipher, crot;
+	scheme.encrypt(cipher, mmat, N0h, N1, logp, logq);
+
+	vector<pair<long, long>> rots;
+	for (long r0 = 0; r0 < N0h; r0 += N0h / 4 + 1) {
+		for (long r1 = 0; r1 < N1; r1 += N1 / 4 + 1) {
+			rots.push_back({r0, r1});
+		}
+	}
+
+	long maxSteps = 0;
+	double maxError = 0;
+	for (auto& rot : rots) {
+		vector<pair<long, long>> steps;
+		scheme.planLeftRotate(steps, rot.first, rot.second);
+		maxSteps = max(maxSteps, (long) steps.size());
+		scheme.leftRotate(crot, cipher, rot.first, rot.second);
+		complex<double>* drot = scheme.decrypt(secretKey, crot);
+		for (long j = 0; j < N1; ++j) {
+			for (long i = 0; i < N0h; ++i) {
+				complex<double> mrot = mmat[(i + rot.first) % N0h + ((j + rot.second) % N1) * N0h];
+				maxError = max(maxError, abs(drot[i + j * N0h] - mrot));
+			}
+		}
+		delete[] drot;
+	}
+	cout << "keys: " << scheme.leftRotKeyMap.size() << ", rotations: " << rots.size() << ", max key switches: " << maxSteps << ", max error: " << maxError << endl;
+
+	Ciphertext* cmany = new Ciphertext[rots.size()];
+	timeutils.start("Left rotate many");
+	scheme.leftRotateMany(cmany, cipher, rots);
+	timeutils.stop("Left rotate many");
+	maxError = 0;
+	for (long k = 0; k < (long) rots.size(); ++k) {
+		complex<double>* drot = scheme.decrypt(secretKey, cmany[k]);
+		for (long j = 0; j < N1; ++j) {
+			for (long i = 0; i < N0h; ++i) {
+				complex<double> mrot = mmat[(i + rots[k].first) % N0h + ((j + rots[k].second) % N1) * N0h];
+				maxError = max(maxError, abs(drot[i + j * N0h] - mrot));
+			}
+		}
+		delete[] drot;
+	}
+	cout << "rotate many max error: " << maxError << endl;
+	delete[] cmany;
+
+	cout << "!!! END TEST ROTATE COMPOSE !!!" << endl;
+}
+
+
 //----------------------------------------------------------------------------------
 //   POWER & PRODUCT TESTS
 //----------------------------------------------------------------------------------
@@ -727,5 +839,508 @@ void TestScheme::testCiphertextWriteAndRead(long logq, long logp, long logn0, lo
 	cout << "!!! END TEST WRITE AND READ !!!" << endl;
 }
 
+void TestScheme::testMoveAndCopy(long logq, long logp, long logn0, long logn1) {
+	cout << "!!! START TEST MOVE AND COPY !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring);
+
+	long n0 = (1 << logn0);
+	long n1 = (1 << logn1);
+	long n = n0 * n1;
+
+	complex<double>* mmat = EvaluatorUtils::randomComplexSignedArray(n);
+	Ciphertext cipher;
+	scheme.encrypt(cipher, mmat, n0, n1, logp, logq);
+
+	Ciphertext moved(std::move(cipher));
+	cipher = moved;
+	complex<double>* dmat = scheme.decrypt(secretKey, cipher);
+	StringUtils::compare(mmat, dmat, n, "assigned");
+
+	Ciphertext taken = std::move(cipher);
+	cipher.copy(taken);
+	complex<double>* dcopy = scheme.decrypt(secretKey, cipher);
+	StringUtils::compare(mmat, dcopy, n, "copied");
+
+	Plaintext msg;
+	scheme.encode(msg, mmat, n0, n1, logp);
+	Plaintext movedmsg(std::move(msg));
+	msg = movedmsg;
+	complex<double>* dmsg = scheme.decode(msg);
+	StringUtils::compare(mmat, dmsg, n, "plain");
+
+	cout << "!!! END TEST MOVE AND COPY !!!" << endl;
+}
+
+void TestScheme::testKeyStore(long logq, long logp, long logn0, long logn1) {
+	cout << "!!! START TEST KEY STORE !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	mkdir("serkey", 0755);
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring, true, true);
+	scheme.addLeftRotKey(secretKey, 1, 0);
+
+	long n0 = (1 << logn0);
+	long n1 = (1 << logn1);
+	long n = n0 * n1;
+
+	complex<double>* mmat1 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmat2 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmult = new complex<double>[n];
+	complex<double>* mrot = new complex<double>[n];
+	for (long i = 0; i < n; ++i) {
+		mmult[i] = mmat1[i] * mmat2[i];
+	}
+	for (long j = 0; j < n1; ++j) {
+		for (long i = 0; i < n0; ++i) {
+			mrot[i + j * n0] = mmat1[(i + 1) % n0 + j * n0];
+		}
+	}
+	Ciphertext cipher1, cipher2, cmult, crot;
+	scheme.encrypt(cipher1, mmat1, n0, n1, logp, logq);
+	scheme.encrypt(cipher2, mmat2, n0, n1, logp, logq);
+
+	scheme.mult(cmult, cipher1, cipher2);
+	scheme.leftRotate(crot, cipher1, 1, 0);
+
+	Key& key = scheme.keyStore.at(scheme.serKeyMap.at(MULTIPLICATION));
+	cout << "mapped keys: " << scheme.keyStore.keys.size() << ", view: " << key.isView << ", Shoup: " << (key.rbxShoup != NULL) << endl;
+
+	complex<double>* dmult = scheme.decrypt(secretKey, cmult);
+	complex<double>* drot = scheme.decrypt(secretKey, crot);
+	StringUtils::compare(mmult, dmult, n, "mult");
+	StringUtils::compare(mrot, drot, n, "rot");
+
+	fstream fout("serkey/BROKEN.txt", ios::binary|ios::out);
+	fout << "broken";
+	fout.close();
+	try {
+		scheme.keyStore.at("serkey/BROKEN.txt");
+	} catch (invalid_argument& e) {
+		cout << "rejected: " << e.what() << endl;
+	}
+	try {
+		scheme.keyStore.at("serkey/MISSING.txt");
+	} catch (invalid_argument& e) {
+		cout << "rejected: " << e.what() << endl;
+	}
+	remove("serkey/BROKEN.txt");
+
+	cout << "!!! END TEST KEY STORE !!!" << endl;
+}
+
+void TestScheme::testSeededKeys(long logq, long logp, long logn0, long logn1) {
+	cout << "!!! START TEST SEEDED KEYS !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	mkdir("serkey", 0755);
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring, false, true, true);
+	Scheme serScheme(secretKey, ring, true, false, true);
+	scheme.addLeftRotKey(secretKey, 1, 0);
+	scheme.addConjKey(secretKey);
+	serScheme.addLeftRotKey(secretKey, 1, 0);
+
+	Key& multKey = scheme.keyMap.at(MULTIPLICATION);
+	cout << "seeded: " << (multKey.rax == NULL) << ", key bytes: " << KeyCache::keyBytes(multKey) << ", rotation key bytes: " << scheme.rotKeyBytes() << endl;
+
+	long n0 = (1 << logn0);
+	long n1 = (1 << logn1);
+	long n = n0 * n1;
+
+	complex<double>* mmat1 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmat2 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmult = new complex<double>[n];
+	complex<double>* mrot = new complex<double>[n];
+	complex<double>* mconj = new complex<double>[n];
+	for (long i = 0; i < n; ++i) {
+		mmult[i] = mmat1[i] * mmat2[i];
+		mconj[i] = conj(mmat1[i]);
+	}
+	for (long j = 0; j < n1; ++j) {
+		for (long i = 0; i < n0; ++i) {
+			mrot[i + j * n0] = mmat1[(i + 1) % n0 + j * n0];
+		}
+	}
+	Ciphertext cipher1, cipher2, cmult, crot, cconj;
+	scheme.encrypt(cipher1, mmat1, n0, n1, logp, logq);
+	scheme.encrypt(cipher2, mmat2, n0, n1, logp, logq);
+
+	TimeUtils timeutils;
+	timeutils.start("mult seeded");
+	scheme.mult(cmult, cipher1, cipher2);
+	timeutils.stop("mult seeded");
+	scheme.conjugate(cconj, cipher1);
+	complex<double>* dmult = scheme.decrypt(secretKey, cmult);
+	complex<double>* dconj = scheme.decrypt(secretKey, cconj);
+	StringUtils::compare(mmult, dmult, n, "mult");
+	StringUtils::compare(mconj, dconj, n, "conj");
+
+	scheme.expandKey(multKey);
+	cout << "expanded: " << (multKey.rax != NULL) << ", key bytes: " << KeyCache::keyBytes(multKey) << endl;
+	timeutils.start("mult expanded");
+	scheme.mult(cmult, cipher1, cipher2);
+	timeutils.stop("mult expanded");
+	dmult = scheme.decrypt(secretKey, cmult);
+	StringUtils::compare(mmult, dmult, n, "expanded mult");
+
+	serScheme.leftRotate(crot, cipher1, 1, 0);
+	complex<double>* drot = serScheme.decrypt(secretKey, crot);
+	StringUtils::compare(mrot, drot, n, "serialized rot");
+
+	cout << "!!! END TEST SEEDED KEYS !!!" << endl;
+}
+
+void TestScheme::testTruncatedKeys(long logq, long logp, long logn0, long logn1) {
+	cout << "!!! START TEST TRUNCATED KEYS !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring, false, true);
+	long rotBytes = scheme.rotKeyBytes();
+	scheme.truncateKeys(logq);
+	scheme.addLeftRotKey(secretKey, 1, 0);
+
+	Key& multKey = scheme.keyMap.at(MULTIPLICATION);
+	Key& rotKey = scheme.leftRotKeyMap.at({1, 0});
+	cout << "key primes: " << multKey.np << ", " << rotKey.np << " of " << nprimes << ", rotation key bytes: " << scheme.rotKeyBytes() << " of " << rotBytes << endl;
+
+	long n0 = (1 << logn0);
+	long n1 = (1 << logn1);
+	long n = n0 * n1;
+
+	complex<double>* mmat1 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmat2 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmult = new complex<double>[n];
+	complex<double>* mrot = new complex<double>[n];
+	for (long i = 0; i < n; ++i) {
+		mmult[i] = mmat1[i] * mmat2[i];
+	}
+	for (long j = 0; j < n1; ++j) {
+		for (long i = 0; i < n0; ++i) {
+			mrot[i + j * n0] = mmult[(i + 1) % n0 + j * n0];
+		}
+	}
+	Ciphertext cipher1, cipher2, cmult, crot;
+	scheme.encrypt(cipher1, mmat1, n0, n1, logp, logq);
+	scheme.encrypt(cipher2, mmat2, n0, n1, logp, logq);
+
+	TimeUtils timeutils;
+	timeutils.start("mult truncated");
+	scheme.mult(cmult, cipher1, cipher2);
+	timeutils.stop("mult truncated");
+	scheme.reScaleByAndEqual(cmult, logp);
+	timeutils.start("rotate truncated");
+	scheme.leftRotate(crot, cmult, 1, 0);
+	timeutils.stop("rotate truncated");
+
+	complex<double>* dmult = scheme.decrypt(secretKey, cmult);
+	complex<double>* drot = scheme.decrypt(secretKey, crot);
+	StringUtils::compare(mmult, dmult, n, "mult");
+	StringUtils::compare(mrot, drot, n, "rot");
+
+	cout << "!!! END TEST TRUNCATED KEYS !!!" << endl;
+}
+
+void TestScheme::testKeyCache(long logq, long logp, long logn0, long logn1, long budgetKeys) {
+	cout << "!!! START TEST KEY CACHE !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	mkdir("serkey", 0755);
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring, true);
+	for (long r = 1; r < 4; ++r) {
+		scheme.addLeftRotKey(secretKey, r, 0);
+	}
+	scheme.addConjKey(secretKey);
+	scheme.keyCache.budget = budgetKeys * scheme.rotKeyBytes();
+	scheme.pinKey(MULTIPLICATION);
+
+	long n0 = (1 << logn0);
+	long n1 = (1 << logn1);
+	long n = n0 * n1;
+
+	complex<double>* mmat1 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmat2 = EvaluatorUtils::randomComplexSignedArray(n);
+	Ciphertext cipher1, cipher2, cres;
+	scheme.encrypt(cipher1, mmat1, n0, n1, logp, logq);
+	scheme.encrypt(cipher2, mmat2, n0, n1, logp, logq);
+
+	double maxError = 0;
+	for (long it = 0; it < 3; ++it) {
+		scheme.mult(cres, cipher1, cipher2);
+		complex<double>* dmult = scheme.decrypt(secretKey, cres);
+		for (long i = 0; i < n; ++i) {
+			maxError = max(maxError, abs(dmult[i] - mmat1[i] * mmat2[i]));
+		}
+		delete[] dmult;
+		for (long r = 1; r < 4; ++r) {
+			scheme.leftRotate(cres, cipher1, r, 0);
+			complex<double>* drot = scheme.decrypt(secretKey, cres);
+			for (long j = 0; j < n1; ++j) {
+				for (long i = 0; i < n0; ++i) {
+					maxError = max(maxError, abs(drot[i + j * n0] - mmat1[(i + r) % n0 + j * n0]));
+				}
+			}
+			delete[] drot;
+		}
+		scheme.conjugate(cres, cipher1);
+		complex<double>* dconj = scheme.decrypt(secretKey, cres);
+		for (long i = 0; i < n; ++i) {
+			maxError = max(maxError, abs(dconj[i] - conj(mmat1[i])));
+		}
+		delete[] dconj;
+	}
+
+	KeyCache& cache = scheme.keyCache;
+	cout << "hits: " << cache.hits << ", misses: " << cache.misses << ", evictions: " << cache.evictions << endl;
+	cout << "cached keys: " << cache.entries.size() << ", bytes: " << cache.bytes << " of " << cache.budget << endl;
+	cout << "mult key pinned and cached: " << cache.entries.count(scheme.serKeyMap.at(MULTIPLICATION)) << ", max error: " << maxError << endl;
+
+	cout << "!!! END TEST KEY CACHE !!!" << endl;
+}
+
+void TestScheme::testResidues(long logq, long np) {
+	cout << "!!! START TEST RESIDUES !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	Ring ring;
+	RingMultiplier& multiplier = ring.multiplier;
+
+	ZZ* a = new ZZ[N];
+	ring.sampleUniform(a, logq);
+	for (long n = 1; n < N; n += 2) {
+		a[n] = -a[n];
+	}
+	a[N - 1] = RandomBits_ZZ(64 * cbnd + 1);
+
+	residue_t* rref = new residue_t[np << logN];
+	residue_t* ra = new residue_t[np << logN];
+	multiplier.toResiduesPrimes(rref, a, np);
+	multiplier.toResidues(ra, a, np);
+	long mismatch = 0;
+	for (long i = 0; i < (np << logN); ++i) {
+		if (ra[i] != rref[i]) mismatch++;
+	}
+	cout << "toResidues mismatches: " << mismatch << endl;
+
+	long nttX0Mismatch = 0, nttX1Mismatch = 0;
+	for (long i = 0; i < np; ++i) {
+		multiplier.NTTX0(rref + (i << logN), i);
+	}
+	multiplier.toNTTX0(ra, a, np);
+	for (long i = 0; i < np; ++i) {
+		for (long n = 0; n < N0; ++n) {
+			if (ra[(i << logN0) + n] != rref[(i << logN) + n]) nttX0Mismatch++;
+		}
+	}
+	cout << "toNTTX0 mismatches: " << nttX0Mismatch << endl;
+
+	ZZ* acol = a + N - N1;
+	multiplier.toResiduesPrimes(rref, a, np);
+	for (long i = 0; i < np; ++i) {
+		residue_t* rrefi = rref + (i << logN);
+		for (long n = 0; n < N1; ++n) {
+			rrefi[n] = rrefi[N - N1 + n];
+		}
+		multiplier.NTTX1(rrefi, i);
+	}
+	multiplier.toNTTX1(ra, acol, np);
+	for (long i = 0; i < np; ++i) {
+		for (long n = 0; n < N1; ++n) {
+			if (ra[(i << logN1) + n] != rref[(i << logN) + n]) nttX1Mismatch++;
+		}
+	}
+	cout << "toNTTX1 mismatches: " << nttX1Mismatch << endl;
+
+	delete[] a;
+	delete[] rref;
+	delete[] ra;
+
+	cout << "!!! END TEST RESIDUES !!!" << endl;
+}
+
+void TestScheme::testNTTSimd(long np) {
+	cout << "!!! START TEST NTT SIMD !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	Ring ring;
+	RingMultiplier& multiplier = ring.multiplier;
+	long detected = multiplier.simdLevel;
+	long len = np << logN;
+
+	residue_t* ra = new residue_t[len];
+	residue_t* rref = new residue_t[len];
+	residue_t* rsimd = new residue_t[len];
+	for (long i = 0; i < np; ++i) {
+		uint64_t p = multiplier.pVec[i];
+		for (long n = 0; n < N; ++n) {
+			ra[(i << logN) + n] = ((uint64_t) rand() << 32 | rand()) % p;
+		}
+	}
+
+	for (long level = SIMD_AVX2; level <= detected; ++level) {
+		long nttMismatch = 0, inttMismatch = 0;
+
+		copy(ra, ra + len, rref);
+		copy(ra, ra + len, rsimd);
+		multiplier.simdLevel = SIMD_NONE;
+		multiplier.NTTX0Batch(rref, np);
+		multiplier.simdLevel = level;
+		multiplier.NTTX0Batch(rsimd, np);
+		for (long i = 0; i < len; ++i) {
+			if (rref[i] != rsimd[i]) nttMismatch++;
+		}
+
+		multiplier.simdLevel = SIMD_NONE;
+		multiplier.INTTX0Batch(rref, np);
+		multiplier.simdLevel = level;
+		multiplier.INTTX0Batch(rsimd, np);
+		for (long i = 0; i < len; ++i) {
+			if (rref[i] != rsimd[i] || rsimd[i] != ra[i]) inttMismatch++;
+		}
+
+		cout << (level == SIMD_AVX512 ? "AVX512" : "AVX2") << " NTTX0 mismatches: " << nttMismatch << ", INTTX0 mismatches: " << inttMismatch << endl;
+	}
+	multiplier.simdLevel = detected;
+
+	delete[] ra;
+	delete[] rref;
+	delete[] rsimd;
+
+	cout << "!!! END TEST NTT SIMD !!!" << endl;
+}
+
+void TestScheme::testNTTOps(long logq, long logp, long logn0, long logn1) {
+	cout << "!!! START TEST NTT OPS !!!" << endl;
+
+	srand(time(NULL));
+	SetNumThreads(8);
+
+	TimeUtils timeutils;
+	Ring ring;
+	SecretKey secretKey(ring);
+	Scheme scheme(secretKey, ring);
+
+	scheme.addLeftRotKey(secretKey, 1, 0);
+	scheme.addConjKey(secretKey);
+
+	long np = ceil((logq + 3)/(double)pbnd);
+	ZZ q = power2_ZZ(logq);
+	ZZ qs = power2_ZZ(logq - logp);
+	ZZ* a = new ZZ[N];
+	ZZ* x = new ZZ[N];
+	ring.sampleUniform(a, logq - 1);
+	for (long n = 1; n < N; n += 2) {
+		a[n] = -a[n];
+	}
+	residue_t* ra = new residue_t[np << logN];
+	ring.toNTT(ra, a, np);
+
+	long zzMismatch = 0, wordsMismatch = 0, scaleMismatch = 0;
+	ring.fromNTT(x, ra, np, q);
+	for (long n = 0; n < N; ++n) {
+		if (x[n] != a[n] % q) zzMismatch++;
+	}
+	CoeffArray xw(qbnd);
+	ring.fromNTT(xw, ra, np, logq);
+	ring.fromCoeffArray(x, xw);
+	for (long n = 0; n < N; ++n) {
+		if (x[n] % q != a[n] % q) wordsMismatch++;
+	}
+	cout << "power-of-two reconstruct mismatches: " << zzMismatch << ", words: " << wordsMismatch << endl;
+
+	timeutils.start("scale NTT");
+	ring.scaleNTT(ra, np, ra, np, logp, logq - logp);
+	timeutils.stop("scale NTT");
+	ring.fromNTT(x, ra, np, qs);
+	for (long n = 0; n < N; ++n) {
+		ZZ r = ((a[n] % q + power2_ZZ(logp - 1)) >> logp) % qs;
+		if (x[n] != r) scaleMismatch++;
+	}
+	cout << "scale NTT mismatches: " << scaleMismatch << endl;
+
+	long n0 = (1 << logn0);
+	long n1 = (1 << logn1);
+	long n = n0 * n1;
+
+	complex<double>* mmat1 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmat2 = EvaluatorUtils::randomComplexSignedArray(n);
+	complex<double>* mmult = new complex<double>[n];
+	complex<double>* mconst = new complex<double>[n];
+	complex<double>* mconj = new complex<double>[n];
+	for (long i = 0; i < n; ++i) {
+		mmult[i] = mmat1[i] * mmat2[i];
+		mconst[i] = mmat1[i] * 3.0;
+		mconj[i] = conj(mmat1[i]);
+	}
+	Ciphertext cipher1, cipher2, cres;
+	scheme.encrypt(cipher1, mmat1, n0, n1, logp, logq);
+	scheme.encrypt(cipher2, mmat2, n0, n1, logp, logq);
+	CiphertextNTT ntt1, ntt2, nttres;
+	scheme.toNTT(ntt1, cipher1);
+	scheme.toNTT(ntt2, cipher2);
+
+	timeutils.start("mult NTT");
+	scheme.mult(cres, ntt1, ntt2);
+	timeutils.stop("mult NTT");
+	scheme.reScaleByAndEqual(cres, logp);
+	complex<double>* dmult = scheme.decrypt(secretKey, cres);
+	StringUtils::compare(mmult, dmult, n, "mult");
+
+	timeutils.start("rescale NTT");
+	scheme.multConst(nttres, ntt1, 3.0, logp);
+	scheme.reScaleByAndEqual(nttres, logp);
+	timeutils.stop("rescale NTT");
+	scheme.fromNTT(cres, nttres);
+	complex<double>* dconst = scheme.decrypt(secretKey, cres);
+	StringUtils::compare(mconst, dconst, n, "const");
+
+	timeutils.start("conjugate NTT");
+	scheme.conjugate(nttres, ntt1);
+	timeutils.stop("conjugate NTT");
+	scheme.fromNTT(cres, nttres);
+	complex<double>* dconj = scheme.decrypt(secretKey, cres);
+	StringUtils::compare(mconj, dconj, n, "conj");
+
+	timeutils.start("left rotate NTT");
+	scheme.leftRotate(nttres, ntt1, 1, 0);
+	timeutils.stop("left rotate NTT");
+	CiphertextNTT moved(std::move(nttres));
+	nttres = moved;
+	scheme.fromNTT(cres, nttres);
+	complex<double>* drot = scheme.decrypt(secretKey, cres);
+	EvaluatorUtils::leftRotateAndEqual(mmat1, n0, n1, 1, 0);
+	StringUtils::compare(mmat1, drot, n, "rot");
+
+	delete[] a;
+	delete[] x;
+	delete[] ra;
+
+	cout << "!!! END TEST NTT OPS !!!" << endl;
+}
+
 void TestScheme::test() {
 }
@@ -36,6 +36,10 @@ public:
 
 	static void testConjugate(long logq, long logp, long logn0, long logn1);
 
+	static void testRotKeyBudget(long logq, long logp, long logn, long budgetKeys);
+
+	static void testRotateCompose(long logq, long logp, bool isMinLatency);
+
 
 	//----------------------------------------------------------------------------------
 	//   POWER & PRODUCT TESTS
@@ -90,6 +94,22 @@ public:
 
 	static void testCiphertextWriteAndRead(long logq, long logp, long logn0, long logn1);
 
+	static void testMoveAndCopy(long logq, long logp, long logn0, long logn1);
+
+	static void testKeyStore(long logq, long logp, long logn0, long logn1);
+
+	static void testSeededKeys(long logq, long logp, long logn0, long logn1);
+
+	static void testTruncatedKeys(long logq, long logp, long logn0, long logn1);
+
+	static void testKeyCache(long logq, long logp, long logn0, long logn1, long budgetKeys);
+
+	static void testResidues(long logq, long np);
+
+	static void testNTTSimd(long np);
+
+	static void testNTTOps(long logq, long logp, long logn0, long logn1);
+
 	static void test();
 
 };